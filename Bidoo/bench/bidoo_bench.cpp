@@ -0,0 +1,1286 @@
+// Offline benchmark of every registered Bidoo model, built with `make bidoo_bench`.
+// Each module is driven with deterministic audio, clocks and poly CV and timed
+// outside of the engine, results go to stdout and to a CSV file.
+//
+// usage: ./bidoo_bench [-s seconds] [-r samplerate] [-o results.csv] [-w file.wav]... [-b] [-c] [-k] [-f] [-t] [-l] [-v] [-d] [SLUG...]
+//
+// -w times the mono and stereo sample decoders on a file instead, the CSV row
+// then holds ns per decoded frame, the whole load time and the decode peak heap.
+// It also times interpolated reads from the float and int16 sample storages,
+// with ns per read, the whole pass and the heap the loaded sample keeps.
+//
+// -b times dsp::DoubleRingBuffer against the single copy ringbuffer::RingBuffer
+// at FREIN's size, per sample and in EDSAROS sized blocks, with ns per element
+// and the heap the buffer takes.
+//
+// -c checks slideCurve against powf and against the powTable[100][10000]
+// ZOUMAI and ENCORE used to interpolate, on every slide step and a fine phase
+// grid, then times the three. The worst error goes in the worst column and
+// the run fails when either exceeds its tolerance.
+//
+// -k runs every model that supports control rate evaluation at audio rate and
+// at each division of its menu on the same signals, audio into its inputs
+// named "In" and slow CV into the others. The worst column holds the RMS
+// difference of all outputs relative to their audio rate RMS, the run fails
+// when it exceeds CONTROL_RATE_TOLERANCE.
+//
+// -f runs svf::PolySVF against the per channel MultiFilter OAI, MAGMA and
+// PERCO used before, over 16 and then 7 channels with random modes, Q and
+// active voices and stepping cutoffs, then times both. The worst column holds
+// the largest output difference relative to the peak, the run fails when it
+// exceeds POLY_SVF_TOLERANCE.
+//
+// -t fills FORK's formant table with the per entry loop it used before and
+// with init_formant, then times both. The run fails unless the two tables are
+// bit for bit equal.
+//
+// -l checks fastTanh against std::tanh on a fine grid, then runs LIMBO on
+// 16 channels a side against the scalar ladder it ran per channel before, in
+// linear and nonlinear mode with swept cutoff and gain, and times both. The
+// worst column holds the largest fastTanh error and the largest output
+// difference relative to the peak, the run fails when either exceeds
+// FAST_TANH_TOLERANCE or LIMBO_TOLERANCE.
+//
+// -v runs REI against its previous loop, the scalar freeverb and a tanh per
+// channel, on the same audio with shimmer feedback and freeze toggling every
+// 1.5 s, then times both. It runs at 44.1 kHz whatever -r says, the rate the
+// old reverb was tuned for. The worst column holds the largest output
+// difference in volts, the run fails when it exceeds REVERB_TOLERANCE.
+//
+// -d checks fastLog2 and fastExp2 against log2 and exp2 over the exponents
+// the detectors and the gain use, then runs BAR's stereo linked detector and
+// gain computer with levelDb and dbToGain against the log10, exp and pow path
+// it ran before, on the same enveloped audio, and times both in ns and time
+// stamp counter cycles per sample (0 off x86). The worst column holds the largest log2 error, exp2
+// relative error, meter and gain differences in dB, the run fails when any
+// exceeds LOG2_TOLERANCE, EXP2_TOLERANCE, METER_TOLERANCE or GAIN_TOLERANCE.
+
+#include "plugin.hpp"
+#include "dep/waves.hpp"
+#include "dep/ringbuffer.hpp"
+#include "dep/filters/svf.hpp"
+#include "dep/filters/pitchshifter.h"
+#include "dep/freeverb/tuning.hh"
+#include "dep/dynamics.hpp"
+#include <context.hpp>
+#include <settings.hpp>
+#include <random.hpp>
+#include <engine/Engine.hpp>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+void init(rack::Plugin *p);
+
+// FORK's formant table
+extern float TF[];
+extern bool TF_ready;
+void init_formant(void);
+
+// heap accounting, every allocation carries its size in a header
+static std::atomic<size_t> heapCurrent{0};
+static std::atomic<size_t> heapPeak{0};
+static const size_t heapHeader = alignof(std::max_align_t);
+
+void *operator new(size_t size) {
+	char *p = (char*)std::malloc(size + heapHeader);
+	if (!p) std::abort();
+	*(size_t*)p = size;
+	size_t current = heapCurrent.fetch_add(size) + size;
+	size_t peak = heapPeak.load();
+	while ((current > peak) && !heapPeak.compare_exchange_weak(peak, current)) {}
+	return p + heapHeader;
+}
+
+void operator delete(void *ptr) noexcept {
+	if (!ptr) return;
+	char *p = (char*)ptr - heapHeader;
+	heapCurrent.fetch_sub(*(size_t*)p);
+	std::free(p);
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { operator delete(ptr); }
+
+enum SignalType {
+	SIGNAL_AUDIO,
+	SIGNAL_CLOCK,
+	SIGNAL_CV
+};
+
+static bool nameContains(const std::string &name, const char *word) {
+	return string::lowercase(name).find(word) != std::string::npos;
+}
+
+static SignalType signalType(const std::string &name) {
+	static const char *clockWords[] = {"clock", "trig", "gate", "reset", "run", "sync", "play", "rec"};
+	static const char *cvWords[] = {"v/oct", "cv", "pitch", "cutoff", "freq", "mod", "pos", "speed", "level", "gain", "size", "time"};
+	for (const char *word : clockWords) {
+		if (nameContains(name, word)) return SIGNAL_CLOCK;
+	}
+	for (const char *word : cvWords) {
+		if (nameContains(name, word)) return SIGNAL_CV;
+	}
+	return SIGNAL_AUDIO;
+}
+
+struct SignalGenerator {
+	uint32_t seed = 0x12345678;
+	float phase = 0.f;
+
+	float noise() {
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) * (2.f / 16777216.f) - 1.f;
+	}
+
+	// signals only depend on the frame index and a fixed seed so runs are repeatable
+	float audio(int64_t frame, float sampleTime) {
+		phase += 220.f * sampleTime;
+		if (phase >= 1.f) phase -= 1.f;
+		return 4.f * std::sin(2.f * M_PI * phase) + 0.5f * noise();
+	}
+
+	static float clock(int64_t frame, float sampleRate) {
+		int64_t period = (int64_t)(sampleRate / 8.f);
+		return (frame % period) < (period / 2) ? 10.f : 0.f;
+	}
+
+	static float cv(int64_t frame, float sampleRate, int channel) {
+		float t = (float)frame / sampleRate * (0.25f + 0.1f * channel);
+		float tri = 2.f * std::fabs(2.f * (t - std::floor(t + 0.5f))) - 1.f;
+		return 2.f * tri;
+	}
+};
+
+struct BenchResult {
+	std::string slug;
+	double nsPerSample = 0.0;
+	double worstNs = 0.0;
+	size_t peakHeap = 0;
+};
+
+static void setInputs(engine::Module *module, const std::vector<SignalType> &types, SignalGenerator &generator, int64_t frame, float sampleRate) {
+	float audio = generator.audio(frame, 1.f / sampleRate);
+	for (int i = 0; i < (int)module->inputs.size(); i++) {
+		switch (types[i]) {
+			case SIGNAL_AUDIO: module->inputs[i].setVoltage(audio); break;
+			case SIGNAL_CLOCK: module->inputs[i].setVoltage(SignalGenerator::clock(frame, sampleRate)); break;
+			case SIGNAL_CV:
+				for (int c = 0; c < 4; c++) module->inputs[i].setVoltage(SignalGenerator::cv(frame, sampleRate, c), c);
+				break;
+		}
+	}
+}
+
+static BenchResult benchModel(Model *model, float sampleRate, float seconds) {
+	BenchResult result;
+	result.slug = model->slug;
+
+	size_t heapBase = heapCurrent.load();
+	heapPeak.store(heapBase);
+
+	engine::Module *module = model->createModule();
+
+	engine::Module::SampleRateChangeEvent e;
+	e.sampleRate = sampleRate;
+	e.sampleTime = 1.f / sampleRate;
+	module->onSampleRateChange(e);
+
+	std::vector<SignalType> types;
+	for (int i = 0; i < (int)module->inputs.size(); i++) {
+		SignalType type = signalType(module->inputInfos[i]->name);
+		types.push_back(type);
+		module->inputs[i].setChannels(type == SIGNAL_CV ? 4 : 1);
+	}
+	for (Output &output : module->outputs) {
+		output.setChannels(1);
+	}
+
+	SignalGenerator generator;
+	engine::Module::ProcessArgs args;
+	args.sampleRate = sampleRate;
+	args.sampleTime = 1.f / sampleRate;
+
+	int64_t frames = (int64_t)(sampleRate * seconds);
+	double total = 0.0;
+	for (int64_t frame = 0; frame < frames; frame++) {
+		setInputs(module, types, generator, frame, sampleRate);
+		args.frame = frame;
+		auto start = std::chrono::steady_clock::now();
+		module->process(args);
+		auto stop = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+		total += ns;
+		if (ns > result.worstNs) result.worstNs = ns;
+	}
+
+	result.nsPerSample = frames > 0 ? total / frames : 0.0;
+	result.peakHeap = heapPeak.load() - heapBase;
+	delete module;
+	return result;
+}
+
+template <typename Decoder>
+static BenchResult benchDecode(const std::string &name, Decoder decode, const std::string &path, float sampleRate) {
+	BenchResult result;
+	result.slug = name + ":" + system::getFilename(path);
+	size_t heapBase = heapCurrent.load();
+	heapPeak.store(heapBase);
+
+	std::string fileName, extension;
+	int channels = 0, rate = 0, count = 0;
+	auto start = std::chrono::steady_clock::now();
+	size_t frames = decode(path, sampleRate, fileName, extension, channels, rate, count).size();
+	auto stop = std::chrono::steady_clock::now();
+
+	result.worstNs = std::chrono::duration<double, std::nano>(stop - start).count();
+	result.nsPerSample = frames > 0 ? result.worstNs / frames : 0.0;
+	result.peakHeap = heapPeak.load() - heapBase;
+	return result;
+}
+
+static BenchResult benchRead(const std::string &name, bool compact, const std::string &path, float sampleRate) {
+	BenchResult result;
+	result.slug = name + ":" + system::getFilename(path);
+	size_t heapBase = heapCurrent.load();
+
+	std::string fileName, extension;
+	int channels = 0, rate = 0, count = 0;
+	waves::StereoSample sample = waves::getStereoSample(path, sampleRate, fileName, extension, channels, rate, count, compact);
+	result.peakHeap = heapCurrent.load() - heapBase;
+	size_t size = sample->size();
+	if (size < 2) return result;
+
+	// a detuned playback pass, every read interpolates two frames
+	static volatile float sink;
+	float sum = 0.f;
+	int64_t reads = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (double pos = 0.0; pos < size - 1; pos += 1.37) {
+		int xi = pos;
+		float xf = pos - xi;
+		dsp::Frame<2> a = sample->frame(xi);
+		dsp::Frame<2> b = sample->frame(xi + 1);
+		sum += crossfade(a.samples[0], b.samples[0], xf) + crossfade(a.samples[1], b.samples[1], xf);
+		reads++;
+	}
+	auto stop = std::chrono::steady_clock::now();
+	sink = sum;
+
+	result.worstNs = std::chrono::duration<double, std::nano>(stop - start).count();
+	result.nsPerSample = result.worstNs / reads;
+	return result;
+}
+
+static const size_t RING_SIZE = 262144;
+static const size_t RING_BLOCK = 256;
+typedef dsp::DoubleRingBuffer<float, RING_SIZE> DoubleRing;
+typedef ringbuffer::RingBuffer<float, RING_SIZE> SingleRing;
+
+static float ringAt(DoubleRing &buffer, size_t i) {
+	return buffer.startData()[i];
+}
+
+static float ringAt(SingleRing &buffer, size_t i) {
+	return buffer.at(i);
+}
+
+static void ringWrite(DoubleRing &buffer, const float *block, size_t n) {
+	std::memcpy(buffer.endData(), block, n * sizeof(float));
+	buffer.endIncr(n);
+}
+
+static void ringWrite(SingleRing &buffer, const float *block, size_t n) {
+	buffer.push(block, n);
+}
+
+// one push a sample, an interpolated read walking through the window as FREIN
+// does, and a shift once full as the BAR meters do
+template <typename Buffer>
+static BenchResult benchRing(const std::string &name, int64_t count) {
+	BenchResult result;
+	result.slug = name;
+	size_t heapBase = heapCurrent.load();
+	Buffer *buffer = new Buffer;
+	result.peakHeap = heapCurrent.load() - heapBase;
+
+	static volatile float sink;
+	float sum = 0.f;
+	size_t offset = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int64_t i = 0; i < count; i++) {
+		if (buffer->full()) {
+			sum -= ringAt(*buffer, 0);
+			buffer->startIncr(1);
+		}
+		buffer->push((float)(i & 1023));
+		if (buffer->size() > 1) {
+			offset = (offset + 7) % (buffer->size() - 1);
+			sum += crossfade(ringAt(*buffer, offset), ringAt(*buffer, offset + 1), 0.37f);
+		}
+	}
+	auto stop = std::chrono::steady_clock::now();
+	sink = sum;
+	delete buffer;
+
+	result.worstNs = std::chrono::duration<double, std::nano>(stop - start).count();
+	result.nsPerSample = result.worstNs / count;
+	return result;
+}
+
+// block writes drained one sample at a time, as the EDSAROS voices do
+template <typename Buffer>
+static BenchResult benchRingBlock(const std::string &name, int64_t count) {
+	BenchResult result;
+	result.slug = name;
+	size_t heapBase = heapCurrent.load();
+	Buffer *buffer = new Buffer;
+	result.peakHeap = heapCurrent.load() - heapBase;
+
+	static volatile float sink;
+	float block[RING_BLOCK];
+	for (size_t i = 0; i < RING_BLOCK; i++) block[i] = (float)i;
+	float sum = 0.f;
+	auto start = std::chrono::steady_clock::now();
+	for (int64_t i = 0; i < count; i++) {
+		if (buffer->empty()) ringWrite(*buffer, block, RING_BLOCK);
+		sum += ringAt(*buffer, 0);
+		buffer->startIncr(1);
+	}
+	auto stop = std::chrono::steady_clock::now();
+	sink = sum;
+	delete buffer;
+
+	result.worstNs = std::chrono::duration<double, std::nano>(stop - start).count();
+	result.nsPerSample = result.worstNs / count;
+	return result;
+}
+
+static const float CONTROL_RATE_TOLERANCE = 0.02f;
+
+// all output voltages of a run, frame after frame, or nothing when the model
+// doesn't support control rate evaluation
+static std::vector<float> runControlRate(Model *model, float sampleRate, float seconds, int division) {
+	std::vector<float> result;
+	engine::Module *module = model->createModule();
+	BidooModule *bidooModule = dynamic_cast<BidooModule*>(module);
+	if (!bidooModule || !bidooModule->controlRateSupported) {
+		delete module;
+		return result;
+	}
+	bidooModule->controlRateDivision = division;
+
+	engine::Module::SampleRateChangeEvent e;
+	e.sampleRate = sampleRate;
+	e.sampleTime = 1.f / sampleRate;
+	module->onSampleRateChange(e);
+
+	// the divisions only claim to follow control signals, so anything else
+	// than the audio inputs gets CV
+	std::vector<SignalType> types;
+	for (int i = 0; i < (int)module->inputs.size(); i++) {
+		bool audio = (i == 0) || (module->inputInfos[i]->name.compare(0, 2, "In") == 0);
+		types.push_back(audio ? SIGNAL_AUDIO : SIGNAL_CV);
+		module->inputs[i].setChannels(audio ? 1 : 4);
+	}
+
+	SignalGenerator generator;
+	engine::Module::ProcessArgs args;
+	args.sampleRate = sampleRate;
+	args.sampleTime = 1.f / sampleRate;
+	int64_t frames = (int64_t)(sampleRate * seconds);
+	for (int64_t frame = 0; frame < frames; frame++) {
+		setInputs(module, types, generator, frame, sampleRate);
+		args.frame = frame;
+		module->process(args);
+		for (Output &output : module->outputs) {
+			for (int c = 0; c < output.getChannels(); c++) result.push_back(output.getVoltage(c));
+		}
+	}
+	delete module;
+	return result;
+}
+
+static bool checkControlRate(const std::vector<std::string> &slugs, Plugin *plugin, float sampleRate, float seconds, FILE *csv) {
+	static const int divisions[5] = {4, 8, 16, 32, 64};
+	bool passed = true;
+	for (Model *model : plugin->models) {
+		if (!slugs.empty() && (std::find(slugs.begin(), slugs.end(), model->slug) == slugs.end())) continue;
+		std::vector<float> reference = runControlRate(model, sampleRate, seconds, 1);
+		if (reference.empty()) continue;
+		double power = 0.0;
+		for (float v : reference) power += (double)v * v;
+
+		for (int division : divisions) {
+			std::vector<float> output = runControlRate(model, sampleRate, seconds, division);
+			size_t n = std::min(output.size(), reference.size());
+			double error = 0.0;
+			for (size_t i = 0; i < n; i++) error += ((double)output[i] - reference[i]) * ((double)output[i] - reference[i]);
+			double relative = power > 0.0 ? std::sqrt(error / power) : std::sqrt(error / std::max(n, (size_t)1));
+			bool ok = (output.size() == reference.size()) && (relative <= CONTROL_RATE_TOLERANCE);
+			passed &= ok;
+			std::string name = model->slug + ":" + std::to_string(division);
+			std::printf("%-24s %14.2e %s\n", name.c_str(), relative, ok ? "ok" : "FAILED");
+			std::fprintf(csv, "%s,0,%.3e,0\n", name.c_str(), relative);
+		}
+	}
+	std::printf("tolerance %.0e of the audio rate RMS\n", CONTROL_RATE_TOLERANCE);
+	return passed;
+}
+
+// The table read phase*9999 from entries j*0.0001 apart, so it was itself up
+// to 1e-4 below powf. Against it only phases from 0.01 on count, below it the
+// table interpolated linearly from 0.
+static const float SLIDE_POWF_TOLERANCE = 2e-5f;
+static const float SLIDE_TABLE_TOLERANCE = 2e-4f;
+
+static bool checkSlideCurve(FILE *csv) {
+	std::vector<float> table(100 * 10000);
+	for (int i = 0; i < 100; i++) {
+		for (int j = 0; j < 10000; j++) {
+			table[i * 10000 + j] = powf(j * 0.0001f, i * 0.01f);
+		}
+	}
+
+	const int phases = 20000;
+	float tableError = 0.f, powError = 0.f;
+	for (int s = 0; s <= 1000; s++) {
+		float slide = s * 0.001f;
+		const float *row = &table[(int)(slide * 99.0f) * 10000];
+		for (int p = 0; p <= phases; p++) {
+			float phase = (float)p / phases;
+			float y = slideCurve(slide, phase);
+			if (phase >= 0.01f) tableError = std::max(tableError, std::fabs(y - interpolateLinear(row, 9999.0f * phase)));
+			powError = std::max(powError, std::fabs(y - powf(phase, (int)(slide * 99.0f) * 0.01f)));
+		}
+	}
+
+	static volatile float sink;
+	const char *names[3] = {"slide-table", "slide-powf", "slide-curve"};
+	float errors[3] = {0.f, 0.f, std::max(tableError, powError)};
+	const int64_t count = 10000000;
+	for (int k = 0; k < 3; k++) {
+		float sum = 0.f;
+		auto start = std::chrono::steady_clock::now();
+		for (int64_t i = 0; i < count; i++) {
+			float slide = (i & 1023) * (1.f / 1024.f);
+			float phase = ((i * 7919) & 65535) * (1.f / 65536.f);
+			int row = (int)(slide * 99.0f);
+			if (k == 0) sum += interpolateLinear(&table[row * 10000], 9999.0f * phase);
+			else if (k == 1) sum += powf(phase, row * 0.01f);
+			else sum += slideCurve(slide, phase);
+		}
+		auto stop = std::chrono::steady_clock::now();
+		sink = sum;
+		double ns = std::chrono::duration<double, std::nano>(stop - start).count() / count;
+		std::printf("%-24s %8.2f ns/call %14.2e\n", names[k], ns, errors[k]);
+		std::fprintf(csv, "%s,%.2f,%.3e,0\n", names[k], ns, errors[k]);
+	}
+	std::printf("slideCurve vs powf %.2e (tolerance %.0e), vs table %.2e (tolerance %.0e)\n", powError, SLIDE_POWF_TOLERANCE, tableError, SLIDE_TABLE_TOLERANCE);
+	return (powError <= SLIDE_POWF_TOLERANCE) && (tableError <= SLIDE_TABLE_TOLERANCE);
+}
+
+static const float POLY_SVF_TOLERANCE = 1e-3f;
+
+// the filter each module kept per channel, with a tan per sample
+struct MultiFilter {
+	float q;
+	float freq;
+	float smpRate;
+	float hp = 0.0f, bp = 0.0f, lp = 0.0f, mem1 = 0.0f, mem2 = 0.0f;
+
+	void setParams(float freq, float q, float smpRate) {
+		this->freq = freq;
+		this->q = q;
+		this->smpRate = smpRate;
+	}
+
+	void calcOutput(float sample) {
+		float g = std::tan(M_PI * freq / smpRate);
+		float R = 1.0f / (2.0f * q);
+		hp = (sample - (2.0f * R + g) * mem1 - mem2) / (1.0f + 2.0f * R * g + g * g);
+		bp = g * hp + mem1;
+		lp = g * bp + mem2;
+		mem1 = g * hp + bp;
+		mem2 = g * bp + lp;
+	}
+};
+
+// voices change cutoff every 64 samples, so both the cached and the
+// evaluated coefficients run, and mode, Q and active flag every 4800
+static void polySVFFrame(SignalGenerator &generator, int64_t frame, float sampleRate, float *in, float *pitch, float *q, int *mode, bool *active) {
+	for (int v = 0; v < 16; v++) {
+		in[v] = generator.audio(frame, 1.f / sampleRate) * 0.2f;
+		if ((frame % 64) == 0) {
+			// 30 Hz to 0.4 of the rate, under the bank's Nyquist clamp
+			float t = (float)frame / sampleRate * (0.3f + 0.05f * v);
+			float sweep = std::fabs(2.f * (t - std::floor(t + 0.5f)));
+			pitch[v] = crossfade(std::log2(30.f), std::log2(0.4f * sampleRate), sweep);
+		}
+		if ((frame % 4800) == 0) {
+			mode[v] = std::min((int)(4.f * (0.5f + 0.5f * generator.noise())), 3);
+			q[v] = 10.f * (0.55f + 0.45f * generator.noise());
+			active[v] = generator.noise() > -0.6f;
+		}
+	}
+}
+
+static bool checkPolySVF(float sampleRate, float seconds, FILE *csv) {
+	int64_t frames = (int64_t)(sampleRate * seconds);
+	float worst = 0.f;
+	static volatile float sink;
+	for (int channels : {16, 7}) {
+		svf::PolySVF bank;
+		MultiFilter reference[16];
+		SignalGenerator generator;
+		float in[16], pitch[16], q[16];
+		int mode[16];
+		bool active[16];
+		float error = 0.f, peak = 0.f;
+		double elapsed[2] = {0.0, 0.0};
+		for (int64_t frame = 0; frame < frames; frame++) {
+			polySVFFrame(generator, frame, sampleRate, in, pitch, q, mode, active);
+
+			auto start = std::chrono::steady_clock::now();
+			for (int v = 0; v < 16; v++) {
+				bank.in[v] = in[v];
+				bank.pitch[v] = pitch[v];
+				bank.q[v] = q[v];
+				bank.mode[v] = mode[v];
+				bank.active[v] = active[v];
+			}
+			bank.process(1.f / sampleRate, channels);
+			auto middle = std::chrono::steady_clock::now();
+			float y[16];
+			for (int v = 0; v < channels; v++) {
+				if (!active[v]) continue;
+				reference[v].setParams(std::pow(2.f, pitch[v]), q[v], sampleRate);
+				reference[v].calcOutput(in[v]);
+				y[v] = mode[v] == svf::LOWPASS ? reference[v].lp : mode[v] == svf::BANDPASS ? reference[v].bp : mode[v] == svf::HIGHPASS ? reference[v].hp : in[v];
+			}
+			auto stop = std::chrono::steady_clock::now();
+			elapsed[0] += std::chrono::duration<double, std::nano>(middle - start).count();
+			elapsed[1] += std::chrono::duration<double, std::nano>(stop - middle).count();
+
+			for (int v = 0; v < channels; v++) {
+				if (!active[v]) continue;
+				error = std::max(error, std::fabs(bank.out[v] - y[v]));
+				peak = std::max(peak, std::fabs(y[v]));
+				sink = y[v];
+			}
+		}
+		float relative = peak > 0.f ? error / peak : error;
+		worst = std::max(worst, relative);
+		const char *names[2] = {"poly-svf", "multifilter"};
+		for (int k = 0; k < 2; k++) {
+			std::string name = std::string(names[k]) + ":" + std::to_string(channels);
+			double perSample = elapsed[k] / frames;
+			std::printf("%-24s %8.1f ns/sample %14.2e\n", name.c_str(), perSample, k == 0 ? relative : 0.f);
+			std::fprintf(csv, "%s,%.2f,%.3e,0\n", name.c_str(), perSample, k == 0 ? relative : 0.f);
+		}
+	}
+	std::printf("PolySVF vs MultiFilter %.2e of the peak (tolerance %.0e)\n", worst, POLY_SVF_TOLERANCE);
+	return worst <= POLY_SVF_TOLERANCE;
+}
+
+static const int FORMANT_TABLE_SIZE = 256 + 1;
+static const int FORMANT_WIDTHS = 64;
+
+static float formantCos(const float x) {
+	float x2 = x * x;
+	return 1.0f + x2 * (-4.0f + 2.0f * x2);
+}
+
+// fonc_formant as FORK evaluated it for every entry
+static float formantReference(float p, const float I) {
+	float a = 0.5f;
+	int hmax = int(10 * I) > FORMANT_TABLE_SIZE / 2 ? FORMANT_TABLE_SIZE / 2 : int(10 * I);
+	float phi = 0.0f;
+	for (int h = 1; h < hmax; h++) {
+		phi += 3.14159265359f * p;
+		float hann = 0.5f + 0.5f * formantCos(h * (1.0f / hmax));
+		float gaussienne = 0.85f * std::exp(-h * h / (I * I));
+		float jupe = 0.15f;
+		float harmonique = std::cos(phi);
+		a += hann * (gaussienne + jupe) * harmonique;
+	}
+	return a;
+}
+
+static bool checkFormantTable(FILE *csv) {
+	const int size = FORMANT_TABLE_SIZE * FORMANT_WIDTHS;
+	std::vector<float> reference(size);
+	float coef = 2.0f / (FORMANT_TABLE_SIZE - 1);
+	auto start = std::chrono::steady_clock::now();
+	for (int I = 0; I < FORMANT_WIDTHS; I++) {
+		for (int P = 0; P < FORMANT_TABLE_SIZE; P++) {
+			reference[P + I * FORMANT_TABLE_SIZE] = formantReference(-1 + P * coef, float(I));
+		}
+	}
+	auto middle = std::chrono::steady_clock::now();
+	TF_ready = false;
+	init_formant();
+	auto stop = std::chrono::steady_clock::now();
+
+	int mismatches = 0;
+	for (int i = 0; i < size; i++) {
+		if (std::memcmp(&reference[i], &TF[i], sizeof(float))) mismatches++;
+	}
+	double ms[2] = {
+		std::chrono::duration<double, std::milli>(middle - start).count(),
+		std::chrono::duration<double, std::milli>(stop - middle).count()
+	};
+	const char *names[2] = {"formant-reference", "formant-table"};
+	for (int k = 0; k < 2; k++) {
+		std::printf("%-24s %8.2f ms %14d\n", names[k], ms[k], k == 1 ? mismatches : 0);
+		std::fprintf(csv, "%s,%.0f,%d,0\n", names[k], ms[k] * 1e6, k == 1 ? mismatches : 0);
+	}
+	std::printf("%d of %d entries differ from the reference\n", mismatches, size);
+	return mismatches == 0;
+}
+
+static const float FAST_TANH_TOLERANCE = 1e-4f;
+static const float LIMBO_RATE = 44100.f;
+static const float LIMBO_TOLERANCE = 2e-4f;
+
+// LIMBO's ladder as it ran per channel, std::tanh in every stage
+struct LadderReference {
+	float mem[4] = {};
+
+	float stage(int i, float sample, float g, float gain, float tanhGain, int mode) {
+		float G = g / (1.0 + g);
+		float out;
+		if (mode == 0) {
+			out = (sample - mem[i]) * G + mem[i];
+		} else {
+			out = (std::tanh(sample*gain) / tanhGain - mem[i]) * G + mem[i];
+		}
+		mem[i] = out + (sample - mem[i]) * G;
+		return out;
+	}
+
+	float process(float sample, float g, float q, float gain, float tanhGain, int mode) {
+		float G = g / (1.0f + g);
+		G = G*G*G*G;
+		float S = G*G*G*(mem[0] / (1.0f + g)) + G*G*(mem[1] / (1.0f + g)) + G*(mem[2] / (1.0f + g)) + mem[3] / (1.0f + g);
+		float y = (sample - q * S) / (1.0f + q * G);
+		for (int i = 0; i < 4; i++) y = stage(i, y, g, gain, tanhGain, mode);
+		return y;
+	}
+};
+
+static int findInput(engine::Module *module, const char *name) {
+	for (int i = 0; i < (int)module->inputs.size(); i++) {
+		if (module->inputInfos[i]->name == name) return i;
+	}
+	std::fprintf(stderr, "no %s input\n", name);
+	return -1;
+}
+
+static int findParam(engine::Module *module, const char *name) {
+	for (int i = 0; i < (int)module->params.size(); i++) {
+		if (module->paramQuantities[i]->name == name) return i;
+	}
+	std::fprintf(stderr, "no %s param\n", name);
+	return -1;
+}
+
+static bool checkFastTanh(FILE *csv) {
+	// past +-5 both are within 1e-4 of +-1
+	const int points = 160000;
+	std::vector<float> x(points), y(points), reference(points);
+	for (int i = 0; i < points; i++) x[i] = -8.f + 16.f * i / points;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < points; i++) y[i] = fastTanh(x[i]);
+	auto middle = std::chrono::steady_clock::now();
+	for (int i = 0; i < points; i++) reference[i] = std::tanh(x[i]);
+	auto stop = std::chrono::steady_clock::now();
+
+	float error = 0.f;
+	for (int i = 0; i < points; i += 4) {
+		// the float_4 instance LIMBO and BAFIS run
+		simd::float_4 y4 = fastTanh(simd::float_4::load(&x[i]));
+		for (int k = 0; k < 4; k++) {
+			error = std::max(error, std::fabs(y[i + k] - reference[i + k]));
+			error = std::max(error, std::fabs(y4[k] - reference[i + k]));
+		}
+	}
+	double elapsed[2] = {
+		std::chrono::duration<double, std::nano>(middle - start).count(),
+		std::chrono::duration<double, std::nano>(stop - middle).count()
+	};
+	const char *names[2] = {"fast-tanh", "std-tanh"};
+	for (int k = 0; k < 2; k++) {
+		double perCall = elapsed[k] / points;
+		std::printf("%-24s %8.1f ns/call %14.2e\n", names[k], perCall, k == 0 ? error : 0.f);
+		std::fprintf(csv, "%s,%.2f,%.3e,0\n", names[k], perCall, k == 0 ? error : 0.f);
+	}
+	std::printf("fastTanh vs std::tanh %.2e (tolerance %.0e)\n", error, FAST_TANH_TOLERANCE);
+	return error <= FAST_TANH_TOLERANCE;
+}
+
+static bool checkLimbo(Plugin *plugin, float seconds, FILE *csv) {
+	bool passed = checkFastTanh(csv);
+	Model *model = plugin->getModel("LIMBO");
+	if (!model) return false;
+	for (int mode = 0; mode < 2; mode++) {
+		engine::Module *module = model->createModule();
+		engine::Module::SampleRateChangeEvent e;
+		e.sampleRate = LIMBO_RATE;
+		e.sampleTime = 1.f / LIMBO_RATE;
+		module->onSampleRateChange(e);
+		int inL = findInput(module, "In L (poly)");
+		int inR = findInput(module, "In R (poly)");
+		int cutoffInput = findInput(module, "Cutoff");
+		int qInput = findInput(module, "Q");
+		int mugInput = findInput(module, "Mug");
+		int modParam = findParam(module, "Freq. Mod");
+		int modeParam = findParam(module, "Linear");
+		if ((std::min({inL, inR, cutoffInput, qInput, mugInput}) < 0) || (modParam < 0) || (modeParam < 0)) {
+			delete module;
+			return false;
+		}
+		// the knobs at 0 and full modulation depth, so each control is its input
+		for (Param &param : module->params) param.setValue(0.f);
+		module->params[modParam].setValue(1.f);
+		module->params[modeParam].setValue(mode);
+		module->inputs[inL].setChannels(16);
+		module->inputs[inR].setChannels(16);
+		module->inputs[cutoffInput].setChannels(1);
+		module->inputs[qInput].setChannels(1);
+		module->inputs[mugInput].setChannels(1);
+
+		LadderReference reference[32];
+		SignalGenerator generator;
+		engine::Module::ProcessArgs args;
+		args.sampleRate = LIMBO_RATE;
+		args.sampleTime = 1.f / LIMBO_RATE;
+		int64_t frames = (int64_t)(LIMBO_RATE * seconds);
+		float error = 0.f, peak = 0.f;
+		double elapsed[2] = {0.0, 0.0};
+		for (int64_t frame = 0; frame < frames; frame++) {
+			// cutoff over most of its range. Mug stays in its lower half and Q
+			// low: past that the nonlinear stages gain enough to self
+			// oscillate, and any difference then only shows as a phase drift.
+			float audio = generator.audio(frame, 1.f / LIMBO_RATE);
+			float in[32];
+			for (int c = 0; c < 32; c++) in[c] = audio * (1.f - c / 40.f);
+			float cutoffCV = 2.5f + 1.125f * SignalGenerator::cv(frame, LIMBO_RATE, 0);
+			float qCV = 1.5f;
+			float mugCV = 1.25f + 0.625f * SignalGenerator::cv(frame, LIMBO_RATE, 1);
+			for (int c = 0; c < 16; c++) {
+				module->inputs[inL].setVoltage(in[c], c);
+				module->inputs[inR].setVoltage(in[16 + c], c);
+			}
+			module->inputs[cutoffInput].setVoltage(cutoffCV);
+			module->inputs[qInput].setVoltage(qCV);
+			module->inputs[mugInput].setVoltage(mugCV);
+			args.frame = frame;
+
+			auto start = std::chrono::steady_clock::now();
+			module->process(args);
+			auto middle = std::chrono::steady_clock::now();
+			float cutoff = clamp(cutoffCV * 0.2f, 0.0f, 1.0f);
+			float cfreq = std::pow(2.0f, rescale(cutoff, 0.0f, 1.0f, 4.5f, 14.0f));
+			float g = std::tan(M_PI * cfreq / LIMBO_RATE);
+			float q = 3.5f * clamp(qCV * 0.2f, 0.0f, 1.0f);
+			float mug = std::pow(2.0f, rescale(clamp(mugCV * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 0.0f, 3.0f));
+			float gain = mug / 3;
+			float tanhGain = std::tanh(gain);
+			float y[32];
+			for (int c = 0; c < 32; c++) {
+				y[c] = reference[c].process(in[c] * 0.2f, g, q, gain, tanhGain, mode) * 5.0f * (mode == 0 ? mug : 1);
+			}
+			auto stop = std::chrono::steady_clock::now();
+			elapsed[0] += std::chrono::duration<double, std::nano>(middle - start).count();
+			elapsed[1] += std::chrono::duration<double, std::nano>(stop - middle).count();
+
+			for (int c = 0; c < 16; c++) {
+				error = std::max(error, std::fabs(module->outputs[0].getVoltage(c) - y[c]));
+				error = std::max(error, std::fabs(module->outputs[1].getVoltage(c) - y[16 + c]));
+				peak = std::max(peak, std::max(std::fabs(y[c]), std::fabs(y[16 + c])));
+			}
+		}
+		delete module;
+
+		float relative = peak > 0.f ? error / peak : error;
+		const char *names[2] = {"limbo", "limbo-scalar"};
+		for (int k = 0; k < 2; k++) {
+			std::string name = std::string(names[k]) + (mode == 0 ? ":linear" : ":nonlinear");
+			double perSample = frames > 0 ? elapsed[k] / frames : 0.0;
+			std::printf("%-24s %8.1f ns/sample %8.1f ns/channel %14.2e\n", name.c_str(), perSample, perSample / 32, k == 0 ? relative : 0.f);
+			std::fprintf(csv, "%s,%.2f,%.3e,0\n", name.c_str(), perSample, k == 0 ? relative : 0.f);
+		}
+		std::printf("LIMBO %s vs the scalar ladder %.2e V on a %.2f V peak, %.2e of it (tolerance %.0e)\n", mode == 0 ? "linear" : "nonlinear", error, peak, relative, LIMBO_TOLERANCE);
+		passed &= relative <= LIMBO_TOLERANCE;
+	}
+	return passed;
+}
+
+static const float REVERB_RATE = 44100.f;
+static const float REVERB_TOLERANCE = 1e-4f;
+
+// the scalar freeverb REI ran before, 8 combs and 4 allpasses a side at the
+// 44.1 kHz tunings, with update() folded into process()
+struct ScalarReverb {
+	struct Line {
+		std::vector<float> buffer;
+		int index = 0;
+		float store = 0.f;
+
+		Line(int size) : buffer(size, 0.f) {}
+	};
+
+	std::vector<Line> combL, combR, allpassL, allpassR;
+	float roomsize = 0.f, damp = 0.f, wet = 0.f, dry = 0.f, width = 0.f, mode = 0.f;
+
+	ScalarReverb() {
+		const int combs[numcombs] = {combtuningL1, combtuningL2, combtuningL3, combtuningL4, combtuningL5, combtuningL6, combtuningL7, combtuningL8};
+		const int allpasses[numallpasses] = {allpasstuningL1, allpasstuningL2, allpasstuningL3, allpasstuningL4};
+		for (int size : combs) {
+			combL.emplace_back(size);
+			combR.emplace_back(size + stereospread);
+		}
+		for (int size : allpasses) {
+			allpassL.emplace_back(size);
+			allpassR.emplace_back(size + stereospread);
+		}
+	}
+
+	static float comb(Line &line, float input, float feedback, float damp1) {
+		float output = line.buffer[line.index];
+		line.store = (output * (1 - damp1)) + (line.store * damp1);
+		line.buffer[line.index] = input + (line.store * feedback);
+		if (++line.index >= (int)line.buffer.size()) line.index = 0;
+		return output;
+	}
+
+	static float allpass(Line &line, float input) {
+		float bufout = line.buffer[line.index];
+		line.buffer[line.index] = input + (bufout * 0.5f);
+		if (++line.index >= (int)line.buffer.size()) line.index = 0;
+		return -input + bufout;
+	}
+
+	void process(float inL, float inR, float fbIn, float &outputL, float &outputR) {
+		bool frozen = mode >= freezemode;
+		float feedback = frozen ? 1.f : roomsize;
+		float damp1 = frozen ? 0.f : damp;
+		float gain = frozen ? muted : fixedgain;
+		float wet1 = wet * (width / 2 + 0.5f);
+		float wet2 = wet * ((1 - width) / 2);
+		float input = (inL + inR + fbIn) * gain;
+		float outL = 0.f, outR = 0.f;
+		for (int i = 0; i < numcombs; i++) {
+			outL += comb(combL[i], input, feedback, damp1);
+			outR += comb(combR[i], input, feedback, damp1);
+		}
+		for (int i = 0; i < numallpasses; i++) {
+			outL = allpass(allpassL[i], outL);
+			outR = allpass(allpassR[i], outR);
+		}
+		outputL = outL * wet1 + outR * wet2 + inL * dry;
+		outputR = outR * wet1 + outL * wet2 + inR * dry;
+	}
+};
+
+// REI's inputs, its knobs are all set to 0 so each control is its input alone
+static const int REVERB_INPUTS = 10;
+static const char *reverbInputs[REVERB_INPUTS] = {"In L", "In R", "Size", "Damp", "Freeze", "Width", "Shim", "Shim pitch", "Dry", "Wet"};
+
+static void reverbFrame(SignalGenerator &generator, int64_t frame, float *v) {
+	float audio = generator.audio(frame, 1.f / REVERB_RATE);
+	v[0] = audio;
+	v[1] = 0.7f * audio;
+	v[2] = 0.5f + 0.2f * SignalGenerator::cv(frame, REVERB_RATE, 0);
+	v[3] = 0.5f;
+	v[4] = ((frame > 0) && ((frame % (int64_t)(1.5f * REVERB_RATE)) < 64)) ? 10.f : 0.f;
+	v[5] = 0.8f;
+	v[6] = 5.f;
+	v[7] = 2.f;
+	v[8] = 5.f;
+	v[9] = 6.f;
+}
+
+// REI's process() as it was around the scalar reverb
+struct ReverbReference {
+	ScalarReverb reverb;
+	ringbuffer::RingBuffer<float, 2 * 512> pin;
+	PitchShifter shifter;
+	dsp::SchmittTrigger freezeTrigger;
+	bool freeze = false;
+
+	ReverbReference() {
+		shifter.init(512, 4, REVERB_RATE);
+		shifter.amortized = true;
+		shifter.fastKernel = true;
+	}
+
+	void process(const float *v, float &outL, float &outR) {
+		reverb.damp = clamp(v[3], 0.f, 1.f) * scaledamp;
+		reverb.roomsize = (clamp(v[2], 0.f, 1.f) * scaleroom) + offsetroom;
+		reverb.wet = clamp(rescale(v[9], 0.f, 10.f, 0.f, 1.f), 0.f, 1.f) * scalewet;
+		reverb.dry = clamp(rescale(v[8], 0.f, 10.f, 0.f, 1.f), 0.f, 1.f) * scaledry;
+		reverb.width = clamp(v[5], 0.f, 1.f);
+		if (freezeTrigger.process(v[4])) freeze = !freeze;
+		reverb.mode = freeze ? 1.f : 0.f;
+		float fact = clamp(rescale(v[6], 0.f, 10.f, 0.f, 1.f), 0.f, 1.f) * 3.f;
+		float fbIn = 0.f;
+		if (pin.size() > 512) {
+			fbIn = fact * pin.front();
+			pin.startIncr(1);
+		}
+		reverb.process(v[0] * 0.1f, v[1] * 0.1f, fbIn, outL, outR);
+		outL = std::tanh(outL / 5.f) * 7.f;
+		outR = std::tanh(outR / 5.f) * 7.f;
+		pin.push(shifter.processSample(clamp(v[7], 0.5f, 4.f), (outL + outR) * 0.05f));
+	}
+};
+
+static bool checkReverb(Plugin *plugin, float seconds, FILE *csv) {
+	Model *model = plugin->getModel("REI");
+	if (!model) return false;
+	engine::Module *module = model->createModule();
+	engine::Module::SampleRateChangeEvent e;
+	e.sampleRate = REVERB_RATE;
+	e.sampleTime = 1.f / REVERB_RATE;
+	module->onSampleRateChange(e);
+	for (Param &param : module->params) param.setValue(0.f);
+
+	int ids[REVERB_INPUTS];
+	for (int k = 0; k < REVERB_INPUTS; k++) {
+		ids[k] = -1;
+		for (int i = 0; i < (int)module->inputs.size(); i++) {
+			if (module->inputInfos[i]->name == reverbInputs[k]) ids[k] = i;
+		}
+		if (ids[k] < 0) {
+			std::fprintf(stderr, "REI has no %s input\n", reverbInputs[k]);
+			delete module;
+			return false;
+		}
+		module->inputs[ids[k]].setChannels(1);
+	}
+	for (Output &output : module->outputs) output.setChannels(1);
+
+	ReverbReference reference;
+	SignalGenerator generator;
+	engine::Module::ProcessArgs args;
+	args.sampleRate = REVERB_RATE;
+	args.sampleTime = 1.f / REVERB_RATE;
+	int64_t frames = (int64_t)(REVERB_RATE * seconds);
+	float error = 0.f, peak = 0.f;
+	double elapsed[2] = {0.0, 0.0};
+	for (int64_t frame = 0; frame < frames; frame++) {
+		float v[REVERB_INPUTS];
+		reverbFrame(generator, frame, v);
+		for (int k = 0; k < REVERB_INPUTS; k++) module->inputs[ids[k]].setVoltage(v[k]);
+		args.frame = frame;
+
+		auto start = std::chrono::steady_clock::now();
+		module->process(args);
+		auto middle = std::chrono::steady_clock::now();
+		float outL, outR;
+		reference.process(v, outL, outR);
+		auto stop = std::chrono::steady_clock::now();
+		elapsed[0] += std::chrono::duration<double, std::nano>(middle - start).count();
+		elapsed[1] += std::chrono::duration<double, std::nano>(stop - middle).count();
+
+		error = std::max(error, std::fabs(module->outputs[0].getVoltage() - outL));
+		error = std::max(error, std::fabs(module->outputs[1].getVoltage() - outR));
+		peak = std::max(peak, std::max(std::fabs(outL), std::fabs(outR)));
+	}
+	delete module;
+
+	const char *names[2] = {"rei", "rei-scalar"};
+	for (int k = 0; k < 2; k++) {
+		double perSample = frames > 0 ? elapsed[k] / frames : 0.0;
+		std::printf("%-24s %8.1f ns/sample %14.2e\n", names[k], perSample, k == 0 ? error : 0.f);
+		std::fprintf(csv, "%s,%.2f,%.3e,0\n", names[k], perSample, k == 0 ? error : 0.f);
+	}
+	std::printf("REI vs the scalar freeverb %.2e V on a %.2f V peak (tolerance %.0e V)\n", error, peak, REVERB_TOLERANCE);
+	return error <= REVERB_TOLERANCE;
+}
+
+static const float LOG2_TOLERANCE = 1.5e-5f;
+static const float EXP2_TOLERANCE = 3e-6f;
+// in dB, fastLog2's 9e-5 plus the rounding of the float log10 path near -96 dB
+static const float METER_TOLERANCE = 1.5e-4f;
+static const float GAIN_TOLERANCE = 1.5e-4f;
+static const float DYNAMICS_THRESHOLD = -20.f;
+static const float DYNAMICS_RATIO = 4.f;
+static const float DYNAMICS_KNEE = 6.f;
+static const float DYNAMICS_ATTACK = 10.f;
+static const float DYNAMICS_RELEASE = 100.f;
+static const float DYNAMICS_MAKEUP = 6.f;
+
+// time stamp counter, 0 where there is none
+static uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// BAR's levels and gain as they were, log10 per signal, exp per coefficient
+// and pow for the knee and the gain on every sample
+static void dynamicsReference(const float *inL, const float *inR, int64_t frames, float sampleRate, float *levels, float *gains) {
+	float previousPostGain = 1.0f;
+	for (int64_t n = 0; n < frames; n++) {
+		float in_L_dBFS = std::max(20.0f*std::log10((std::fabs(inL[n])+1e-6f) * 0.2f), -96.3f);
+		float in_R_dBFS = std::max(20.0f*std::log10((std::fabs(inR[n])+1e-6f) * 0.2f), -96.3f);
+		float maxIn = std::max(in_L_dBFS, in_R_dBFS);
+		float slope = 1.0f/DYNAMICS_RATIO-1.0f;
+		float dist = maxIn-DYNAMICS_THRESHOLD;
+		float gcurve = 0.0f;
+		if (dist<-1.0f*DYNAMICS_KNEE/2.0f)
+			gcurve = maxIn;
+		else if ((dist > -1.0f*DYNAMICS_KNEE*0.5f) && (dist < DYNAMICS_KNEE*0.5f))
+			gcurve = maxIn + slope*std::pow(dist + DYNAMICS_KNEE*0.5f, 2.0f)/(2.0f*DYNAMICS_KNEE);
+		else
+			gcurve = maxIn + slope*dist;
+		float preGain = gcurve - maxIn;
+		float cAtt = std::exp(-1.0f/(DYNAMICS_ATTACK*sampleRate*0.001f));
+		float cRel = std::exp(-1.0f/(DYNAMICS_RELEASE*sampleRate*0.001f));
+		float postGain = preGain<previousPostGain ? cAtt*previousPostGain+(1.0f-cAtt)*preGain : cRel*previousPostGain+(1.0f-cRel)*preGain;
+		previousPostGain = postGain;
+		gains[n] = std::pow(10.0f, (DYNAMICS_MAKEUP + postGain)/20.0f);
+		levels[2 * n] = in_L_dBFS;
+		levels[2 * n + 1] = in_R_dBFS;
+	}
+}
+
+// the same with the four detector levels in one float_4 as BAR runs it now,
+// the side chain lanes unconnected
+static void dynamicsPath(const float *inL, const float *inR, int64_t frames, float sampleRate, float *levels, float *gains) {
+	dynamics::GainComputer gainComputer;
+	for (int64_t n = 0; n < frames; n++) {
+		simd::float_4 connected = simd::float_4(1.f, 1.f, 0.f, 0.f) != 0.f;
+		simd::float_4 dBFS = simd::ifelse(connected, dynamics::levelDb(simd::float_4(inL[n], inR[n], 0.f, 0.f)), -96.3f);
+		float maxIn = std::max(dBFS[0], dBFS[1]);
+		gainComputer.setTimes(DYNAMICS_ATTACK, DYNAMICS_RELEASE, sampleRate);
+		gains[n] = dynamics::dbToGain(DYNAMICS_MAKEUP + gainComputer.process(maxIn, DYNAMICS_THRESHOLD, DYNAMICS_RATIO, DYNAMICS_KNEE));
+		levels[2 * n] = dBFS[0];
+		levels[2 * n + 1] = dBFS[1];
+	}
+}
+
+static bool checkDynamics(float sampleRate, float seconds, FILE *csv) {
+	// log2 over the levels above the -96.3 dB floor, exp2 over every normal
+	// exponent, both in 1/4096 steps
+	const int logPoints = 32 * 4096;
+	const int points = 254 * 4096;
+	std::vector<float> x(points), y(points);
+	for (int i = 0; i < logPoints; i++) y[i] = (float)std::exp2(-16.0 + i / 4096.0);
+
+	double sweepNs[2], sweepCycles[2];
+	float log2Error = 0.f, exp2Error = 0.f;
+	auto start = std::chrono::steady_clock::now();
+	uint64_t cycles = readCycles();
+	for (int i = 0; i < logPoints; i += 4) dynamics::fastLog2(simd::float_4::load(&y[i])).store(&x[i]);
+	sweepCycles[0] = (double)(readCycles() - cycles) / logPoints;
+	sweepNs[0] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / logPoints;
+	for (int i = 0; i < logPoints; i++) log2Error = std::max(log2Error, (float)std::fabs(x[i] - std::log2((double)y[i])));
+
+	for (int i = 0; i < points; i++) x[i] = -126.f + i * (1.f / 4096.f);
+	start = std::chrono::steady_clock::now();
+	cycles = readCycles();
+	for (int i = 0; i < points; i += 4) dynamics::fastExp2(simd::float_4::load(&x[i])).store(&y[i]);
+	sweepCycles[1] = (double)(readCycles() - cycles) / points;
+	sweepNs[1] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / points;
+	for (int i = 0; i < points; i++) {
+		double reference = std::exp2((double)x[i]);
+		exp2Error = std::max(exp2Error, (float)std::fabs(y[i] / reference - 1.0));
+		// the scalar instance BAR and MINIBAR run for the gain
+		exp2Error = std::max(exp2Error, (float)std::fabs(dynamics::fastExp2(x[i]) / reference - 1.0));
+	}
+
+	int64_t frames = (int64_t)(sampleRate * seconds);
+	std::vector<float> inL(frames), inR(frames);
+	SignalGenerator generator;
+	for (int64_t frame = 0; frame < frames; frame++) {
+		// envelopes from silence to full scale so the knee, attack and release all run
+		float audio = generator.audio(frame, 1.f / sampleRate);
+		inL[frame] = audio * (0.5f + 0.25f * SignalGenerator::cv(frame, sampleRate, 0));
+		inR[frame] = 0.7f * audio * (0.5f + 0.25f * SignalGenerator::cv(frame, sampleRate, 1));
+	}
+
+	std::vector<float> levels[2], gains[2];
+	double pathNs[2], pathCycles[2];
+	for (int k = 0; k < 2; k++) {
+		levels[k].resize(2 * frames);
+		gains[k].resize(frames);
+		start = std::chrono::steady_clock::now();
+		cycles = readCycles();
+		if (k == 0) dynamicsPath(inL.data(), inR.data(), frames, sampleRate, levels[k].data(), gains[k].data());
+		else dynamicsReference(inL.data(), inR.data(), frames, sampleRate, levels[k].data(), gains[k].data());
+		pathCycles[k] = frames > 0 ? (double)(readCycles() - cycles) / frames : 0.0;
+		pathNs[k] = frames > 0 ? std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / frames : 0.0;
+	}
+
+	float meterError = 0.f, gainError = 0.f;
+	for (int64_t n = 0; n < frames; n++) {
+		meterError = std::max(meterError, std::fabs(levels[0][2 * n] - levels[1][2 * n]));
+		meterError = std::max(meterError, std::fabs(levels[0][2 * n + 1] - levels[1][2 * n + 1]));
+		gainError = std::max(gainError, (float)std::fabs(20.0 * std::log10((double)gains[0][n] / gains[1][n])));
+	}
+
+	const char *names[4] = {"fast-log2", "fast-exp2", "dynamics", "dynamics-log10"};
+	double ns[4] = {sweepNs[0], sweepNs[1], pathNs[0], pathNs[1]};
+	double perSample[4] = {sweepCycles[0], sweepCycles[1], pathCycles[0], pathCycles[1]};
+	float errors[4] = {log2Error, exp2Error, std::max(meterError, gainError), 0.f};
+	for (int k = 0; k < 4; k++) {
+		std::printf("%-24s %8.1f ns/sample %8.1f cycles/sample %14.2e\n", names[k], ns[k], perSample[k], errors[k]);
+		std::fprintf(csv, "%s,%.2f,%.3e,0\n", names[k], ns[k], errors[k]);
+	}
+	std::printf("fastLog2 vs log2 %.2e (tolerance %.1e), fastExp2 vs exp2 %.2e relative (tolerance %.0e)\n", log2Error, LOG2_TOLERANCE, exp2Error, EXP2_TOLERANCE);
+	std::printf("meters vs log10 %.2e dB (tolerance %.1e dB), gain vs pow %.2e dB (tolerance %.1e dB)\n", meterError, METER_TOLERANCE, gainError, GAIN_TOLERANCE);
+	return (log2Error <= LOG2_TOLERANCE) && (exp2Error <= EXP2_TOLERANCE) && (meterError <= METER_TOLERANCE) && (gainError <= GAIN_TOLERANCE);
+}
+
+int main(int argc, char **argv) {
+	float seconds = 10.f;
+	float sampleRate = 48000.f;
+	std::string csvPath = "bidoo_bench.csv";
+	std::vector<std::string> slugs;
+	std::vector<std::string> wavs;
+	bool rings = false;
+	bool slides = false;
+	bool controlRate = false;
+	bool polySVF = false;
+	bool formants = false;
+	bool reverb = false;
+	bool limbo = false;
+	bool dynamicsPaths = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "-s") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else if (!std::strcmp(argv[i], "-r") && (i + 1 < argc)) sampleRate = std::atof(argv[++i]);
+		else if (!std::strcmp(argv[i], "-o") && (i + 1 < argc)) csvPath = argv[++i];
+		else if (!std::strcmp(argv[i], "-w") && (i + 1 < argc)) wavs.push_back(argv[++i]);
+		else if (!std::strcmp(argv[i], "-b")) rings = true;
+		else if (!std::strcmp(argv[i], "-c")) slides = true;
+		else if (!std::strcmp(argv[i], "-k")) controlRate = true;
+		else if (!std::strcmp(argv[i], "-f")) polySVF = true;
+		else if (!std::strcmp(argv[i], "-t")) formants = true;
+		else if (!std::strcmp(argv[i], "-l")) limbo = true;
+		else if (!std::strcmp(argv[i], "-v")) reverb = true;
+		else if (!std::strcmp(argv[i], "-d")) dynamicsPaths = true;
+		else slugs.push_back(argv[i]);
+	}
+
+	random::init();
+	settings::sampleRate = sampleRate;
+	Context *context = new Context;
+	contextSet(context);
+	context->engine = new engine::Engine;
+	context->engine->setSuggestedSampleRate(sampleRate);
+	context->engine->stepBlock(1);
+
+	Plugin *plugin = new Plugin;
+	plugin->slug = "Bidoo";
+	plugin->path = ".";
+	init(plugin);
+
+	FILE *csv = std::fopen(csvPath.c_str(), "w");
+	if (!csv) {
+		std::fprintf(stderr, "cannot write %s\n", csvPath.c_str());
+		return 1;
+	}
+	std::fprintf(csv, "model,ns_per_sample,worst_ns,peak_heap_bytes\n");
+
+	if (controlRate) {
+		bool passed = checkControlRate(slugs, plugin, sampleRate, seconds, csv);
+		std::fclose(csv);
+		return passed ? 0 : 1;
+	}
+
+	if (polySVF) {
+		bool passed = checkPolySVF(sampleRate, seconds, csv);
+		std::fclose(csv);
+		return passed ? 0 : 1;
+	}
+
+	if (formants) {
+		bool passed = checkFormantTable(csv);
+		std::fclose(csv);
+		return passed ? 0 : 1;
+	}
+
+	if (limbo) {
+		bool passed = checkLimbo(plugin, seconds, csv);
+		std::fclose(csv);
+		return passed ? 0 : 1;
+	}
+
+	if (reverb) {
+		bool passed = checkReverb(plugin, seconds, csv);
+		std::fclose(csv);
+		return passed ? 0 : 1;
+	}
+
+	if (dynamicsPaths) {
+		bool passed = checkDynamics(sampleRate, seconds, csv);
+		std::fclose(csv);
+		return passed ? 0 : 1;
+	}
+
+	if (slides) {
+		bool passed = checkSlideCurve(csv);
+		std::fclose(csv);
+		return passed ? 0 : 1;
+	}
+
+	if (rings) {
+		int64_t count = seconds * sampleRate;
+		BenchResult results[4] = {
+			benchRing<DoubleRing>("ring-double", count),
+			benchRing<SingleRing>("ring-single", count),
+			benchRingBlock<DoubleRing>("ring-double-block", count),
+			benchRingBlock<SingleRing>("ring-single-block", count)
+		};
+		for (const BenchResult &result : results) {
+			std::printf("%-24s %8.2f ns/sample %10.1f ms %16zu\n", result.slug.c_str(), result.nsPerSample, result.worstNs / 1e6, result.peakHeap);
+			std::fprintf(csv, "%s,%.2f,%.0f,%zu\n", result.slug.c_str(), result.nsPerSample, result.worstNs, result.peakHeap);
+		}
+		std::fclose(csv);
+		return 0;
+	}
+
+	if (!wavs.empty()) {
+		for (const std::string &path : wavs) {
+			BenchResult results[4] = {
+				benchDecode("mono", waves::getMonoWav, path, sampleRate),
+				benchDecode("stereo", waves::getStereoWav, path, sampleRate),
+				benchRead("read-float", false, path, sampleRate),
+				benchRead("read-int16", true, path, sampleRate)
+			};
+			for (const BenchResult &result : results) {
+				std::printf("%-24s %8.1f ns/frame %10.1f ms %16zu\n", result.slug.c_str(), result.nsPerSample, result.worstNs / 1e6, result.peakHeap);
+				std::fprintf(csv, "%s,%.2f,%.0f,%zu\n", result.slug.c_str(), result.nsPerSample, result.worstNs, result.peakHeap);
+			}
+		}
+		std::fclose(csv);
+		return 0;
+	}
+
+	std::printf("%-12s %14s %12s %16s\n", "model", "ns/sample", "worst ns", "peak heap");
+	for (Model *model : plugin->models) {
+		if (!slugs.empty() && (std::find(slugs.begin(), slugs.end(), model->slug) == slugs.end())) continue;
+		BenchResult result = benchModel(model, sampleRate, seconds);
+		std::printf("%-12s %14.1f %12.0f %16zu\n", result.slug.c_str(), result.nsPerSample, result.worstNs, result.peakHeap);
+		std::fprintf(csv, "%s,%.2f,%.0f,%zu\n", result.slug.c_str(), result.nsPerSample, result.worstNs, result.peakHeap);
+	}
+
+	std::fclose(csv);
+	return 0;
+}
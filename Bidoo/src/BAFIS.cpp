@@ -1,34 +1,13 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
 #include "dsp/resampler.hpp"
+#include "dep/filters/svf.hpp"
 
 using namespace std;
+using simd::float_4;
 
 #define pi 3.14159265359
 
-struct MultiFilter {
-	float q;
-	float freq;
-	float smpRate;
-	float hp = 0.0f, bp = 0.0f, lp = 0.0f, mem1 = 0.0f, mem2 = 0.0f;
-
-	void setParams(float freq, float q, float smpRate) {
-		this->freq = freq;
-		this->q = q;
-		this->smpRate = smpRate;
-	}
-
-	void calcOutput(float sample) {
-		float g = tan(pi * freq / smpRate);
-		float R = 1.0f / (2.0f*q);
-		hp = (sample - (2.0f*R + g)*mem1 - mem2) / (1.0f + 2.0f * R * g + g * g);
-		bp = g * hp + mem1;
-		lp = g * bp + mem2;
-		mem1 = g * hp + bp;
-		mem2 = g * bp + lp;
-	}
-};
-
 struct BAFIS : BidooModule {
 	enum ParamIds {
 		FREQ_PARAM,
@@ -57,7 +36,16 @@ struct BAFIS : BidooModule {
 		NUM_LIGHTS
 	};
 
-	MultiFilter filter0, filter1,filter2, filter3, filter4, filter5;
+	// lane i of the float_4s is band i. The first stage holds the band 0 low
+	// pass and the high passes of bands 1, 2 and 3, the second stage low
+	// passes the high passes of bands 1 and 2, its lanes 0 and 3 are unused.
+	svf::SVF<float_4> stage1[16], stage2[16];
+	ControlRamp4 g1Ramps[16], g2Ramps[16], qRamps[16], driveRamps[16], volumeRamps[16];
+	// crossover cutoffs the g ramps were last set from, -1 to set them again
+	float_4 cutoffs[16];
+	// per band distortion type and pre/post, shared by the channels
+	float_4 tanhMask = 0.0f, sinMask = 0.0f, postMask = 0.0f;
+	bool anyTanh = false, anySin = false, anyPre = false, anyPost = false, band2Post = false;
 
 	///Tooltip
 	struct tpType : ParamQuantity {
@@ -94,155 +82,111 @@ struct BAFIS : BidooModule {
       configParam<tpPrePost>(PREPOST_PARAM+i, 0.f, 1.f, 0.f, "Pre/Post");
       configParam(VOLUME_PARAM+i, 0.f, 1.f, 0.5f, "Volume", "%", 0.f, 100.f);
     }
-	}
 
-	void process(const ProcessArgs &args) override {
-    float in = inputs[IN].getVoltage() * 0.2f; //normalise to -1/+1 we consider VCV Rack standard is #+5/-5V on VCO1
-    float out = 0.f;
-		float c0freq = std::pow(2.0f, rescale(clamp(params[FREQ_PARAM].getValue() + inputs[FREQ_INPUT].getVoltage() * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f));
-		float c1freq = std::pow(2.0f, rescale(clamp(params[FREQ_PARAM+1].getValue() + inputs[FREQ_INPUT+1].getVoltage() * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f));
-		float c2freq = std::pow(2.0f, rescale(clamp(params[FREQ_PARAM+2].getValue() + inputs[FREQ_INPUT+2].getVoltage() * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f));
-
-    float q0 = 10.0f * clamp(params[Q_PARAM].getValue() + inputs[Q_INPUT].getVoltage() / 10.f, 0.1f, 1.0f);
-    float q1 = 10.0f * clamp(params[Q_PARAM+1].getValue() + inputs[Q_INPUT+1].getVoltage() / 10.f, 0.1f, 1.0f);
-    float q2 = 10.0f * clamp(params[Q_PARAM+2].getValue() + inputs[Q_INPUT+2].getVoltage() / 10.f, 0.1f, 1.0f);
-    float q3 = 10.0f * clamp(params[Q_PARAM+3].getValue() + inputs[Q_INPUT+3].getVoltage() / 10.f, 0.1f, 1.0f);
+		for (int c = 0; c < 16; c++) cutoffs[c] = -1.0f;
 
-    float g0 = clamp(params[GAIN_PARAM].getValue() + inputs[GAIN_INPUT].getVoltage(), 1.f, 10.0f);
-    float g1 = clamp(params[GAIN_PARAM+1].getValue() + inputs[GAIN_INPUT+1].getVoltage(), 1.f, 10.0f);
-    float g2 = clamp(params[GAIN_PARAM+2].getValue() + inputs[GAIN_INPUT+2].getVoltage(), 1.f, 10.0f);
-    float g3 = clamp(params[GAIN_PARAM+3].getValue() + inputs[GAIN_INPUT+3].getVoltage(), 1.f, 10.0f);
-
-		float v0 = clamp(params[VOLUME_PARAM].getValue() + inputs[VOLUME_INPUT].getVoltage() * 0.1f, 0.f, 1.0f);
-    float v1 = clamp(params[VOLUME_PARAM+1].getValue() + inputs[VOLUME_INPUT+1].getVoltage() * 0.1f, 0.f, 1.0f);
-    float v2 = clamp(params[VOLUME_PARAM+2].getValue() + inputs[VOLUME_INPUT+2].getVoltage() * 0.1f, 0.f, 1.0f);
-    float v3 = clamp(params[VOLUME_PARAM+3].getValue() + inputs[VOLUME_INPUT+3].getVoltage() * 0.1f, 0.f, 1.0f);
+		controlRateSupported = true;
+	}
 
-    if ((params[PREPOST_PARAM].getValue() == 0.f) || (inputs[PREPOST_INPUT].isConnected() && (inputs[PREPOST_INPUT].getVoltage()<1.f))) {
-      float dIn = 0.f;
-      if ((params[TYPE_PARAM].getValue() == 0.f) || (inputs[TYPE_INPUT].isConnected() && (inputs[TYPE_INPUT].getVoltage() == 0.f))) {
-        dIn = tanh(g0*in);
-      }
-      else if ((params[TYPE_PARAM].getValue() == 1.f) || (inputs[TYPE_INPUT].isConnected() && (inputs[TYPE_INPUT].getVoltage() == 1.f))) {
-        dIn = sin(g0*in);
-      }
-      else {
-        dIn = clamp(g0*in,-1.0f,1.0f);
-      }
-      filter0.setParams(c0freq, q0, args.sampleRate);
-    	filter0.calcOutput(dIn);
-  		out = filter0.lp * v0 * 30517578125e-15f;
-    }
-    else {
-      filter0.setParams(c0freq, q0, args.sampleRate);
-    	filter0.calcOutput(in);
-      if ((params[TYPE_PARAM].getValue() == 0.f) || (inputs[TYPE_INPUT].isConnected() && (inputs[TYPE_INPUT].getVoltage() == 0.f))) {
-        out = tanh(g0*filter0.lp) * v0 * 30517578125e-15f;
-      }
-      else if ((params[TYPE_PARAM].getValue() == 1.f) || (inputs[TYPE_INPUT].isConnected() && (inputs[TYPE_INPUT].getVoltage() == 1.f))) {
-        out = sin(g0*filter0.lp) * v0 * 30517578125e-15f;
-      }
-      else {
-        out = clamp(g0*filter0.lp,-1.f,1.f) * v0 * 30517578125e-15f;
-      }
-    }
+	// the g ramps are prewarped for the rate
+	void onSampleRateChange(const SampleRateChangeEvent &e) override {
+		for (int c = 0; c < 16; c++) cutoffs[c] = -1.0f;
+	}
 
-    if ((params[PREPOST_PARAM+1].getValue() == 0.f) || (inputs[PREPOST_INPUT+1].isConnected() && (inputs[PREPOST_INPUT+1].getVoltage()<1.f))) {
-      float dIn = 0.f;
-      if ((params[TYPE_PARAM+1].getValue() == 0.f) || (inputs[TYPE_INPUT+1].isConnected() && (inputs[TYPE_INPUT+1].getVoltage() == 0.f))) {
-        dIn = tanh(g1*in);
-      }
-      else if ((params[TYPE_PARAM+1].getValue() == 1.f) || (inputs[TYPE_INPUT+1].isConnected() && (inputs[TYPE_INPUT+1].getVoltage() == 1.f))) {
-        dIn = sin(g1*in);
-      }
-      else {
-        dIn = clamp(g1*in,-1.0f,1.0f);
-      }
-      filter1.setParams(c0freq, q1, args.sampleRate);
-    	filter1.calcOutput(dIn);
-      filter2.setParams(c1freq, q1, args.sampleRate);
-    	filter2.calcOutput(filter1.hp);
-      out += filter2.lp * v1 * 30517578125e-15f;
-    }
-    else {
-      filter1.setParams(c0freq, q1, args.sampleRate);
-    	filter1.calcOutput(in);
-      filter2.setParams(c1freq, q1, args.sampleRate);
-    	filter2.calcOutput(filter1.hp);
-      if ((params[TYPE_PARAM+1].getValue() == 0.f) || (inputs[TYPE_INPUT+1].isConnected() && (inputs[TYPE_INPUT+1].getVoltage() == 0.f))) {
-        out += tanh(g1*filter2.lp) * v1 * 30517578125e-15f;
-      }
-      else if ((params[TYPE_PARAM+1].getValue() == 1.f) || (inputs[TYPE_INPUT+1].isConnected() && (inputs[TYPE_INPUT+1].getVoltage() == 1.f))) {
-        out += sin(g1*filter2.lp) * v1 * 30517578125e-15f;
-      }
-      else {
-        out += clamp(g1*filter2.lp,-1.f,1.f) * v1 * 30517578125e-15f;
-      }
-    }
+	void updateBands() {
+		float_4 type = 2.0f, post = 0.0f;
+		for (int i = 0; i < 4; i++) {
+			bool typeCv = inputs[TYPE_INPUT+i].isConnected();
+			if ((params[TYPE_PARAM+i].getValue() == 0.f) || (typeCv && (inputs[TYPE_INPUT+i].getVoltage() == 0.f))) {
+				type[i] = 0.0f;
+			}
+			else if ((params[TYPE_PARAM+i].getValue() == 1.f) || (typeCv && (inputs[TYPE_INPUT+i].getVoltage() == 1.f))) {
+				type[i] = 1.0f;
+			}
+			if (!((params[PREPOST_PARAM+i].getValue() == 0.f) || (inputs[PREPOST_INPUT+i].isConnected() && (inputs[PREPOST_INPUT+i].getVoltage()<1.f)))) {
+				post[i] = 1.0f;
+			}
+		}
+		tanhMask = type == 0.0f;
+		sinMask = type == 1.0f;
+		postMask = post != 0.0f;
+		anyTanh = simd::movemask(tanhMask) != 0;
+		anySin = simd::movemask(sinMask) != 0;
+		anyPost = simd::movemask(postMask) != 0;
+		anyPre = simd::movemask(postMask) != 0xF;
+		band2Post = post[2] != 0.0f;
+	}
 
-    if ((params[PREPOST_PARAM+2].getValue() == 0.f) || (inputs[PREPOST_INPUT+2].isConnected() && (inputs[PREPOST_INPUT+2].getVoltage()<1.f))) {
-      float dIn = 0.f;
-      if ((params[TYPE_PARAM+2].getValue() == 0.f) || (inputs[TYPE_INPUT+2].isConnected() && (inputs[TYPE_INPUT+2].getVoltage() == 0.f))) {
-        dIn = tanh(g2*in);
-      }
-      else if ((params[TYPE_PARAM+2].getValue() == 1.f) || (inputs[TYPE_INPUT+2].isConnected() && (inputs[TYPE_INPUT+2].getVoltage() == 1.f))) {
-        dIn = sin(g2*in);
-      }
-      else {
-        dIn = clamp(g2*in,-1.0f,1.0f);
-      }
-      filter3.setParams(c1freq, q2, args.sampleRate);
-    	filter3.calcOutput(dIn);
-      filter4.setParams(c2freq, q2, args.sampleRate);
-    	filter4.calcOutput(filter3.hp);
-      out += filter4.lp * v2 * 30517578125e-15f;
-    }
-    else {
-      filter3.setParams(c1freq, q2, args.sampleRate);
-    	filter3.calcOutput(in);
-      filter4.setParams(c2freq, q2, args.sampleRate);
-    	filter4.calcOutput(filter1.hp);
-      if ((params[TYPE_PARAM+2].getValue() == 0.f) || (inputs[TYPE_INPUT+2].isConnected() && (inputs[TYPE_INPUT+2].getVoltage() == 0.f))) {
-        out += tanh(g2*filter4.lp) * v2 * 30517578125e-15f;
-      }
-      else if ((params[TYPE_PARAM+2].getValue() == 1.f) || (inputs[TYPE_INPUT+2].isConnected() && (inputs[TYPE_INPUT+2].getVoltage() == 1.f))) {
-        out += sin(g2*filter4.lp) * v2 * 30517578125e-15f;
-      }
-      else {
-        out += clamp(g2*filter4.lp,-1.f,1.f) * v2 * 30517578125e-15f;
-      }
-    }
+	float_4 distort(float_4 x) {
+		float_4 y = simd::clamp(x, -1.0f, 1.0f);
+		if (anySin) {
+			y = simd::ifelse(sinMask, simd::sin(x), y);
+		}
+		if (anyTanh) {
+			y = simd::ifelse(tanhMask, fastTanh(x), y);
+		}
+		return y;
+	}
 
-    if ((params[PREPOST_PARAM+3].getValue() == 0.f) || (inputs[PREPOST_INPUT+3].isConnected() && (inputs[PREPOST_INPUT+3].getVoltage()<1.f))) {
-      float dIn = 0.f;
-      if ((params[TYPE_PARAM+3].getValue() == 0.f) || (inputs[TYPE_INPUT+3].isConnected() && (inputs[TYPE_INPUT+3].getVoltage() == 0.f))) {
-        dIn = tanh(g3*in);
-      }
-      else if ((params[TYPE_PARAM+3].getValue() == 1.f) || (inputs[TYPE_INPUT+3].isConnected() && (inputs[TYPE_INPUT+3].getVoltage() == 1.f))) {
-        dIn = sin(g3*in);
-      }
-      else {
-        dIn = clamp(g3*in,-1.0f,1.0f);
-      }
-      filter5.setParams(c2freq, q3, args.sampleRate);
-    	filter5.calcOutput(dIn);
-      out += filter5.hp * v3 * 30517578125e-15f;
-    }
-    else {
-      filter5.setParams(c2freq, q3, args.sampleRate);
-    	filter5.calcOutput(in);
-      if ((params[TYPE_PARAM+3].getValue() == 0.f) || (inputs[TYPE_INPUT+3].isConnected() && (inputs[TYPE_INPUT+3].getVoltage() == 0.f))) {
-        out += tanh(g3*filter5.hp) * v3 * 30517578125e-15f;
-      }
-      else if ((params[TYPE_PARAM+3].getValue() == 1.f) || (inputs[TYPE_INPUT+3].isConnected() && (inputs[TYPE_INPUT+3].getVoltage() == 1.f))) {
-        out += sin(g3*filter5.hp) * v3 * 30517578125e-15f;
-      }
-      else {
-        out += clamp(g3*filter5.hp,-1.f,1.f) * v3 * 30517578125e-15f;
-      }
-    }
+	void process(const ProcessArgs &args) override {
+		int channels = std::max(inputs[IN].getChannels(), 1);
+
+		if (controlRateTick()) {
+			updateBands();
+			for (int c = 0; c < channels; c++) {
+				float_4 cutoff, q, drive, volume;
+				for (int i = 0; i < 3; i++) {
+					cutoff[i] = params[FREQ_PARAM+i].getValue() + inputs[FREQ_INPUT+i].getPolyVoltage(c) * 0.2f;
+				}
+				cutoff[3] = cutoff[2];
+				cutoff = simd::clamp(cutoff, 0.0f, 1.0f);
+				for (int i = 0; i < 4; i++) {
+					q[i] = params[Q_PARAM+i].getValue() + inputs[Q_INPUT+i].getPolyVoltage(c) / 10.f;
+					drive[i] = params[GAIN_PARAM+i].getValue() + inputs[GAIN_INPUT+i].getPolyVoltage(c);
+					volume[i] = params[VOLUME_PARAM+i].getValue() + inputs[VOLUME_INPUT+i].getPolyVoltage(c) * 0.1f;
+				}
+				if (simd::movemask(cutoff != cutoffs[c])) {
+					// prewarped cutoffs of the three crossovers, kept below Nyquist
+					cutoffs[c] = cutoff;
+					float_4 cfreq = dsp::approxExp2_taylor5(4.5f + 9.5f * cutoff);
+					float_4 w = simd::fmin(cfreq * args.sampleTime, 0.45f) * (float)pi;
+					float_4 g = simd::sin(w) / simd::cos(w);
+					g1Ramps[c].setTarget(float_4(g[0], g[0], g[1], g[2]), controlRateDivision);
+					g2Ramps[c].setTarget(float_4(g[1], g[1], g[2], g[2]), controlRateDivision);
+				}
+				qRamps[c].setTarget(10.0f * simd::clamp(q, 0.1f, 1.0f), controlRateDivision);
+				driveRamps[c].setTarget(simd::clamp(drive, 1.0f, 10.0f), controlRateDivision);
+				volumeRamps[c].setTarget(simd::clamp(volume, 0.0f, 1.0f), controlRateDivision);
+			}
+		}
 
-    outputs[OUT].setVoltage(out * 32768.0f * 5.0f);
+		outputs[OUT].setChannels(channels);
+		for (int c = 0; c < channels; c++) {
+			float_4 g1 = g1Ramps[c].process();
+			float_4 g2 = g2Ramps[c].process();
+			float_4 q = qRamps[c].process();
+			float_4 drive = driveRamps[c].process();
+			float_4 volume = volumeRamps[c].process();
+
+			float_4 in = inputs[IN].getPolyVoltage(c) * 0.2f; //normalise to -1/+1 we consider VCV Rack standard is #+5/-5V on VCO1
+			if (anyPre) {
+				in = simd::ifelse(postMask, in, distort(drive * in));
+			}
+			stage1[c].process(in, g1, q);
+			float_4 hp = stage1[c].hp;
+			// band 2 in post mode has always been fed by the band 1 high pass
+			if (band2Post) {
+				hp[2] = hp[1];
+			}
+			stage2[c].process(hp, g2, q);
+
+			float_4 band = stage1[c].lp * float_4(1.0f, 0.0f, 0.0f, 0.0f) + stage2[c].lp * float_4(0.0f, 1.0f, 1.0f, 0.0f) + stage1[c].hp * float_4(0.0f, 0.0f, 0.0f, 1.0f);
+			if (anyPost) {
+				band = simd::ifelse(postMask, distort(drive * band), band);
+			}
+			band *= volume;
+			outputs[OUT].setVoltage((band[0] + band[1] + band[2] + band[3]) * 5.0f, c);
+		}
 	}
 
 };
@@ -74,6 +74,13 @@ struct BANCAU : BidooModule {
 	float bp2 = 0.0f;
 	float end2 = 0.0f;
 
+	// x^4 with two multiplies, the Exp modes feed the output back into the
+	// times so they cannot move to control rate
+	static float quartic(const float x) {
+		float x2 = x * x;
+		return x2 * x2;
+	}
+
 	BANCAU() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
@@ -118,8 +125,8 @@ struct BANCAU : BidooModule {
 
 		rise1CV = params[RISEEXP1_PARAM].getValue() == 0 ? (params[RISECV1_PARAM].getValue() * rescale(clamp(inputs[RISECV1_INPUT].getVoltage() + inputs[BOTHCV1_INPUT].getVoltage(),-10.0f,10.0f),-10.f,10.f,-1.f, 1.f))	: (params[RISECV1_PARAM].getValue() * out1/10.0f);
 		fall1CV = params[FALLEXP1_PARAM].getValue() == 0 ? (params[FALLCV1_PARAM].getValue() * rescale(clamp(inputs[FALLCV1_INPUT].getVoltage() + inputs[BOTHCV1_INPUT].getVoltage(),-10.0f,10.0f),-10.f,10.f,-1.f, 1.f))	: (params[FALLCV1_PARAM].getValue() * out1/10.0f);
-		rise1 = std::pow(params[RISE1_PARAM].getValue() + rise1CV,4.f);
-		fall1 = std::pow(params[FALL1_PARAM].getValue() + fall1CV,4.f);
+		rise1 = quartic(params[RISE1_PARAM].getValue() + rise1CV);
+		fall1 = quartic(params[FALL1_PARAM].getValue() + fall1CV);
 		// rise1 = exp(params[RISE1_PARAM].getValue() + rise1CV)-1.0f;
 		// fall1 = exp(params[FALL1_PARAM].getValue() + fall1CV)-1.0f;
 
@@ -174,8 +181,8 @@ struct BANCAU : BidooModule {
 
 		rise2CV = params[RISEEXP2_PARAM].getValue() == 0 ? (params[RISECV2_PARAM].getValue() * rescale(clamp(inputs[RISECV2_INPUT].getVoltage() + inputs[BOTHCV2_INPUT].getVoltage(),-10.0f,10.0f),-10.f,10.f,-1.f, 1.f))	: (params[RISECV2_PARAM].getValue() * out2/10.0f);
 		fall2CV = params[FALLEXP2_PARAM].getValue() == 0 ? (params[FALLCV2_PARAM].getValue() * rescale(clamp(inputs[FALLCV2_INPUT].getVoltage() + inputs[BOTHCV2_INPUT].getVoltage(),-10.0f,10.0f),-10.f,10.f,-1.f, 1.f))	: (params[FALLCV2_PARAM].getValue() * out2/10.0f);
-		rise2 = std::pow(params[RISE2_PARAM].getValue() + rise2CV,4.f);
-		fall2 = std::pow(params[FALL2_PARAM].getValue() + fall2CV,4.f);
+		rise2 = quartic(params[RISE2_PARAM].getValue() + rise2CV);
+		fall2 = quartic(params[FALL2_PARAM].getValue() + fall2CV);
 
 		float in2 = inputs[IN2_INPUT].getVoltage();
 
@@ -1,9 +1,11 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
-#include "dsp/ringbuffer.hpp"
+#include "dep/ringbuffer.hpp"
+#include "dep/dynamics.hpp"
 #include "dsp/digital.hpp"
 
 using namespace std;
+using simd::float_4;
 
 struct BAR : BidooModule {
 	enum ParamIds {
@@ -35,16 +37,16 @@ struct BAR : BidooModule {
 		NUM_LIGHTS
 	};
 
-	dsp::DoubleRingBuffer<float,16384> vu_L_Buffer, vu_R_Buffer;
-	dsp::DoubleRingBuffer<float,512> rms_L_Buffer, rms_R_Buffer;
+	ringbuffer::RingBuffer<float,16384> vu_L_Buffer, vu_R_Buffer;
+	ringbuffer::RingBuffer<float,512> rms_L_Buffer, rms_R_Buffer;
 	float runningVU_L_Sum = 1e-6f, runningRMS_L_Sum = 1e-6f, rms_L = -96.3f, vu_L = -96.3f, peakL = -96.3f;
 	float runningVU_R_Sum = 1e-6f, runningRMS_R_Sum = 1e-6f, rms_R = -96.3f, vu_R = -96.3f, peakR = -96.3f;
 
 	float in_L_dBFS = 1e-6f;
 	float in_R_dBFS = 1e-6f;
 
-	dsp::DoubleRingBuffer<float,16384> SC_vu_L_Buffer, SC_vu_R_Buffer;
-	dsp::DoubleRingBuffer<float,512> SC_rms_L_Buffer, SC_rms_R_Buffer;
+	ringbuffer::RingBuffer<float,16384> SC_vu_L_Buffer, SC_vu_R_Buffer;
+	ringbuffer::RingBuffer<float,512> SC_rms_L_Buffer, SC_rms_R_Buffer;
 	float SC_runningVU_L_Sum = 1e-6f, SC_runningRMS_L_Sum = 1e-6f, SC_rms_L = -96.3f, SC_vu_L = -96.3f, SC_peakL = -96.3f;
 	float SC_runningVU_R_Sum = 1e-6f, SC_runningRMS_R_Sum = 1e-6f, SC_rms_R = -96.3f, SC_vu_R = -96.3f, SC_peakR = -96.3f;
 
@@ -52,7 +54,8 @@ struct BAR : BidooModule {
 	float SC_in_R_dBFS = 1e-6f;
 
 	float dist = 0.0f, gain = 1.0f, gaindB = 1.0f, ratio = 1.0f, threshold = 1.0f, knee = 0.0f;
-	float attackTime = 0.0f, releaseTime = 0.0f, makeup = 1.0f, previousPostGain = 1.0f, mix = 1.0f;
+	float attackTime = 0.0f, releaseTime = 0.0f, makeup = 1.0f, mix = 1.0f;
+	dynamics::GainComputer gainComputer;
 	int indexVU = 0, indexRMS = 0, lookAheadWriteIndex=0;
 	int maxIndexVU = 0, maxIndexRMS = 0, maxLookAheadWriteIndex=0;
 	int lookAhead;
@@ -92,24 +95,24 @@ void BAR::process(const ProcessArgs &args) {
 	lights[BYPASS_LIGHT].setBrightness(bypass ? 1.0f : 0.0f);
 
 	if (indexVU>=16384) {
-		runningVU_L_Sum -= *vu_L_Buffer.startData();
-		runningVU_R_Sum -= *vu_R_Buffer.startData();
+		runningVU_L_Sum -= vu_L_Buffer.front();
+		runningVU_R_Sum -= vu_R_Buffer.front();
 		vu_L_Buffer.startIncr(1);
 		vu_R_Buffer.startIncr(1);
-		SC_runningVU_L_Sum -= *SC_vu_L_Buffer.startData();
-		SC_runningVU_R_Sum -= *SC_vu_R_Buffer.startData();
+		SC_runningVU_L_Sum -= SC_vu_L_Buffer.front();
+		SC_runningVU_R_Sum -= SC_vu_R_Buffer.front();
 		SC_vu_L_Buffer.startIncr(1);
 		SC_vu_R_Buffer.startIncr(1);
 		indexVU--;
 	}
 
 	if (indexRMS>=512) {
-		runningRMS_L_Sum -= *rms_L_Buffer.startData();
-		runningRMS_R_Sum -= *rms_R_Buffer.startData();
+		runningRMS_L_Sum -= rms_L_Buffer.front();
+		runningRMS_R_Sum -= rms_R_Buffer.front();
 		rms_L_Buffer.startIncr(1);
 		rms_R_Buffer.startIncr(1);
-		SC_runningRMS_L_Sum -= *SC_rms_L_Buffer.startData();
-		SC_runningRMS_R_Sum -= *SC_rms_R_Buffer.startData();
+		SC_runningRMS_L_Sum -= SC_rms_L_Buffer.front();
+		SC_runningRMS_R_Sum -= SC_rms_R_Buffer.front();
 		SC_rms_L_Buffer.startIncr(1);
 		SC_rms_R_Buffer.startIncr(1);
 		indexRMS--;
@@ -121,25 +124,14 @@ void BAR::process(const ProcessArgs &args) {
 	buffL[lookAheadWriteIndex]=inputs[IN_L_INPUT].getVoltage();
 	buffR[lookAheadWriteIndex]=inputs[IN_R_INPUT].getVoltage();
 
-	if (inputs[IN_L_INPUT].isConnected())
-		in_L_dBFS = max(20.0f*log10((abs(inputs[IN_L_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		in_L_dBFS = -96.3f;
-
-	if (inputs[SC_L_INPUT].isConnected())
-		SC_in_L_dBFS = max(20.0f*log10((abs(inputs[SC_L_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		SC_in_L_dBFS = -96.3f;
-
-	if (inputs[IN_R_INPUT].isConnected())
-		in_R_dBFS = max(20.0f*log10((abs(inputs[IN_R_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		in_R_dBFS = -96.3f;
-
-	if (inputs[SC_R_INPUT].isConnected())
-		SC_in_R_dBFS = max(20.0f*log10((abs(inputs[SC_R_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		SC_in_R_dBFS = -96.3f;
+	// the two inputs and the two side chains in one float_4
+	float_4 connected = float_4(inputs[IN_L_INPUT].isConnected(), inputs[IN_R_INPUT].isConnected(), inputs[SC_L_INPUT].isConnected(), inputs[SC_R_INPUT].isConnected()) != 0.0f;
+	float_4 level = float_4(inputs[IN_L_INPUT].getVoltage(), inputs[IN_R_INPUT].getVoltage(), inputs[SC_L_INPUT].getVoltage(), inputs[SC_R_INPUT].getVoltage());
+	level = simd::ifelse(connected, dynamics::levelDb(level), -96.3f);
+	in_L_dBFS = level[0];
+	in_R_dBFS = level[1];
+	SC_in_L_dBFS = level[2];
+	SC_in_R_dBFS = level[3];
 
 	float data_L = in_L_dBFS*in_L_dBFS;
 	float data_R = in_R_dBFS*in_R_dBFS;
@@ -206,33 +198,10 @@ void BAR::process(const ProcessArgs &args) {
 	else
 		SC_peakR -= 50.0f / args.sampleRate;
 
-	float slope = 1.0f/ratio-1.0f;
 	float maxIn = (inputs[SC_L_INPUT].isConnected() || inputs[SC_R_INPUT].isConnected()) ? max(SC_in_L_dBFS,SC_in_R_dBFS) : max(in_L_dBFS,in_R_dBFS);
-	float dist = maxIn-threshold;
-	float gcurve = 0.0f;
-
-	if (dist<-1.0f*knee/2.0f)
-		gcurve = maxIn;
-	else if ((dist > -1.0f * knee * 0.5f) && (dist < knee * 0.5f)) {
-		gcurve = maxIn + slope * pow(dist + knee *0.5f, 2.0f) / (2.0f * knee);
-	} else {
-		gcurve = maxIn + slope * dist;
-	}
-
-	float preGain = gcurve - maxIn;
-	float postGain = 0.0f;
-	float cAtt = exp(-1.0f/(attackTime * args.sampleRate * 0.001f));
-	float cRel = exp(-1.0f/(releaseTime * args.sampleRate * 0.001f));
-
-	if (preGain<previousPostGain) {
-		postGain = cAtt * previousPostGain + (1.0f-cAtt) * preGain;
-	} else {
-		postGain = cRel * previousPostGain + (1.0f-cRel) * preGain;
-	}
-
-	previousPostGain = postGain;
-	gaindB = makeup + postGain;
-	gain = pow(10.0f, gaindB/20.0f);
+	gainComputer.setTimes(attackTime, releaseTime, args.sampleRate);
+	gaindB = makeup + gainComputer.process(maxIn, threshold, ratio, knee);
+	gain = dynamics::dbToGain(gaindB);
 
 	mix = params[MIX_PARAM].getValue();
 	lookAhead = params[LOOKAHEAD_PARAM].getValue();
@@ -9,6 +9,8 @@
 #include <algorithm>
 #include <atomic>
 #include "dep/waves.hpp"
+#include "dep/handoff.hpp"
+#include "dep/loader.hpp"
 #include "../debug_raw.h"
 
 #if defined(METAMODULE)
@@ -64,14 +66,27 @@ struct CANARD : BidooModule {
 	int channels = 2;
 	int sampleRate = 0;
 	int totalSampleCount = 0;
-	vector<dsp::Frame<2>> playBuffer, recordBuffer;
+	handoff::Handoff<waves::StereoSample> playBuffer;
+	handoff::Handoff<std::vector<int>> sliceList;
+	handoff::Handoff<waves::Stream> streamBuffer;
+	vector<dsp::Frame<2>> recordBuffer;
+	// a finished recording handed to editInternal(), swapped out of
+	// recordBuffer so process() neither copies nor frees it
+	vector<dsp::Frame<2>> recorded;
+	std::atomic<bool> recordedPending = false;
+	bool recordedAppend = false;
+	float recordedRate = 0.0f;
+	// audio thread snapshot of the published buffers
+	const waves::Sample<2> *wav = NULL;
+	waves::Stream *stream = NULL;
+	std::vector<int> *slices = &noSlices;
+	std::vector<int> noSlices;
 	float samplePos = 0.0f, sampleStart = 0.0f, loopLength = 0.0f, fadeLenght = 0.0f, fadeCoeff = 1.0f, speedFactor = 1.0f;
 	size_t prevPlayedSlice = 0;
 	size_t playedSlice = 0;
 	bool changedSlice = false;
 	int readMode = 0; // 0 formward, 1 backward, 2 repeat
 	float speed;
-	std::vector<int> slices;
 	int selected = -1;
 	bool deleteFlag = false;
 	int addSliceMarker = -1;
@@ -85,27 +100,34 @@ struct CANARD : BidooModule {
 	std::string waveFileName;
 	std::string waveExtension;
 	std::atomic<bool> loading = false;
-	bool clear_requested = false;
+	bool streaming = false;
+	bool compactStorage = false;
+	std::atomic<bool> clear_requested = false;
 	dsp::SchmittTrigger trigTrigger;
 	dsp::SchmittTrigger recordTrigger;
 	dsp::SchmittTrigger clearTrigger;
 	dsp::PulseGenerator eocPulse;
-	std::atomic<bool> locked{false};
 	bool newStop = false;
 	bool first=true;
 
 #if defined(METAMODULE)
 	MetaModule::AsyncThread loadSampleAsync{this, [this]() {
 		DebugPin3High();
-		if (loading.load(std::memory_order_acquire)) {
-			this->loadSampleInternal();
+		if (loading.exchange(false)) {
+			this->loadSample();
 		}
+		loader::poll(this);
+		this->fillStream();
 		DebugPin3Low();
 	}};
 	
 	MetaModule::AsyncThread saveSampleAsync{this, [this]() {
 		this->saveSampleInternal();
+		this->collect();
 	}};
+#else
+	// declared last so it is joined before the buffers go away
+	waves::StreamWorker streamWorker;
 #endif
 
 	CANARD() {
@@ -121,7 +143,6 @@ struct CANARD : BidooModule {
 		configParam(THRESHOLD_PARAM, 0.01f, 10.0f, 1.0f, "Threshold");
 		configSwitch(MODE_PARAM, 0, 1, 0, "Slice mode", {"Off", "On"});
 
-		playBuffer.resize(0);
 		recordBuffer.resize(0);
 
 		configInput(INL_INPUT, "In L");
@@ -147,41 +168,92 @@ struct CANARD : BidooModule {
 #endif
 	}
 
+	~CANARD() override {
+		loader::cancel(this);
+	}
+
 	void process(const ProcessArgs &args) override;
 
 	void calcLoop();
 	void initPos();
-	void loadSample();
+	void loadSample(int priority = loader::PRIORITY_USER, std::function<void()> done = nullptr);
 	void saveSample();
 	void loadSampleInternal();
 	void saveSampleInternal();
+	void resample();
+	void resampleInternal();
 	void calcTransients();
+	void edit();
+	void editInternal();
+
+	void snapshot() {
+		waves::StereoSample *sample = playBuffer.acquire(handoff::AUDIO_READER);
+		wav = sample ? sample->get() : NULL;
+		std::vector<int> *s = sliceList.acquire(handoff::AUDIO_READER);
+		slices = s ? s : &noSlices;
+		stream = streamBuffer.acquire(handoff::AUDIO_READER);
+		totalSampleCount = wav ? wav->size() : (stream ? stream->sampleCount : 0);
+	}
 
-	void lock() {
-		bool expected = false;
-		while (!locked.compare_exchange_strong(expected, true)) {
-			expected = false;
-		}
+	dsp::Frame<2> frameAt(int i) {
+		if (wav) return wav->frame(i);
+		// an underrun reads a silent frame
+		dsp::Frame<2> frame;
+		stream->read(i, frame);
+		return frame;
+	}
+
+	std::shared_ptr<waves::Sample<2>> copyFrames(const waves::StereoSample &held) {
+		std::shared_ptr<waves::Sample<2>> sample = std::make_shared<waves::Sample<2>>();
+		// edits and recordings are kept as float frames
+		if (held) sample->frames = held->expand();
+		sample->frameRate = held ? held->frameRate : (int)APP->engine->getSampleRate();
+		return sample;
+	}
+
+	void publishFrames(waves::StereoSample sample) {
+		waves::StereoSample *buffer = sample ? new waves::StereoSample(sample) : NULL;
+		if (!playBuffer.publish(buffer)) delete buffer;
+	}
+
+	void publishSlices(std::vector<int> *s) {
+		if (!sliceList.publish(s)) delete s;
 	}
 
-	bool try_lock() {
-		bool expected = false;
-		return locked.compare_exchange_strong(expected, true);
+	void publishStream(waves::Stream *s) {
+		if (!streamBuffer.publish(s)) delete s;
 	}
 
-	void unlock() {
-		locked.store(false);
+	void collect() {
+		playBuffer.collect();
+		sliceList.collect();
+		streamBuffer.collect();
+	}
+
+	// false when no stream is published
+	bool fillStream() {
+		waves::Stream *s = streamBuffer.acquire(handoff::WORKER_READER);
+		if (s) s->fill();
+		streamBuffer.release(handoff::WORKER_READER);
+		collect();
+		return s != NULL;
 	}
 
 	json_t *dataToJson() override {
 		json_t *rootJ = BidooModule::dataToJson();
 		// lastPath
 		json_object_set_new(rootJ, "lastPath", json_string(lastPath.c_str()));
+		json_object_set_new(rootJ, "streaming", json_boolean(streaming));
+		json_object_set_new(rootJ, "compactStorage", json_boolean(compactStorage));
 		json_t *slicesJ = json_array();
-		for (size_t i = 0; i<slices.size() ; i++) {
-			json_t *sliceJ = json_integer(slices[i]);
-			json_array_append_new(slicesJ, sliceJ);
+		std::vector<int> *s = sliceList.acquire(handoff::UI_READER);
+		if (s) {
+			for (size_t i = 0; i<s->size() ; i++) {
+				json_t *sliceJ = json_integer((*s)[i]);
+				json_array_append_new(slicesJ, sliceJ);
+			}
 		}
+		sliceList.release(handoff::UI_READER);
 		json_object_set_new(rootJ, "slices", slicesJ);
 
 		return rootJ;
@@ -190,50 +262,67 @@ struct CANARD : BidooModule {
 	void dataFromJson(json_t *rootJ) override {
 		printf("CANARD::dataFromJson\n");
 		BidooModule::dataFromJson(rootJ);
+		json_t *streamingJ = json_object_get(rootJ, "streaming");
+		if (streamingJ) {
+			streaming = json_boolean_value(streamingJ);
+		}
+		json_t *compactStorageJ = json_object_get(rootJ, "compactStorage");
+		if (compactStorageJ) {
+			compactStorage = json_boolean_value(compactStorageJ);
+		}
 		json_t *lastPathJ = json_object_get(rootJ, "lastPath");
 		if (lastPathJ) {
 			lastPath = json_string_value(lastPathJ);
 			waveFileName = rack::system::getFilename(lastPath);
 			waveExtension = rack::system::getExtension(lastPath);
-			if (!lastPath.empty()) loadSampleInternal();
-			if (totalSampleCount>0) {
-				json_t *slicesJ = json_object_get(rootJ, "slices");
-				if (slicesJ) {
-					size_t i;
-					json_t *sliceJ;
-					json_array_foreach(slicesJ, i, sliceJ) {
-							if (i != 0)
-								slices.push_back(json_integer_value(sliceJ));
-					}
+			if (lastPath.empty()) return;
+			std::shared_ptr<std::vector<int>> restored;
+			json_t *slicesJ = json_object_get(rootJ, "slices");
+			if (slicesJ) {
+				restored = std::make_shared<std::vector<int>>();
+				size_t i;
+				json_t *sliceJ;
+				json_array_foreach(slicesJ, i, sliceJ) {
+						if (i != 0)
+							restored->push_back(json_integer_value(sliceJ));
 				}
 			}
+			// the slices go in once the file they were set on is loaded
+			loadSample(loader::PRIORITY_PATCH, [this, restored]() {
+				if (restored && (totalSampleCount>0)) publishSlices(new std::vector<int>(*restored));
+				this->collect();
+			});
 		}
 	}
 
 	void onSampleRateChange() override {
-		if (!lastPath.empty()) loadSample();
+		resample();
 	}
 };
 
 void CANARD::calcTransients() {
-	slices.clear();
-	slices.push_back(0);
+	waves::StereoSample *sample = playBuffer.acquire(handoff::UI_READER);
+	const waves::Sample<2> *buffer = sample ? sample->get() : NULL;
+	if (!buffer) {
+		// streamed files are not scanned
+		playBuffer.release(handoff::UI_READER);
+		return;
+	}
+	int count = buffer->size();
+	std::vector<int> *s = new std::vector<int>();
+	s->push_back(0);
 	int i = 0;
 	int size = 256;
-	vector<dsp::Frame<2>>::const_iterator first;
-	vector<dsp::Frame<2>>::const_iterator last;
 	float prevNrgy = 0.0f;
-	while (i+size<totalSampleCount) {
-		first = playBuffer.begin() + i;
-		last = playBuffer.begin() + i + size;
-		vector<dsp::Frame<2>> newVec(first, last);
+	while (i+size<count) {
 		float nrgy = 0.0f;
 		float zcRate = 0.0f;
 		unsigned int zcIdx = 0;
 		bool first = true;
 		for (int k = 0; k < size; k++) {
-			nrgy += 100*newVec[k].samples[0]*newVec[k].samples[0]/size;
-			if (newVec[k].samples[0]==0.0f) {
+			float x = buffer->frame(i + k).samples[0];
+			nrgy += 100*x*x/size;
+			if (x==0.0f) {
 				zcRate += 1;
 				if (first) {
 					zcIdx = k;
@@ -242,15 +331,17 @@ void CANARD::calcTransients() {
 			}
 		}
 		if ((nrgy > params[CANARD::THRESHOLD_PARAM].getValue()) && (nrgy > 10*prevNrgy))
-			slices.push_back(i+zcIdx);
+			s->push_back(i+zcIdx);
 		i+=size;
 		prevNrgy = nrgy;
 	}
+	publishSlices(s);
+	playBuffer.release(handoff::UI_READER);
+	collect();
 }
 
 void CANARD::loadSampleInternal() {
-	// On MM, this is called during audio startup (dataFromJson)
-	// and in the AsyncThread context when loading == true
+	// runs on the loader queue, see loadSample()
 
 	APP->engine->yieldWorkers();
 	
@@ -262,50 +353,236 @@ void CANARD::loadSampleInternal() {
 		lastPath = "";
 		waveFileName = "";
 		waveExtension = "";
-		loading = false;
 		return;
 	}
 	
-#if defined(METAMODULE)
-	// Try to get the lock from the GUI thread. If we fail (i.e. GUI thread is using the buffer),
-	// then `loading` will stay true so we'll try again the next time the AsyncThread is scheduled.
-	if (!try_lock())
-		return;
-#else
-	lock();
+	if (streaming) {
+		waves::Stream *s = new waves::Stream;
+		if (s->open(lastPath)) {
+			waveFileName = rack::system::getFilename(lastPath);
+			waveExtension = rack::system::getExtension(waveFileName);
+			channels = s->channels;
+			sampleRate = s->sampleRate;
+			totalSampleCount = s->sampleCount;
+			publishFrames(nullptr);
+			publishStream(s);
+			publishSlices(NULL);
+#if !defined(METAMODULE)
+			// ends by itself once the stream is dropped, MetaModule fills it
+			// from loadSampleAsync
+			streamWorker.start([this]() {
+				return this->fillStream();
+			});
 #endif
+			return;
+		}
+		// AIFF files and unreadable headers are decoded in RAM
+		delete s;
+	}
 
-	playBuffer = waves::getStereoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, channels, sampleRate, totalSampleCount);
-	vector<dsp::Frame<2>>(playBuffer).swap(playBuffer);
+	// readers keep playing the previous buffer until they pick this one up
+	publishFrames(waves::getStereoSample(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, channels, sampleRate, totalSampleCount, compactStorage));
+	publishStream(NULL);
+	publishSlices(NULL);
+}
 
-	slices.clear();
+void CANARD::loadSample(int priority, std::function<void()> done) {
+	// On MM, the queue is run from the AsyncThread
+	loader::Job job;
+	job.owner = this;
+	job.path = lastPath;
+	job.priority = priority;
+	job.load = [this]() {
+		this->loadSampleInternal();
+		this->collect();
+	};
+	job.done = done;
+	loader::submit(job);
+}
 
-	// unlock must be done after we're done accessing playBuffer and slices
-	unlock();
+void CANARD::resampleInternal() {
+	waves::StereoSample *current = playBuffer.acquire(handoff::LOADER_READER);
+	waves::StereoSample held = current ? *current : nullptr;
+	playBuffer.release(handoff::LOADER_READER);
+	// streams play at the file rate whatever the engine rate
+	bool streamed = streamBuffer.acquire(handoff::LOADER_READER) != NULL;
+	streamBuffer.release(handoff::LOADER_READER);
+	if (streamed) return;
+
+	// recordings and edits are resampled too, they have no file to reload
+	waves::StereoSample resampled = waves::resampleSample(held, APP->engine->getSampleRate(), compactStorage);
+	if (!resampled) {
+		if (!lastPath.empty()) loadSampleInternal();
+		return;
+	}
+	if (resampled == held) return;
+
+	// slice markers follow the frames they were set on
+	std::vector<int> *s = sliceList.acquire(handoff::LOADER_READER);
+	std::vector<int> *moved = s ? new std::vector<int>(*s) : NULL;
+	sliceList.release(handoff::LOADER_READER);
+	if (moved) {
+		double ratio = (double)resampled->size() / std::max((size_t)1, held->size());
+		for (int &slice : *moved) {
+			slice = std::min((int)std::lround(slice * ratio), std::max((int)resampled->size() - 1, 0));
+		}
+	}
+	publishFrames(resampled);
+	publishSlices(moved);
+	collect();
+}
 
-	loading = false;
+void CANARD::resample() {
+	// a slot of its own so a file load still pending is not replaced
+	loader::Job job;
+	job.owner = this;
+	job.slot = 1;
+	job.path = lastPath;
+	job.priority = loader::PRIORITY_RELOAD;
+	job.load = [this]() {
+		this->resampleInternal();
+	};
+	loader::submit(job);
 }
 
-void CANARD::loadSample() {
-	// On MM, this is only called from the audio context
+void CANARD::editInternal() {
+	// runs on the loader queue, see edit()
+	waves::StereoSample *current = playBuffer.acquire(handoff::LOADER_READER);
+	waves::StereoSample frames = current ? *current : nullptr;
+	playBuffer.release(handoff::LOADER_READER);
+	std::vector<int> *s = sliceList.acquire(handoff::LOADER_READER);
+	std::vector<int> edited = s ? *s : std::vector<int>();
+	sliceList.release(handoff::LOADER_READER);
+	bool streamed = streamBuffer.acquire(handoff::LOADER_READER) != NULL;
+	streamBuffer.release(handoff::LOADER_READER);
+	bool framesChanged = false;
+	bool slicesChanged = false;
+
+	if (clear_requested.exchange(false)) {
+		frames = nullptr;
+		edited.clear();
+		streamed = false;
+		framesChanged = true;
+		slicesChanged = true;
+		lastPath = "";
+		waveFileName = "";
+		waveExtension = "";
+	}
 
-#if !defined(METAMODULE)
-	loadSampleInternal();
-#endif
+	if (recordedPending) {
+		size_t length = recorded.size();
+		std::shared_ptr<waves::Sample<2>> buffer;
+		if (recordedAppend && !streamed) {
+			buffer = copyFrames(frames);
+			edited.push_back(buffer->frames.size() > 0 ? ((int)buffer->frames.size()-1) : 0);
+			buffer->frames.insert(buffer->frames.end(), recorded.begin(), recorded.end());
+		}
+		else {
+			buffer = std::make_shared<waves::Sample<2>>();
+			buffer->frames = std::move(recorded);
+			buffer->frameRate = recordedRate;
+			edited.assign(1, 0);
+			streamed = false;
+			lastPath = "";
+			waveFileName = "";
+			waveExtension = "";
+		}
+		// the next recording starts with room for one as long as this one
+		vector<dsp::Frame<2>>().swap(recorded);
+		recorded.reserve(length);
+		recordedPending = false;
+		frames = buffer;
+		framesChanged = true;
+		slicesChanged = true;
+	}
+
+	if ((selected>=0) && deleteFlag) {
+		// a streamed file is read only
+		if (!streamed && frames && ((size_t)selected < edited.size())) {
+			int nbSample=0;
+			std::shared_ptr<waves::Sample<2>> buffer = copyFrames(frames);
+			if ((size_t)selected<(edited.size()-1)) {
+				nbSample = edited[selected + 1] - edited[selected] - 1;
+				buffer->frames.erase(buffer->frames.begin() + edited[selected], buffer->frames.begin() + edited[selected + 1]-1);
+			}
+			else {
+				nbSample = buffer->frames.size() - edited[selected];
+				buffer->frames.erase(buffer->frames.begin() + edited[selected], buffer->frames.end());
+			}
+			edited.erase(edited.begin()+selected);
+			for (size_t i = selected; i < edited.size(); i++)
+			{
+				edited[i] = edited[i]-nbSample;
+			}
+			frames = buffer;
+			framesChanged = true;
+			slicesChanged = true;
+		}
+		selected = -1;
+		deleteFlag = false;
+	}
+
+	if ((addSliceMarker>=0) && addSliceMarkerFlag) {
+		if (std::find(edited.begin(), edited.end(), addSliceMarker) == edited.end()) {
+			edited.insert(std::upper_bound(edited.begin(), edited.end(), addSliceMarker), addSliceMarker);
+			slicesChanged = true;
+		}
+		addSliceMarker = -1;
+		addSliceMarkerFlag = false;
+	}
+
+	if ((deleteSliceMarker>=0) && deleteSliceMarkerFlag) {
+		std::vector<int>::iterator it = std::find(edited.begin(), edited.end(), deleteSliceMarker);
+		if (it != edited.end()) {
+			edited.erase(it);
+			slicesChanged = true;
+		}
+		deleteSliceMarker = -1;
+		deleteSliceMarkerFlag = false;
+	}
+
+	// room in the retire lists so frames and slices are swapped together
+	collect();
+	if (framesChanged) {
+		// edited frames are always in RAM
+		publishFrames(frames);
+		publishStream(NULL);
+	}
+	if (slicesChanged) publishSlices(edited.empty() ? NULL : new std::vector<int>(edited));
+	collect();
+}
+
+void CANARD::edit() {
+	// process() and the menus only raise the edit, the loader builds and
+	// publishes the new buffers. The job holds nothing but this, so queuing
+	// it from process() does not allocate, and a pending one is replaced as
+	// it reads the requests when it runs.
+	loader::Job job;
+	job.owner = this;
+	job.slot = 2;
+	job.priority = loader::PRIORITY_USER;
+	job.load = [this]() {
+		this->editInternal();
+	};
+	loader::submit(job);
 }
 
 void CANARD::saveSampleInternal() {
 	APP->engine->yieldWorkers();
 
 #if defined(METAMODULE)
-	if (!try_lock())
-		return;
+	waves::StereoSample *sample = playBuffer.acquire(handoff::WORKER_READER);
+	const waves::Sample<2> *buffer = sample ? sample->get() : NULL;
 #else
-	lock();
+	// called from process(), the buffer is the audio thread snapshot
+	const waves::Sample<2> *buffer = wav;
 #endif
 
-	waves::saveWave(playBuffer, APP->engine->getSampleRate(), lastPath);
-	unlock();
+	if (buffer) waves::saveWave(*buffer, APP->engine->getSampleRate(), lastPath);
+
+#if defined(METAMODULE)
+	playBuffer.release(handoff::WORKER_READER);
+#endif
 
 	save = false;
 }
@@ -324,11 +601,11 @@ void CANARD::calcLoop() {
 	index = 0;
 	int sliceStart = 0;;
 	int sliceEnd = totalSampleCount > 0 ? totalSampleCount - 1 : 0;
-	if ((params[MODE_PARAM].getValue() == 1) && (slices.size()>0))
+	if ((params[MODE_PARAM].getValue() == 1) && (slices->size()>0))
 	{
-		index = round(clamp(params[SLICE_PARAM].getValue() + inputs[SLICE_INPUT].getVoltage(), 0.0f,10.0f)*(slices.size()-1)/10);
-		sliceStart = slices[index];
-		sliceEnd = (index < (slices.size() - 1)) ? (slices[index+1] - 1) : (totalSampleCount - 1);
+		index = round(clamp(params[SLICE_PARAM].getValue() + inputs[SLICE_INPUT].getVoltage(), 0.0f,10.0f)*(slices->size()-1)/10);
+		sliceStart = (*slices)[index];
+		sliceEnd = (index < (slices->size() - 1)) ? ((*slices)[index+1] - 1) : (totalSampleCount - 1);
 	}
 
 	if (totalSampleCount > 0) {
@@ -358,10 +635,14 @@ void CANARD::initPos() {
 
 void CANARD::process(const ProcessArgs &args) {
 #if !defined(METAMODULE)
-	if (loading) {
+	if (loading.exchange(false)) {
 		loadSample();
 	}
+#endif
+
+	snapshot();
 
+#if !defined(METAMODULE)
 	if (save) {
 		saveSample();
 	}
@@ -370,133 +651,53 @@ void CANARD::process(const ProcessArgs &args) {
 	if (clearTrigger.process(inputs[CLEAR_INPUT].getVoltage() + params[CLEAR_PARAM].getValue()))
 	{
 		clear_requested = true;
-	}
-
-	if (clear_requested)
-	{
-#if defined(METAMODULE)
-		if (try_lock()) {
-#else
-		lock();
-#endif
-		playBuffer.clear();
-		totalSampleCount = 0;
-		slices.clear();
-#if defined(METAMODULE)
-		}
-#endif
-		unlock();
-		lastPath = "";
-		waveFileName = "";
-		waveExtension = "";
-		clear_requested = false;
-	}
-
-	if ((selected>=0) && (deleteFlag)) {
-		int nbSample=0;
-		if ((size_t)selected<(slices.size()-1)) {
-			nbSample = slices[selected + 1] - slices[selected] - 1;
-			lock();
-			playBuffer.erase(playBuffer.begin() + slices[selected], playBuffer.begin() + slices[selected + 1]-1);
-			unlock();
-		}
-		else {
-			nbSample = totalSampleCount - slices[selected];
-			lock();
-			playBuffer.erase(playBuffer.begin() + slices[selected], playBuffer.end());
-			unlock();
-		}
-		slices.erase(slices.begin()+selected);
-		totalSampleCount = playBuffer.size();
-		for (size_t i = selected; i < slices.size(); i++)
-		{
-			slices[i] = slices[i]-nbSample;
-		}
-		selected = -1;
-		deleteFlag = false;
-		calcLoop();
-	}
-
-	if ((addSliceMarker>=0) && (addSliceMarkerFlag)) {
-		if (std::find(slices.begin(), slices.end(), addSliceMarker) != slices.end()) {
-			addSliceMarker = -1;
-			addSliceMarkerFlag = false;
-		}
-		else {
-			auto it = std::upper_bound(slices.begin(), slices.end(), addSliceMarker);
-			lock();
-			slices.insert(it, addSliceMarker);
-			unlock();
-			addSliceMarker = -1;
-			addSliceMarkerFlag = false;
-			calcLoop();
-		}
-	}
-
-	if ((deleteSliceMarker>=0) && (deleteSliceMarkerFlag)) {
-		if (std::find(slices.begin(), slices.end(), deleteSliceMarker) != slices.end()) {
-			lock();
-			slices.erase(std::find(slices.begin(), slices.end(), deleteSliceMarker));
-			unlock();
-			deleteSliceMarker = -1;
-			deleteSliceMarkerFlag = false;
-			calcLoop();
-		}
+		edit();
 	}
 
 	if (recordTrigger.process(inputs[RECORD_INPUT].getVoltage() + params[RECORD_PARAM].getValue()))
 	{
-		if(record) {
-			if (floor(params[MODE_PARAM].getValue()) == 0) {
-				lock();
-				slices.clear();
-				slices.push_back(0);
-				playBuffer.resize(0);
-				for (int i = 0; i < (int)recordBuffer.size(); i++) {
-					dsp::Frame<2> frame = recordBuffer[i];
-					playBuffer.push_back(frame);
-				}
-				totalSampleCount = playBuffer.size();
-				unlock();
-				lastPath = "";
-				waveFileName = "";
-				waveExtension = "";
-			}
-			else {
-				lock();
-				slices.push_back(totalSampleCount > 0 ? (totalSampleCount-1) : 0);
-				playBuffer.insert(playBuffer.end(), recordBuffer.begin(), recordBuffer.end());
-				totalSampleCount = playBuffer.size();
-				unlock();
-			}
-			lock();
-			recordBuffer.resize(0);
-			unlock();
+		if (!record) {
+			record = true;
+		}
+		else if (!recordedPending) {
+			// the loader builds the new sample, this one keeps going while it
+			// has not picked up the last. A streamed file can not be appended
+			// to, the recording replaces it.
+			recordedAppend = (floor(params[MODE_PARAM].getValue()) != 0) && !stream;
+			recordedRate = args.sampleRate;
+			recorded.swap(recordBuffer);
+			recordedPending = true;
+			edit();
 			lights[REC_LIGHT].setBrightness(0.0f);
+			record = false;
 		}
-		record = !record;
 	}
 
 	if (record) {
 		lights[REC_LIGHT].setBrightness(10.0f);
-		lock();
 		dsp::Frame<2> frame;
 		frame.samples[0] = inputs[INL_INPUT].getVoltage()/10.0f;
 		frame.samples[1] = inputs[INR_INPUT].getVoltage()/10.0f;
 		recordBuffer.push_back(frame);
-		unlock();
 	}
 
 	int trigMode = inputs[TRIG_INPUT].isConnected() ? 1 : (inputs[GATE_INPUT].isConnected() ? 2 : 0);
 	int readMode = round(clamp(inputs[READ_MODE_INPUT].getVoltage() + params[READ_MODE_PARAM].getValue(),0.0f,2.0f));
 	speed = inputs[SPEED_INPUT].getVoltage() + params[SPEED_PARAM].getValue();
+	// streamed frames stay at the file rate
+	if (stream) speed *= stream->sampleRate * args.sampleTime;
 	calcLoop();
 
+	if (stream) {
+		// where the next trigger will jump to
+		stream->setHint((speed >= 0) ? (int)sampleStart : (int)(sampleStart + loopLength) - 1);
+	}
+
 	if (trigMode == 1) {
 		if (trigTrigger.process(inputs[TRIG_INPUT].getVoltage()) && (prevTrigState == 0.0f))
 		{
 			initPos();
-			if ((slices.size() == 1) && (inputs[SLICE_INPUT].isConnected())) {
+			if ((slices->size() == 1) && (inputs[SLICE_INPUT].isConnected())) {
 				samplePos = sampleStart + loopLength * rescale(clamp(params[SLICE_PARAM].getValue() + inputs[SLICE_INPUT].getVoltage(), 0.0f,10.0f),0.0f,10.0f,0.0f,1.0f);
 			}
 			play = true;
@@ -598,9 +799,12 @@ void CANARD::process(const ProcessArgs &args) {
 
 			int xi = samplePos;
 			float xf = samplePos - xi;
-			float crossfaded = crossfade(playBuffer[xi].samples[0], playBuffer[min(xi + 1,(int)totalSampleCount-1)].samples[0], xf);
+			if (stream) stream->setPlayHead(xi, speedFactor * speed < 0);
+			dsp::Frame<2> frame0 = frameAt(xi);
+			dsp::Frame<2> frame1 = frameAt(min(xi + 1,(int)totalSampleCount-1));
+			float crossfaded = crossfade(frame0.samples[0], frame1.samples[0], xf);
 			outputs[OUTL_OUTPUT].setVoltage(crossfaded*fadeCoeff*5.0f);
-			crossfaded = crossfade(playBuffer[xi].samples[1], playBuffer[min(xi + 1,(int)totalSampleCount-1)].samples[1], xf);
+			crossfaded = crossfade(frame0.samples[1], frame1.samples[1], xf);
 			outputs[OUTR_OUTPUT].setVoltage(crossfaded*fadeCoeff*5.0f);
 		}
 	}
@@ -637,14 +841,16 @@ struct CANARDDisplay : OpaqueWidget {
 	}
 
 	void onButton(const event::Button &e) override {
-		if (module->slices.size()>0) {
+		std::vector<int> *s = module->sliceList.acquire(handoff::UI_READER);
+		if (s && (s->size()>0)) {
 			refX = e.pos.x;
 			refIdx = ((e.pos.x - zoomLeftAnchor)/zoomWidth)*(float)module->totalSampleCount;
 			module->addSliceMarker = refIdx;
-			auto lower = std::lower_bound(module->slices.begin(), module->slices.end(), refIdx);
-			module->selected = distance(module->slices.begin(),lower-1);
+			auto lower = std::lower_bound(s->begin(), s->end(), refIdx);
+			module->selected = distance(s->begin(),lower-1);
 			module->deleteSliceMarker = *(lower-1);
 		}
+		module->sliceList.release(handoff::UI_READER);
 		if (e.button == 0)
 			OpaqueWidget::onButton(e);
 		else {
@@ -681,158 +887,165 @@ struct CANARDDisplay : OpaqueWidget {
 
 	void drawLayer(const DrawArgs& args, int layer) override {
 		if (layer == 1) {
-			if (module && (module->playBuffer.size()>0)) {
-				if (module->try_lock()) {
-					std::vector<int> s(module->slices);
-					size_t nbSample = module->totalSampleCount;
-
-					nvgScissor(args.vg, 0, 0, width, 2*height+10);
-
-					// Draw play line
-					if (!module->loading) {
-						nvgStrokeColor(args.vg, LIGHTBLUE_BIDOO);
-						{
-							nvgBeginPath(args.vg);
-							nvgStrokeWidth(args.vg, 2);
-							if (nbSample>0) {
-								nvgMoveTo(args.vg, module->samplePos * zoomWidth / nbSample + zoomLeftAnchor, 0);
-								nvgLineTo(args.vg, module->samplePos * zoomWidth / nbSample + zoomLeftAnchor, 2*height+10);
-							}
-							else {
-								nvgMoveTo(args.vg, 0, 0);
-								nvgLineTo(args.vg, 0, 2*height+10);
-							}
-							nvgClosePath(args.vg);
-						}
-						nvgStroke(args.vg);
-					}
-
-					// Draw ref line
-					nvgStrokeColor(args.vg, nvgRGBA(0xff, 0xff, 0xff, 0x30));
-					nvgStrokeWidth(args.vg, 1);
+			waves::StereoSample *sample = module ? module->playBuffer.acquire(handoff::UI_READER) : NULL;
+			const waves::Sample<2> *buffer = sample ? sample->get() : NULL;
+			// a streamed file is not in RAM, only the play line, loop and slices are drawn
+			waves::Stream *stream = module ? module->streamBuffer.acquire(handoff::UI_READER) : NULL;
+			size_t nbSample = buffer ? buffer->size() : (stream ? stream->sampleCount : 0);
+			if (nbSample>0) {
+				std::vector<int> *slices = module->sliceList.acquire(handoff::UI_READER);
+				std::vector<int> s = slices ? *slices : std::vector<int>();
+				module->sliceList.release(handoff::UI_READER);
+
+				nvgScissor(args.vg, 0, 0, width, 2*height+10);
+
+				// Draw play line
+				if (!module->loading) {
+					nvgStrokeColor(args.vg, LIGHTBLUE_BIDOO);
 					{
 						nvgBeginPath(args.vg);
-						nvgMoveTo(args.vg, 0, height/2);
-						nvgLineTo(args.vg, width, height/2);
+						nvgStrokeWidth(args.vg, 2);
+						if (nbSample>0) {
+							nvgMoveTo(args.vg, module->samplePos * zoomWidth / nbSample + zoomLeftAnchor, 0);
+							nvgLineTo(args.vg, module->samplePos * zoomWidth / nbSample + zoomLeftAnchor, 2*height+10);
+						}
+						else {
+							nvgMoveTo(args.vg, 0, 0);
+							nvgLineTo(args.vg, 0, 2*height+10);
+						}
 						nvgClosePath(args.vg);
 					}
 					nvgStroke(args.vg);
+				}
+
+				// Draw ref line
+				nvgStrokeColor(args.vg, nvgRGBA(0xff, 0xff, 0xff, 0x30));
+				nvgStrokeWidth(args.vg, 1);
+				{
+					nvgBeginPath(args.vg);
+					nvgMoveTo(args.vg, 0, height/2);
+					nvgLineTo(args.vg, width, height/2);
+					nvgClosePath(args.vg);
+				}
+				nvgStroke(args.vg);
+
+				nvgStrokeColor(args.vg, nvgRGBA(0xff, 0xff, 0xff, 0x30));
+				nvgStrokeWidth(args.vg, 1);
+				{
+					nvgBeginPath(args.vg);
+					nvgMoveTo(args.vg, 0, 3*height*0.5f+10);
+					nvgLineTo(args.vg, width, 3*height*0.5f+10);
+					nvgClosePath(args.vg);
+				}
+				nvgStroke(args.vg);
+
+				if ((!module->loading) && (nbSample>0)) {
 
-					nvgStrokeColor(args.vg, nvgRGBA(0xff, 0xff, 0xff, 0x30));
+					// Draw loop
+					nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 60));
 					nvgStrokeWidth(args.vg, 1);
-					{
-						nvgBeginPath(args.vg);
-						nvgMoveTo(args.vg, 0, 3*height*0.5f+10);
-						nvgLineTo(args.vg, width, 3*height*0.5f+10);
+					nvgBeginPath(args.vg);
+					nvgMoveTo(args.vg, (module->sampleStart + module->fadeLenght) * zoomWidth / nbSample + zoomLeftAnchor, 0);
+					nvgLineTo(args.vg, module->sampleStart * zoomWidth / nbSample + zoomLeftAnchor, 2*height+10);
+					nvgLineTo(args.vg, (module->sampleStart + module->loopLength) * zoomWidth / nbSample + zoomLeftAnchor, 2*height+10);
+					nvgLineTo(args.vg, (module->sampleStart + module->loopLength - module->fadeLenght) * zoomWidth / nbSample + zoomLeftAnchor, 0);
+					nvgLineTo(args.vg, (module->sampleStart + module->fadeLenght) * zoomWidth / nbSample + zoomLeftAnchor, 0);
+					nvgClosePath(args.vg);
+					nvgFill(args.vg);
+
+					//draw selected
+					if ((module->selected >= 0) && ((size_t)module->selected < s.size()) && (floor(module->params[CANARD::MODE_PARAM].getValue()) == 1)) {
+						nvgStrokeColor(args.vg, RED_BIDOO);
+							nvgBeginPath(args.vg);
+						nvgStrokeWidth(args.vg, 4);
+						nvgMoveTo(args.vg, (s[module->selected] * zoomWidth / nbSample) + zoomLeftAnchor , 2*height+9);
+						if ((size_t)module->selected < (s.size()-1))
+							nvgLineTo(args.vg, (s[module->selected+1] * zoomWidth / nbSample) + zoomLeftAnchor , 2*height+9);
+						else
+							nvgLineTo(args.vg, zoomWidth + zoomLeftAnchor, 2*height+9);
 						nvgClosePath(args.vg);
+						nvgStroke(args.vg);
 					}
-					nvgStroke(args.vg);
 
-					if ((!module->loading) && (nbSample>0)) {
+					// Draw waveform
 
-						// Draw loop
-						nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 60));
-						nvgStrokeWidth(args.vg, 1);
+					if (buffer) {
+						nvgStrokeColor(args.vg, PINK_BIDOO);
+						nvgSave(args.vg);
+						Rect b = Rect(Vec(zoomLeftAnchor, 0), Vec(zoomWidth, height));
+						float invNbSample = 1.0f / nbSample;
+						size_t inc = std::max(nbSample/zoomWidth/4,1.f);
 						nvgBeginPath(args.vg);
-						nvgMoveTo(args.vg, (module->sampleStart + module->fadeLenght) * zoomWidth / nbSample + zoomLeftAnchor, 0);
-						nvgLineTo(args.vg, module->sampleStart * zoomWidth / nbSample + zoomLeftAnchor, 2*height+10);
-						nvgLineTo(args.vg, (module->sampleStart + module->loopLength) * zoomWidth / nbSample + zoomLeftAnchor, 2*height+10);
-						nvgLineTo(args.vg, (module->sampleStart + module->loopLength - module->fadeLenght) * zoomWidth / nbSample + zoomLeftAnchor, 0);
-						nvgLineTo(args.vg, (module->sampleStart + module->fadeLenght) * zoomWidth / nbSample + zoomLeftAnchor, 0);
-						nvgClosePath(args.vg);
-						nvgFill(args.vg);
-
-						//draw selected
-						if ((module->selected >= 0) && ((size_t)module->selected < s.size()) && (floor(module->params[CANARD::MODE_PARAM].getValue()) == 1)) {
-							nvgStrokeColor(args.vg, RED_BIDOO);
-								nvgBeginPath(args.vg);
-							nvgStrokeWidth(args.vg, 4);
-							nvgMoveTo(args.vg, (s[module->selected] * zoomWidth / nbSample) + zoomLeftAnchor , 2*height+9);
-							if ((size_t)module->selected < (s.size()-1))
-								nvgLineTo(args.vg, (s[module->selected+1] * zoomWidth / nbSample) + zoomLeftAnchor , 2*height+9);
-							else
-								nvgLineTo(args.vg, zoomWidth + zoomLeftAnchor, 2*height+9);
-							nvgClosePath(args.vg);
-							nvgStroke(args.vg);
+						for (size_t i = 0; i < nbSample; i+=inc) {
+							float x, y;
+							x = (float)i * invNbSample ;
+							y = (-1.f)*buffer->frame(i).samples[0] * 0.5f + 0.5f;
+							Vec p;
+							p.x = b.pos.x + b.size.x * x;
+							p.y = b.pos.y + b.size.y * (1.0f - y);
+							if (i == 0) {
+								nvgMoveTo(args.vg, p.x, p.y);
+							}
+							else {
+								nvgLineTo(args.vg, p.x, p.y);
+							}
 						}
 
-						// Draw waveform
+						nvgLineCap(args.vg, NVG_MITER);
+						nvgStrokeWidth(args.vg, 1);
+						nvgGlobalCompositeOperation(args.vg, NVG_LIGHTER);
+						nvgStroke(args.vg);
 
-						if (nbSample>0) {
-							nvgStrokeColor(args.vg, PINK_BIDOO);
-							nvgSave(args.vg);
-							Rect b = Rect(Vec(zoomLeftAnchor, 0), Vec(zoomWidth, height));
-							float invNbSample = 1.0f / nbSample;
-							size_t inc = std::max(nbSample/zoomWidth/4,1.f);
-							nvgBeginPath(args.vg);
-							for (size_t i = 0; i < nbSample; i+=inc) {
-								float x, y;
-								x = (float)i * invNbSample ;
-								y = (-1.f)*module->playBuffer[i].samples[0] * 0.5f + 0.5f;
-								Vec p;
-								p.x = b.pos.x + b.size.x * x;
-								p.y = b.pos.y + b.size.y * (1.0f - y);
-								if (i == 0) {
-									nvgMoveTo(args.vg, p.x, p.y);
-								}
-								else {
-									nvgLineTo(args.vg, p.x, p.y);
-								}
+						b = Rect(Vec(zoomLeftAnchor, height+10), Vec(zoomWidth, height));
+						nvgBeginPath(args.vg);
+						for (size_t i = 0; i < nbSample; i+=inc) {
+							float x, y;
+							x = (float)i * invNbSample;
+							y = (-1.f)*buffer->frame(i).samples[1] * 0.5f + 0.5f;
+							Vec p;
+							p.x = b.pos.x + b.size.x * x;
+							p.y = b.pos.y + b.size.y * (1.0f - y);
+							if (i == 0)
+								nvgMoveTo(args.vg, p.x, p.y);
+							else {
+								nvgLineTo(args.vg, p.x, p.y);
 							}
+						}
+						nvgLineCap(args.vg, NVG_MITER);
+						nvgStrokeWidth(args.vg, 1);
+						nvgGlobalCompositeOperation(args.vg, NVG_LIGHTER);
+						nvgStroke(args.vg);
+					}
 
-							nvgLineCap(args.vg, NVG_MITER);
-							nvgStrokeWidth(args.vg, 1);
-							nvgGlobalCompositeOperation(args.vg, NVG_LIGHTER);
-							nvgStroke(args.vg);
+					//draw slices
 
-							b = Rect(Vec(zoomLeftAnchor, height+10), Vec(zoomWidth, height));
-							nvgBeginPath(args.vg);
-							for (size_t i = 0; i < nbSample; i+=inc) {
-								float x, y;
-								x = (float)i * invNbSample;
-								y = (-1.f)*module->playBuffer[i].samples[1] * 0.5f + 0.5f;
-								Vec p;
-								p.x = b.pos.x + b.size.x * x;
-								p.y = b.pos.y + b.size.y * (1.0f - y);
-								if (i == 0)
-									nvgMoveTo(args.vg, p.x, p.y);
-								else {
-									nvgLineTo(args.vg, p.x, p.y);
-								}
+					if (floor(module->params[CANARD::MODE_PARAM].getValue()) == 1) {
+						for (size_t i = 0; i < s.size(); i++) {
+							if (s[i] != module->deleteSliceMarker) {
+								nvgStrokeColor(args.vg, YELLOW_BIDOO);
+							}
+							else {
+								nvgStrokeColor(args.vg, RED_BIDOO);
 							}
-							nvgLineCap(args.vg, NVG_MITER);
 							nvgStrokeWidth(args.vg, 1);
-							nvgGlobalCompositeOperation(args.vg, NVG_LIGHTER);
-							nvgStroke(args.vg);
-						}
-
-						//draw slices
-
-						if (floor(module->params[CANARD::MODE_PARAM].getValue()) == 1) {
-							for (size_t i = 0; i < s.size(); i++) {
-								if (s[i] != module->deleteSliceMarker) {
-									nvgStrokeColor(args.vg, YELLOW_BIDOO);
-								}
-								else {
-									nvgStrokeColor(args.vg, RED_BIDOO);
-								}
-								nvgStrokeWidth(args.vg, 1);
-								{
-									nvgBeginPath(args.vg);
-									nvgMoveTo(args.vg, s[i] * zoomWidth / nbSample + zoomLeftAnchor , 0);
-									nvgLineTo(args.vg, s[i] * zoomWidth / nbSample + zoomLeftAnchor , 2*height+10);
-									nvgClosePath(args.vg);
-								}
-								nvgStroke(args.vg);
+							{
+								nvgBeginPath(args.vg);
+								nvgMoveTo(args.vg, s[i] * zoomWidth / nbSample + zoomLeftAnchor , 0);
+								nvgLineTo(args.vg, s[i] * zoomWidth / nbSample + zoomLeftAnchor , 2*height+10);
+								nvgClosePath(args.vg);
 							}
+							nvgStroke(args.vg);
 						}
-
 					}
-					nvgResetScissor(args.vg);
-					nvgRestore(args.vg);
 
-					module->unlock();
 				}
+				nvgResetScissor(args.vg);
+				nvgRestore(args.vg);
+			}
+			if (module) {
+				module->playBuffer.release(handoff::UI_READER);
+				module->streamBuffer.release(handoff::UI_READER);
+				module->collect();
 			}
 		}
 		Widget::drawLayer(args, layer);
@@ -903,6 +1116,7 @@ struct CANARDWidget : BidooWidget {
 		CANARD *module;
 		void onAction(const event::Action &e) override {
 			module->deleteFlag = true;
+			module->edit();
 		}
 	};
 
@@ -910,6 +1124,7 @@ struct CANARDWidget : BidooWidget {
 		CANARD *module;
 		void onAction(const event::Action &e) override {
 			module->deleteSliceMarkerFlag = true;
+			module->edit();
 		}
 	};
 
@@ -917,6 +1132,7 @@ struct CANARDWidget : BidooWidget {
 		CANARD *module;
 		void onAction(const event::Action &e) override {
 			module->addSliceMarkerFlag = true;
+			module->edit();
 		}
 	};
 
@@ -953,6 +1169,13 @@ struct CANARDWidget : BidooWidget {
 	};
 
 
+	// edits retire buffers from process() even when the display is not drawn
+	void step() override {
+		CANARD *module = dynamic_cast<CANARD*>(this->module);
+		if (module) module->collect();
+		BidooWidget::step();
+	}
+
 	void onPathDrop(const PathDropEvent& e) override {
 		Widget::onPathDrop(e);
 		CANARD *module = dynamic_cast<CANARD*>(this->module);
@@ -960,6 +1183,22 @@ struct CANARDWidget : BidooWidget {
 		module->loading=true;
 	}
 
+	struct CANARDStreamingItem : MenuItem {
+		CANARD *module;
+		void onAction(const event::Action &e) override {
+			module->streaming = !module->streaming;
+			if (!module->lastPath.empty()) module->loading = true;
+		}
+	};
+
+	struct CANARDCompactItem : MenuItem {
+		CANARD *module;
+		void onAction(const event::Action &e) override {
+			module->compactStorage = !module->compactStorage;
+			if (!module->lastPath.empty()) module->loading = true;
+		}
+	};
+
 	struct CANARDSaveSample : MenuItem {
 		CANARD *module;
 		void onAction(const event::Action &e) override {
@@ -996,7 +1235,16 @@ struct CANARDWidget : BidooWidget {
 		menu->addChild(construct<CANARDAddSliceMarker>(&MenuItem::text, "Add slice marker", &CANARDAddSliceMarker::module, module));
 		menu->addChild(construct<CANARDTransientDetect>(&MenuItem::text, "Detect transients", &CANARDTransientDetect::module, module));
 		menu->addChild(construct<CANARDLoadSample>(&MenuItem::text, "Load sample", &CANARDLoadSample::module, module));
+		menu->addChild(createMenuLabel(loader::describe()));
 		menu->addChild(construct<CANARDSaveSample>(&MenuItem::text, "Save sample", &CANARDSaveSample::module, module));
+		menu->addChild(construct<CANARDStreamingItem>(&MenuItem::text, "Stream from disk", &MenuItem::rightText, CHECKMARK(module->streaming), &CANARDStreamingItem::module, module));
+		menu->addChild(construct<CANARDCompactItem>(&MenuItem::text, "16-bit sample storage", &MenuItem::rightText, CHECKMARK(module->compactStorage), &CANARDCompactItem::module, module));
+
+		waves::Stream *stream = module->streamBuffer.acquire(handoff::UI_READER);
+		if (stream) {
+			menu->addChild(createMenuLabel("Stream underruns: " + std::to_string(stream->underruns.load())));
+		}
+		module->streamBuffer.release(handoff::UI_READER);
 	}
 };
 
@@ -4,6 +4,8 @@
 #include "dep/gverb/src/gverb.c"
 #include "dep/gverb/src/gverbdsp.c"
 
+#define DFUZE_MAX_SIZE 300.0f
+
 using namespace std;
 
 struct DFUZE : BidooModule {
@@ -38,21 +40,20 @@ struct DFUZE : BidooModule {
 	};
 
 
-	ty_gverb *verb;
+	// built for the rate by onSampleRateChange
+	ty_gverb *verb = NULL;
 	float lOut = 0.f, rOut = 0.f;
 
 	DFUZE() {
     config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
-		configParam(SIZE_PARAM, 0.0f, 300.0f, 0.5f, "Size");
+		configParam(SIZE_PARAM, 0.0f, DFUZE_MAX_SIZE, 0.5f, "Size");
 		configParam(REVTIME_PARAM, 0.0f, 50.0f, 0.5f, "Reverb time");
 		configParam(DAMP_PARAM, 0.0f, 0.9f, 0.5f, "Damping");
 		configParam(BANDWIDTH_PARAM, 0.0f, 1.0f, 0.5f, "Bandwidth");
     configParam(EARLYLEVEL_PARAM, 0.0f, 10.0f, 5.0f, "Early reflections level");
     configParam(TAIL_PARAM, 0.0f, 10.0f, 5.0f, "Tail level");
 
-		verb = gverb_new(APP->engine->getSampleRate(), 300, 1, 1, 1, 1, 1, 1, 1);
-
-		configInput(IN_INPUT, "In");
+		configInput(IN_INPUT, "In (2 channels for stereo)");
 		configInput(SIZE_INPUT, "Size");
 		configInput(REVTIME_INPUT, "Reverb time");
 		configInput(DAMP_INPUT, "Damping");
@@ -62,24 +63,45 @@ struct DFUZE : BidooModule {
 
 		configOutput(OUT_L_OUTPUT, "Out L");
 		configOutput(OUT_R_OUTPUT, "Out R");
+
+		controlRateSupported = true;
 	}
 
 	~DFUZE() {
-		gverb_free(verb);
+		if (verb)
+			gverb_free(verb);
+	}
+
+	// the delay lines are sized for the rate, the parameters are applied
+	// again on the next sample
+	void onSampleRateChange(const SampleRateChangeEvent &e) override {
+		if (verb)
+			gverb_free(verb);
+		verb = gverb_new(e.sampleRate, DFUZE_MAX_SIZE, 1, 1, 1, 1, 1, 1, 1);
+		controlRateCounter = 0;
 	}
 
 	void process(const ProcessArgs &args) override;
 };
 
 void DFUZE::process(const ProcessArgs &args) {
-	gverb_set_roomsize(verb, clamp(params[SIZE_PARAM].getValue()+rescale(inputs[SIZE_INPUT].getVoltage(),0.0f,10.0f,0.0f,300.0f),0.0f,300.0f));
-	gverb_set_revtime(verb, clamp(params[REVTIME_PARAM].getValue()+rescale(inputs[REVTIME_INPUT].getVoltage(),0.0f,10.0f,0.0f,50.0f),0.0f,50.0f));
-	gverb_set_damping(verb, clamp(params[DAMP_PARAM].getValue()+inputs[DAMP_INPUT].getVoltage(),0.0f,0.9f));
-	gverb_set_inputbandwidth(verb, clamp(params[BANDWIDTH_PARAM].getValue()+inputs[BANDWIDTH_INPUT].getVoltage(),0.0f,1.0f));
-	gverb_set_earlylevel(verb, clamp(rescale(params[EARLYLEVEL_PARAM].getValue()+inputs[EARLYLEVEL_INPUT].getVoltage(),0.0f,10.0f,0.0f,1.0f),0.0f,1.0f));
-	gverb_set_taillevel(verb, clamp(rescale(params[TAIL_PARAM].getValue()+inputs[TAIL_INPUT].getVoltage(),0.0f,10.0f,0.0f,1.0f),0.0f,1.0f));
-
-	gverb_do(verb, inputs[IN_INPUT].getVoltage()/10.0f, &lOut, &rOut);
+	if (!verb)
+		return;
+
+	if (controlRateTick()) {
+		gverb_set_glide(verb, controlRateDivision);
+		gverb_set_roomsize(verb, clamp(params[SIZE_PARAM].getValue()+rescale(inputs[SIZE_INPUT].getVoltage(),0.0f,10.0f,0.0f,DFUZE_MAX_SIZE),0.0f,DFUZE_MAX_SIZE));
+		gverb_set_revtime(verb, clamp(params[REVTIME_PARAM].getValue()+rescale(inputs[REVTIME_INPUT].getVoltage(),0.0f,10.0f,0.0f,50.0f),0.0f,50.0f));
+		gverb_set_damping(verb, clamp(params[DAMP_PARAM].getValue()+inputs[DAMP_INPUT].getVoltage(),0.0f,0.9f));
+		gverb_set_inputbandwidth(verb, clamp(params[BANDWIDTH_PARAM].getValue()+inputs[BANDWIDTH_INPUT].getVoltage(),0.0f,1.0f));
+		gverb_set_earlylevel(verb, clamp(rescale(params[EARLYLEVEL_PARAM].getValue()+inputs[EARLYLEVEL_INPUT].getVoltage(),0.0f,10.0f,0.0f,1.0f),0.0f,1.0f));
+		gverb_set_taillevel(verb, clamp(rescale(params[TAIL_PARAM].getValue()+inputs[TAIL_INPUT].getVoltage(),0.0f,10.0f,0.0f,1.0f),0.0f,1.0f));
+	}
+
+	if (inputs[IN_INPUT].getChannels() > 1)
+		gverb_do_stereo(verb, inputs[IN_INPUT].getVoltage(0)/10.0f, inputs[IN_INPUT].getVoltage(1)/10.0f, &lOut, &rOut);
+	else
+		gverb_do(verb, inputs[IN_INPUT].getVoltage()/10.0f, &lOut, &rOut);
 	outputs[OUT_L_OUTPUT].setVoltage(lOut);
 	outputs[OUT_R_OUTPUT].setVoltage(rOut);
 }
@@ -14,6 +14,9 @@ Based on Laurent de Soras resampler for pitch shifting
 // #include <sstream>
 #include <mutex>
 #include "dep/waves.hpp"
+#include "dep/handoff.hpp"
+#include "dep/loader.hpp"
+#include "dep/ringbuffer.hpp"
 
 #if defined(METAMODULE)
 #include "async_filebrowser.hh"
@@ -43,6 +46,16 @@ inline constexpr signum(T const x) {
     return (T(0) < x) - (x < T(0));
 }
 
+struct EDSAROSSample {
+	// the mip maps hold their own float copies, this one is for display and zero crossings
+	waves::Sample<1> wav;
+	rspl::MipMapFlt	mip_map;
+	rspl::MipMapFlt	rev_mip_map;
+	int totalSampleCount = 0;
+	// engine rate at load time, a later rate change is made up by the voices pitch
+	float frameRate = 0.0f;
+};
+
 struct EDSAROS : BidooModule {
 	enum ParamIds {
 		SAMPLESTART_PARAM,
@@ -101,20 +114,18 @@ struct EDSAROS : BidooModule {
 	std::string lastPath;
 	std::string waveFileName;
 	std::string waveExtension;
-	vector<dsp::Frame<1>> loadingBuffer;
+	handoff::Handoff<EDSAROSSample> loadedSample;
+	EDSAROSSample *current = NULL;
 	int channels=0;
 	int sampleRate=0;
 	int totalSampleCount=0;
 	rspl::InterpPack interp_pack;
-	rspl::MipMapFlt	mip_map;
-	rspl::MipMapFlt	rev_mip_map;
 	rspl::ResamplerFlt voices[16];
 	rspl::ResamplerFlt rev_voices[16];
-	float *sample = NULL;
-	float *rev_sample = NULL;
 	bool loading = false;
+	bool compactStorage = false;
 	int pos = 0;
-	dsp::DoubleRingBuffer<float,SIZE> audio[16];
+	ringbuffer::RingBuffer<float,SIZE> audio[16];
 	bool play[16] = {false};
 	bool feed[16] = {false};
 	int internalIntegerPosition[16] = {0};
@@ -122,6 +133,8 @@ struct EDSAROS : BidooModule {
 	int internalIntegerRevPosition[16] = {0};
 	int internalFloatingRevPosition[16] = {0};
 	const long depth = 1L << rspl::ResamplerFlt::NBR_BITS_PER_OCT;
+	float rateRatio = 1.0f;
+	long ratePitch = 0;
 	int sampleStart=0;
 	int sampleEnd=0;
 	int loopStart=0;
@@ -146,11 +159,10 @@ struct EDSAROS : BidooModule {
 	int direction[16] = {1};
   bool zeroCrossing = false;
   dsp::SchmittTrigger zeroCrossingTrigger;
-	std::atomic<bool> locked{false};
 
 #if defined(METAMODULE)
 	MetaModule::AsyncThread loadSampleAsync{this, [this]() {
-		this->loadSampleInternal();
+		loader::poll(this);
 	}};
 #endif
 
@@ -201,40 +213,31 @@ struct EDSAROS : BidooModule {
 		configOutput(OUT, "Audio");
 	}
 
-	~EDSAROS() {
-		free(sample);
-		free(rev_sample);
+	~EDSAROS() override {
+		loader::cancel(this);
 	}
 
 	void process(const ProcessArgs &args) override;
 
-	void loadSample();
+	void loadSample(int priority = loader::PRIORITY_USER);
 	void loadSampleInternal();
 
-	void lock() {
-		bool expected = false;
-		while (!locked.compare_exchange_strong(expected, true)) {
-			expected = false;
-		}
-	}
-
-	void unlock() {
-		locked.store(false);
-	}
-
 	json_t *dataToJson() override {
 		json_t *rootJ = BidooModule::dataToJson();
 		json_object_set_new(rootJ, "lastPath", json_string(lastPath.c_str()));
     json_object_set_new(rootJ, "zeroCrossing", json_boolean(zeroCrossing));
+    json_object_set_new(rootJ, "compactStorage", json_boolean(compactStorage));
 		return rootJ;
 	}
 
 	void dataFromJson(json_t *rootJ) override {
     BidooModule::dataFromJson(rootJ);
+    json_t *compactStorageJ = json_object_get(rootJ, "compactStorage");
+		if (compactStorageJ) compactStorage = json_is_true(compactStorageJ);
 		json_t *lastPathJ = json_object_get(rootJ, "lastPath");
 		if (lastPathJ) {
 			lastPath = json_string_value(lastPathJ);
-			if (!lastPath.empty()) loadSample();
+			if (!lastPath.empty()) loadSample(loader::PRIORITY_PATCH);
 		}
     json_t *zeroCrossingJ = json_object_get(rootJ, "zeroCrossing");
 		if (zeroCrossingJ) zeroCrossing = json_is_true(zeroCrossingJ);
@@ -278,20 +281,17 @@ struct EDSAROS : BidooModule {
 		return sustain;
 	}
 
-	void onSampleRateChange() override {
-		if (!lastPath.empty()) loadSample();
-	}
-
 	int getSnappedIndex(float p, bool forward, bool zeroCrossing) {
 		int idx = p*(totalSampleCount-1)*0.1f;
     	if (!zeroCrossing) return idx;
 		if (forward) {
-			while ((sample[idx]*sample[idx+1])>0 && (idx<totalSampleCount-1)) {
+			while ((idx<totalSampleCount-1) && (current->wav.frame(idx).samples[0]*current->wav.frame(idx+1).samples[0])>0) {
 				idx=idx+1;
 			}
 		}
 		else {
-			while ((sample[idx]*sample[idx+1])>0 && (idx>=0)) {
+			// the last frame is compared with the first one, as the looped sample does
+			while ((idx>=0) && (current->wav.frame(idx).samples[0]*current->wav.frame((idx+1)%totalSampleCount).samples[0])>0) {
 				idx=idx-1;
 			}
 		}
@@ -347,27 +347,25 @@ void EDSAROS::loadSampleInternal() {
 		lastPath = "";
 		waveFileName = "";
 		waveExtension = "";
-		loading = false;
 		return;
 	}
 
-	lock();
-	loadingBuffer = waves::getMonoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, channels, sampleRate, totalSampleCount);
-	if (loadingBuffer.size()>0) {
-		free(sample);
-		free(rev_sample);
-		sample = new float[2*totalSampleCount];
-		rev_sample = new float[2*totalSampleCount];
-
-		for (int i=0; i<totalSampleCount; i++) {
-			sample[i]=loadingBuffer[i].samples[0];
-			sample[i+totalSampleCount]=loadingBuffer[i].samples[0];
-			rev_sample[i]=loadingBuffer[totalSampleCount-i-1].samples[0];
-			rev_sample[i+totalSampleCount]=loadingBuffer[totalSampleCount-i-1].samples[0];
+	EDSAROSSample *loaded = new EDSAROSSample;
+	loaded->frameRate = APP->engine->getSampleRate();
+	loaded->wav.frames = waves::getMonoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, channels, sampleRate, loaded->totalSampleCount);
+	if (loaded->wav.frames.size()>0) {
+		int count = loaded->totalSampleCount;
+		const vector<dsp::Frame<1>> &frames = loaded->wav.frames;
+		// one scratch buffer feeds both mip maps, forward then reversed
+		std::vector<float> sample(2*count);
+
+		for (int i=0; i<count; i++) {
+			sample[i]=frames[i].samples[0];
+			sample[i+count]=frames[i].samples[0];
 		}
 
-		mip_map.init_sample (
-			2*totalSampleCount,
+		loaded->mip_map.init_sample (
+			2*count,
 			rspl::InterpPack::get_len_pre (),
 			rspl::InterpPack::get_len_post (),
 			12,
@@ -375,10 +373,15 @@ void EDSAROS::loadSampleInternal() {
 			rspl::ResamplerFlt::MIP_MAP_FIR_LEN
 		);
 
-		mip_map.fill_sample (&sample[0], 2*totalSampleCount);
+		loaded->mip_map.fill_sample (&sample[0], 2*count);
+
+		for (int i=0; i<count; i++) {
+			sample[i]=frames[count-i-1].samples[0];
+			sample[i+count]=frames[count-i-1].samples[0];
+		}
 
-		rev_mip_map.init_sample (
-			2*totalSampleCount,
+		loaded->rev_mip_map.init_sample (
+			2*count,
 			rspl::InterpPack::get_len_pre (),
 			rspl::InterpPack::get_len_post (),
 			12,
@@ -386,37 +389,71 @@ void EDSAROS::loadSampleInternal() {
 			rspl::ResamplerFlt::MIP_MAP_FIR_LEN
 		);
 
-		rev_mip_map.fill_sample (&rev_sample[0], 2*totalSampleCount);
-
-		for (int i=0; i<16; i++) {
-			voices[i].set_sample (mip_map);
-			voices[i].set_interp (interp_pack);
-			voices[i].clear_buffers ();
-			rev_voices[i].set_sample (rev_mip_map);
-			rev_voices[i].set_interp (interp_pack);
-			rev_voices[i].clear_buffers ();
-		}
+		loaded->rev_mip_map.fill_sample (&sample[0], 2*count);
 
+		if (compactStorage) loaded->wav.compact();
+		else vector<dsp::Frame<1>>(loaded->wav.frames).swap(loaded->wav.frames);
+	}
+	else {
+		delete loaded;
+		loaded = NULL;
 	}
-	unlock();
-	loading = false;
 
-	vector<dsp::Frame<1>>(loadingBuffer).swap(loadingBuffer);
+	// the voices are pointed at the new mip maps by process() once it picks the sample up
+	if (!loadedSample.publish(loaded)) delete loaded;
+	loadedSample.collect();
 }
 
-void EDSAROS::loadSample() {
+void EDSAROS::loadSample(int priority) {
+	loader::Job job;
+	job.owner = this;
+	job.path = lastPath;
+	job.priority = priority;
+	job.load = [this]() {
+		this->loadSampleInternal();
+	};
 #if defined(METAMODULE)
-	loadSampleAsync.run_once();
-#else
-	loadSampleInternal();
+	job.wake = [this]() {
+		loadSampleAsync.run_once();
+	};
 #endif
+	loader::submit(job);
 }
 
 void EDSAROS::process(const ProcessArgs &args) {
 	if (loading) {
+		loading = false;
 		loadSample();
 	}
 
+	EDSAROSSample *loaded = loadedSample.acquire(handoff::AUDIO_READER);
+	if (loaded != current) {
+		current = loaded;
+		totalSampleCount = current ? current->totalSampleCount : 0;
+		for (int i=0; i<16; i++) {
+			if (current) {
+				voices[i].set_sample (current->mip_map);
+				voices[i].set_interp (interp_pack);
+				voices[i].clear_buffers ();
+				rev_voices[i].set_sample (current->rev_mip_map);
+				rev_voices[i].set_interp (interp_pack);
+				rev_voices[i].clear_buffers ();
+			}
+			else {
+				voices[i].remove_sample ();
+				rev_voices[i].remove_sample ();
+			}
+		}
+	}
+
+	// the sample stays at the rate it was loaded at, the voices read it faster
+	// or slower after a rate change instead of it being reloaded
+	float ratio = (current && (current->frameRate > 0.0f)) ? current->frameRate * args.sampleTime : 1.0f;
+	if (ratio != rateRatio) {
+		rateRatio = ratio;
+		ratePitch = std::lround(std::log2(ratio) * depth);
+	}
+
   if (zeroCrossingTrigger.process(params[ZEROCROSSING_PARAM].getValue())) {
     zeroCrossing=!zeroCrossing;
   }
@@ -517,7 +554,7 @@ void EDSAROS::process(const ProcessArgs &args) {
 				}
 
 				if (play[i] || rel[i]) {
-					const long pitch = inputs[PITCH_INPUT].getVoltage(i) * depth;
+					const long pitch = inputs[PITCH_INPUT].getVoltage(i) * depth + ratePitch;
 					voices[i].set_pitch(pitch);
 					rev_voices[i].set_pitch(pitch);
 
@@ -536,18 +573,12 @@ void EDSAROS::process(const ProcessArgs &args) {
               nbr_spl = SIZE;
             }
             if (nbr_spl>0) {
-              float *buff = new float[nbr_spl];
+              float buff[SIZE];
               voices[i].interpolate_block(buff, nbr_spl);
               
               // Make sure we don't write beyond the buffer's capacity
               int writeSize = std::min(nbr_spl, (long)audio[i].capacity());
-              for (int j=0; j<writeSize; j++) {
-                *(audio[i].endData()+j) = buff[j];
-              }
-              audio[i].endIncr(writeSize);
-              
-              // Free the allocated memory
-              delete[] buff;
+              audio[i].push(buff, writeSize);
             }
 			} else {
             long nbr_spl;
@@ -561,18 +592,12 @@ void EDSAROS::process(const ProcessArgs &args) {
               nbr_spl = SIZE;
             }
             if (nbr_spl>0) {
-              float *buff = new float[nbr_spl];
+              float buff[SIZE];
               rev_voices[i].interpolate_block(buff, nbr_spl);
               
               // Make sure we don't write beyond the buffer's capacity
               int writeSize = std::min(nbr_spl, (long)audio[i].capacity());
-              for (int j=0; j<writeSize; j++) {
-                *(audio[i].endData()+j) = buff[j];
-              }
-              audio[i].endIncr(writeSize);
-              
-              // Free the allocated memory
-              delete[] buff;
+              audio[i].push(buff, writeSize);
             }
 					}
 
@@ -581,9 +606,8 @@ void EDSAROS::process(const ProcessArgs &args) {
 			}
 			else if (feed[i]) {
 				for (int j=0; j<SIZE; j++) {
-					*(audio[i].endData()+j) = 0.0f;
+					audio[i].push(0.0f);
 				}
-				audio[i].endIncr(SIZE);
 				feed[i] = false;
 			}
 
@@ -595,7 +619,7 @@ void EDSAROS::process(const ProcessArgs &args) {
 					audio[i].startIncr(1);
 				}
 				else {
-					outputs[OUT].setVoltage(*audio[i].startData()*5.0f*gain[i]*params[GAIN_PARAM].getValue(),i);
+					outputs[OUT].setVoltage(audio[i].front()*5.0f*gain[i]*params[GAIN_PARAM].getValue(),i);
 					audio[i].startIncr(1);
 				}
 			}
@@ -778,13 +802,14 @@ struct EDSAROSDisplay : OpaqueWidget {
   }
 
 	void drawSample(const DrawArgs &args) {
-		if (module->loadingBuffer.size()>0) {
-			module->lock();
+		EDSAROSSample *loaded = module->loadedSample.acquire(handoff::UI_READER);
+		if (loaded && (loaded->wav.size()>0)) {
   		std::vector<float> vL;
-			for (int i=0;i<module->totalSampleCount;i++) {
-				vL.push_back(module->loadingBuffer[i].samples[0]*module->params[EDSAROS::GAIN_PARAM].getValue());
+			for (int i=0;i<loaded->totalSampleCount;i++) {
+				vL.push_back(loaded->wav.frame(i).samples[0]*module->params[EDSAROS::GAIN_PARAM].getValue());
 			}
-  		module->unlock();
+			module->loadedSample.release(handoff::UI_READER);
+			module->loadedSample.collect();
   		size_t nbSample = vL.size();
 
   		if (nbSample>0) {
@@ -1132,12 +1157,22 @@ struct EDSAROSWidget : BidooWidget {
   	}
   };
 
+  struct EDSAROSCompactItem : MenuItem {
+  	EDSAROS *module;
+  	void onAction(const event::Action &e) override {
+  		module->compactStorage = !module->compactStorage;
+  		if (!module->lastPath.empty()) module->loading = true;
+  	}
+  };
+
   void appendContextMenu(ui::Menu *menu) override {
     BidooWidget::appendContextMenu(menu);
 		EDSAROS *module = dynamic_cast<EDSAROS*>(this->module);
 		assert(module);
 		menu->addChild(new MenuSeparator());
 		menu->addChild(construct<EDSAROSItem>(&MenuItem::text, "Load sample", &EDSAROSItem::module, module));
+		menu->addChild(createMenuLabel(loader::describe()));
+		menu->addChild(construct<EDSAROSCompactItem>(&MenuItem::text, "16-bit sample storage", &MenuItem::rightText, CHECKMARK(module->compactStorage), &EDSAROSCompactItem::module, module));
 	}
 
 	void onPathDrop(const PathDropEvent& e) override {
@@ -9,6 +9,9 @@
 #endif
 #include <vector>
 #include "dep/lodepng/lodepng.h"
+#include "dep/fftplans.hpp"
+#include "dep/handoff.hpp"
+#include "dep/loader.hpp"
 
 
 const int FS = 4096;
@@ -22,6 +25,12 @@ const float IFS2 = 1.0f/FS2;
 
 using namespace std;
 
+struct EMILEImage {
+	std::vector<unsigned char> pixels;
+	unsigned width = 0;
+	unsigned height = 0;
+};
+
 inline double fastPow(double a, double b) {
   union {
     double d;
@@ -68,9 +77,7 @@ struct EMILE : BidooModule {
 
 	std::string lastPath;
 	bool loading = false;
-	std::vector<unsigned char> image;
-  unsigned width = 0;
-	unsigned height = 0;
+	handoff::Handoff<EMILEImage> image;
 	unsigned samplePos = 0;
   float *magn;
   float *out;
@@ -79,17 +86,17 @@ struct EMILE : BidooModule {
   PFFFT_Setup *pffftSetup;
   float *fftIn;
   float *fftOut;
+  float *fftWork;
   bool r = false;
   bool g = false;
   bool b = false;
   bool a = false;
   dsp::SchmittTrigger rTrigger, gTrigger, bTrigger, aTrigger;
   float curve=0.0f;
-  std::atomic<bool> locked{false};
 
 #if defined(METAMODULE)
 	MetaModule::AsyncThread loadSampleAsync{this, [this]() {
-		this->loadSampleInternal();
+		loader::poll(this);
 	}};
 #endif
 
@@ -119,36 +126,27 @@ struct EMILE : BidooModule {
     acc = (float*) pffft_aligned_malloc(2*FS*sizeof(float));
     memset(acc, 0, 2*FS*sizeof(float));
     memset(out, 0, STS*sizeof(float));
-    pffftSetup = pffft_new_setup(FS, PFFFT_REAL);
-    fftIn = (float*)pffft_aligned_malloc(FS*sizeof(float));
-    fftOut =  (float*)pffft_aligned_malloc(FS*sizeof(float));
+    pffftSetup = fftplans::acquire(FS, PFFFT_REAL);
+    fftIn = fftplans::acquireBuffer(FS);
+    fftOut = fftplans::acquireBuffer(FS);
+    fftWork = fftplans::acquireBuffer(FS);
 	}
 
   ~EMILE() override {
+    loader::cancel(this);
     pffft_aligned_free(magn);
     pffft_aligned_free(out);
     pffft_aligned_free(acc);
-    pffft_aligned_free(fftIn);
-    pffft_aligned_free(fftOut);
-    pffft_destroy_setup(pffftSetup);
+    fftplans::releaseBuffer(fftIn, FS);
+    fftplans::releaseBuffer(fftOut, FS);
+    fftplans::releaseBuffer(fftWork, FS);
 	}
 
 	void process(const ProcessArgs &args) override;
 
-	void loadSample(std::string path);
+	void loadSample(std::string path, int priority = loader::PRIORITY_USER);
 	void loadSampleInternal();
 	
-	void lock() {
-		bool expected = false;
-		while (!locked.compare_exchange_strong(expected, true)) {
-			expected = false;
-		}
-	}
-
-	void unlock() {
-		locked.store(false);
-	}
-
 	json_t *dataToJson() override {
 		json_t *rootJ = BidooModule::dataToJson();
 		json_object_set_new(rootJ, "lastPath", json_string(lastPath.c_str()));
@@ -166,7 +164,7 @@ struct EMILE : BidooModule {
 		json_t *lastPathJ = json_object_get(rootJ, "lastPath");
 		if (lastPathJ) {
 			lastPath = json_string_value(lastPathJ);
-			loadSample(lastPath);
+			loadSample(lastPath, loader::PRIORITY_PATCH);
 		}
 
     json_t *rJ = json_object_get(rootJ, "r");
@@ -184,33 +182,43 @@ struct EMILE : BidooModule {
 void EMILE::loadSampleInternal() {
 	APP->engine->yieldWorkers();
 	
-  lock();
-  image.clear();
-	unsigned error = lodepng::decode(image, width, height, lastPath, LCT_RGBA, 16);
+  EMILEImage *decoded = new EMILEImage;
+	unsigned error = lodepng::decode(decoded->pixels, decoded->width, decoded->height, lastPath, LCT_RGBA, 16);
 	if(error != 0)
   {
     #ifndef METAMODULE
     std::cout << "error " << error << ": " << lodepng_error_text(error) << std::endl;
     #endif
 		lastPath = "";
+    delete decoded;
+    decoded = NULL;
 	}
   else {
+    vector<unsigned char>(decoded->pixels).swap(decoded->pixels);
     samplePos = 0;
   }
-  unlock();
-	loading = false;
 
-  vector<unsigned char>(image).swap(image);
+  if (!image.publish(decoded)) delete decoded;
+  image.collect();
+	loading = false;
 }
 
-void EMILE::loadSample(std::string path) {
+void EMILE::loadSample(std::string path, int priority) {
 	loading = true;
 	lastPath = path;
+	loader::Job job;
+	job.owner = this;
+	job.path = path;
+	job.priority = priority;
+	job.load = [this]() {
+		this->loadSampleInternal();
+	};
 #if defined(METAMODULE)
-	loadSampleAsync.run_once();
-#else
-	loadSampleInternal();
+	job.wake = [this]() {
+		loadSampleAsync.run_once();
+	};
 #endif
+	loader::submit(job);
 }
 
 void EMILE::process(const ProcessArgs &args) {
@@ -235,7 +243,11 @@ void EMILE::process(const ProcessArgs &args) {
 
 
 
-	if (!loading && (lastPath != "")) {
+  EMILEImage *img = image.acquire(handoff::AUDIO_READER);
+	if (!loading && (lastPath != "") && img) {
+    const std::vector<unsigned char> &pixels = img->pixels;
+    const unsigned width = img->width;
+    const unsigned height = img->height;
     samplePos = clamp(params[POS_PARAM].getValue()+rescale(clamp(inputs[POS_INPUT].getVoltage(),0.0f,10.0f),0.0f,10.0f,0.0f,1.0f),0.0f,1.0f)*(height-1);
 
     if (rIdx == STS) {
@@ -246,10 +258,10 @@ void EMILE::process(const ProcessArgs &args) {
 
       float iWidth = 1.0f/width;
       for(unsigned x = 0; x < width; x++) {
-        unsigned short red = 256 * image[samplePos * 8 * width + x * 8 + 0] + image[samplePos * 8 * width + x * 8 + 1];
-        unsigned short green = 256 * image[samplePos * 8 * width + x * 8 + 2] + image[samplePos * 8 * width + x * 8 + 3];
-        unsigned short blue = 256 * image[samplePos * 8 * width + x * 8 + 4] + image[samplePos * 8 * width + x * 8 + 5];
-        unsigned short alpha = 256 * image[samplePos * 8 * width + x * 8 + 6] + image[samplePos * 8 * width + x * 8 + 7];
+        unsigned short red = 256 * pixels[samplePos * 8 * width + x * 8 + 0] + pixels[samplePos * 8 * width + x * 8 + 1];
+        unsigned short green = 256 * pixels[samplePos * 8 * width + x * 8 + 2] + pixels[samplePos * 8 * width + x * 8 + 3];
+        unsigned short blue = 256 * pixels[samplePos * 8 * width + x * 8 + 4] + pixels[samplePos * 8 * width + x * 8 + 5];
+        unsigned short alpha = 256 * pixels[samplePos * 8 * width + x * 8 + 6] + pixels[samplePos * 8 * width + x * 8 + 7];
         float mix = 1e-7f*((r?red:0)+(g?green:0)+(b?blue:0)+(a?alpha:0))/max(1,r+g+b+a);
         float index = (params[TUNE_PARAM].getValue()+inputs[TUNE_INPUT].getVoltage()+5.0f)*(1.0f-pow(1.0f-x*iWidth,curve))*FS2+3;
         magn[(size_t)index] += mix*(1-index+(size_t)index);
@@ -262,7 +274,7 @@ void EMILE::process(const ProcessArgs &args) {
     		fftIn[2*i] = magn[i];
     	}
 
-    	pffft_transform_ordered(pffftSetup, fftIn, fftOut, NULL, PFFFT_BACKWARD);
+    	pffft_transform_ordered(pffftSetup, fftIn, fftOut, fftWork, PFFFT_BACKWARD);
 
 
     	for (size_t i = 0; i < FS; i++) {
@@ -288,7 +300,7 @@ struct EMILEDisplay : OpaqueWidget {
 	const float width = 125.0f;
 	const float height = 130.0f;
 	std::string path = "";
-	int img = 0;
+	int nvgImg = 0;
 
 	EMILEDisplay() {
 
@@ -296,17 +308,20 @@ struct EMILEDisplay : OpaqueWidget {
 
   void drawLayer(const DrawArgs& args, int layer) override {
   	if (layer == 1) {
+      EMILEImage *img = module ? module->image.acquire(handoff::UI_READER) : NULL;
       if (module && !module->loading) {
+        unsigned imgWidth = img ? img->width : 0;
+        unsigned imgHeight = img ? img->height : 0;
         if (path != module->lastPath) {
-          img = nvgCreateImage(args.vg, module->lastPath.c_str(), 0);
+          nvgImg = nvgCreateImage(args.vg, module->lastPath.c_str(), 0);
           path = module->lastPath;
         }
         nvgSave(args.vg);
         nvgBeginPath(args.vg);
-        if (module->width>0 && module->height>0)
-          nvgScale(args.vg, width/module->width, height/module->height);
-        NVGpaint imgPaint = nvgImagePattern(args.vg, 0, 0, module->width,module->height, 0, img, 1.0f);
-        nvgRect(args.vg, 0, 0, module->width, module->height);
+        if (imgWidth>0 && imgHeight>0)
+          nvgScale(args.vg, width/imgWidth, height/imgHeight);
+        NVGpaint imgPaint = nvgImagePattern(args.vg, 0, 0, imgWidth, imgHeight, 0, nvgImg, 1.0f);
+        nvgRect(args.vg, 0, 0, imgWidth, imgHeight);
         nvgFillPaint(args.vg, imgPaint);
         nvgFill(args.vg);
         nvgClosePath(args.vg);
@@ -314,9 +329,9 @@ struct EMILEDisplay : OpaqueWidget {
         nvgStrokeColor(args.vg, LIGHTBLUE_BIDOO);
         nvgBeginPath(args.vg);
         nvgStrokeWidth(args.vg, 5);
-          if (module->image.size()>0) {
+          if (img && (img->pixels.size()>0)) {
             nvgMoveTo(args.vg, 0, (float)module->samplePos);
-            nvgLineTo(args.vg, (float)module->width, (float)module->samplePos);
+            nvgLineTo(args.vg, (float)imgWidth, (float)module->samplePos);
           }
           else {
             nvgMoveTo(args.vg, 0, 0);
@@ -325,6 +340,10 @@ struct EMILEDisplay : OpaqueWidget {
         nvgClosePath(args.vg);
         nvgStroke(args.vg);
         nvgRestore(args.vg);
+      }
+      if (module) {
+        module->image.release(handoff::UI_READER);
+        module->image.collect();
       }
   	}
   	Widget::drawLayer(args, layer);
@@ -423,6 +442,7 @@ struct EMILEWidget : BidooWidget {
 		assert(module);
     menu->addChild(new MenuSeparator());
 		menu->addChild(construct<EMILEItem>(&MenuItem::text, "Load image (png)", &EMILEItem::module, module));
+		menu->addChild(createMenuLabel(loader::describe()));
 	}
 };
 
@@ -429,8 +429,6 @@ struct ENCORE : BidooModule {
 
 	bool solo = false;
 
-	float powTable[100][10000] = {{0.0f}};
-
   std::string labels[8] = {"Track 1","Track 2","Track 3","Track 4","Track 5","Track 6","Track 7","Track 8"};
 
 	ENCORE() {
@@ -490,12 +488,6 @@ struct ENCORE : BidooModule {
 			}
   	}
 
-		for(int i=0; i<100;i++) {
-      for(int j=0; j<10000;j++) {
-				powTable[i][j] = powf(j*0.0001f,i*0.01f);
-			}
-		}
-
 		onReset();
 	}
 
@@ -1148,23 +1140,23 @@ struct ENCORE : BidooModule {
 				if (slideMode[currentPattern][track]) {
           if (trigSlideType[currentPattern][track][tPT]) {
             float subPhase = clamp(trigGetRelativeTrackPosition(track, tPT),0.0f,32.0f)/32.0f;
-  					return voQ - (1.0f - interpolateLinear(powTable[(int)(trigSlide[currentPattern][track][tPT]*99.0f)],9999.0f*subPhase)) * (voQ - prevVO[track]);
+  					return voQ - (1.0f - slideCurve(trigSlide[currentPattern][track][tPT],subPhase)) * (voQ - prevVO[track]);
           }
           else
           {
             float subPhase = clamp(trigGetRelativeTrackPosition(track, tPT),0.0f,fullLength);
-  					return voQ - (1.0f - interpolateLinear(powTable[(int)(trigSlide[currentPattern][track][tPT]*99.0f)],9999.0f*subPhase/fullLength)) * (voQ - prevVO[track]);
+  					return voQ - (1.0f - slideCurve(trigSlide[currentPattern][track][tPT],subPhase/fullLength)) * (voQ - prevVO[track]);
           }
 				}
 				else {
           if (trigSlideType[currentPattern][track][tPT]) {
             float subPhase = clamp(trigGetRelativeTrackPosition(track, tPT)/32.0f*(1.0f/max((int)abs(voQ - prevVO[track]),1)),0.0f,1.0f);
-  					return voQ - (1.0f - interpolateLinear(powTable[(int)(trigSlide[currentPattern][track][tPT]*99.0f)],9999.0f*subPhase)) * (voQ - prevVO[track]);
+  					return voQ - (1.0f - slideCurve(trigSlide[currentPattern][track][tPT],subPhase)) * (voQ - prevVO[track]);
           }
           else
           {
             float subPhase = clamp(trigGetRelativeTrackPosition(track, tPT)*(1.0f/max((int)abs(voQ - prevVO[track]),1)),0.0f,fullLength);
-  					return voQ - (1.0f - interpolateLinear(powTable[(int)(trigSlide[currentPattern][track][tPT]*99.0f)],9999.0f*subPhase/fullLength)) * (voQ - prevVO[track]);
+  					return voQ - (1.0f - slideCurve(trigSlide[currentPattern][track][tPT],subPhase/fullLength)) * (voQ - prevVO[track]);
           }
 				}
 			}
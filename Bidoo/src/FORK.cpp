@@ -13,31 +13,42 @@ inline float fast_cos(const float x)
 #define L_TABLE (256+1) //The last entry of the table equals the first (to avoid a modulo)
 //Maximal formant width
 #define I_MAX 64
-//Table of formants
+//Table of formants, filled once per process
 float TF[L_TABLE*I_MAX];
-//Formantic function of width I (used to fill the table of formants)
-float fonc_formant(float p,const float I)
-{
-  float a=0.5f;
-  int hmax=int(10*I)>L_TABLE/2?L_TABLE/2:int(10*I);
-  float phi=0.0f;
-  for(int h=1;h<hmax;h++)
-  {
-    phi+=3.14159265359f*p;
-    float hann=0.5f+0.5f*fast_cos(h*(1.0f/hmax));
-    float gaussienne=0.85f*exp(-h*h/(I*I));
-    float jupe=0.15f;
-    float harmonique=cosf(phi);
-    a+=hann*(gaussienne+jupe)*harmonique;
-   }
-  return a;
-}
-//Initialisation of the table TF with the fonction fonc_formant.
+bool TF_ready=false;
+//Initialisation of the table TF with the formantic function of width I.
+//The harmonic weights only depend on the width, they are computed once
+//per width and the result is identical to evaluating each entry on its own.
 void init_formant(void)
-{ float coef=2.0f/(L_TABLE-1);
+{
+  if(TF_ready) return;
+  float coef=2.0f/(L_TABLE-1);
+  float w[L_TABLE/2];
   for(int I=0;I<I_MAX;I++)
+  {
+    const float fI=float(I);
+    int hmax=int(10*fI)>L_TABLE/2?L_TABLE/2:int(10*fI);
+    for(int h=1;h<hmax;h++)
+    {
+      float hann=0.5f+0.5f*fast_cos(h*(1.0f/hmax));
+      float gaussienne=0.85f*exp(-h*h/(fI*fI));
+      float jupe=0.15f;
+      w[h]=hann*(gaussienne+jupe);
+    }
     for(int P=0;P<L_TABLE;P++)
-      TF[P+I*L_TABLE]=fonc_formant(-1+P*coef,float(I));
+    {
+      float p=-1+P*coef;
+      float a=0.5f;
+      float phi=0.0f;
+      for(int h=1;h<hmax;h++)
+      {
+        phi+=3.14159265359f*p;
+        a+=w[h]*cosf(phi);
+      }
+      TF[P+I*L_TABLE]=a;
+    }
+  }
+  TF_ready=true;
 }
 //This function emulates the function fonc_formant
 // thanks to the table TF. A bilinear interpolation is
@@ -1,13 +1,19 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
 #include "dsp/digital.hpp"
-#include "dsp/ringbuffer.hpp"
+#include "dep/ringbuffer.hpp"
+#include "dep/handoff.hpp"
 #include "dep/filters/pitchshifter.h"
 
-#define BUFF_SIZE 262144
+#if defined(METAMODULE)
+#include "CoreModules/async_thread.hh"
+#endif
 
 using namespace std;
 
+// longest brake, SPEED_PARAM plus its CV
+#define MAX_BREAK_TIME 3.0f
+
 struct FREIN : BidooModule {
 	enum ParamIds {
 		TRIG_PARAM,
@@ -33,17 +39,28 @@ struct FREIN : BidooModule {
 
 	dsp::SchmittTrigger trigTrigger;
 	dsp::SchmittTrigger startTrigger;
-	dsp::DoubleRingBuffer<float, BUFF_SIZE> in_Buffer;
+	// one interleaved capture for every channel of the input, rebuilt off the
+	// audio thread when the sample rate or the channel count changes
+	handoff::Handoff<ringbuffer::FrameRing<float>> capture;
+	ringbuffer::FrameRing<float> *in_Buffer = NULL;
+	std::atomic<float> captureRate{0.0f};
+	std::atomic<int> captureChannels{1};
 	bool breakOn = false;
 	float breakSamples = 0.0f;
 	float speed = 1.0f;
 	float speedUp = 0.0f;
 	float head = 0.0f;
 
+#if defined(METAMODULE)
+	MetaModule::AsyncThread captureAsync{this, [this]() {
+		this->allocateCapture();
+	}};
+#endif
+
 	FREIN() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(TRIG_PARAM, 0.0f, 1.0f, 0.0f, "Trig");
-		configParam(SPEED_PARAM, 0.5f, 3.0f, 1.0f, "Speed");
+		configParam(SPEED_PARAM, 0.5f, MAX_BREAK_TIME, 1.0f, "Speed");
 		configParam(START_PARAM, 0.0f, 1.0f, 0.0f, "Start");
 		
 		configInput(INPUT, "Audio");
@@ -54,55 +71,106 @@ struct FREIN : BidooModule {
 		configOutput(OUTPUT, "Audio");
 	}
 
+	void onSampleRateChange(const SampleRateChangeEvent &e) override {
+		captureRate = e.sampleRate;
+		allocateCapture();
+	}
+
+	// the read head trails the input by half the brake at most, consumed frames
+	// are dropped as it goes, 1% over for the rounding of the speed ramp
+	void allocateCapture() {
+		if (captureRate <= 0.0f) return;
+		int channels = captureChannels;
+		size_t frames = (size_t)std::ceil(MAX_BREAK_TIME * 0.5f * 1.01f * captureRate) + 4;
+		ringbuffer::FrameRing<float> *buffer = new ringbuffer::FrameRing<float>(frames, channels);
+		if (!capture.publish(buffer)) delete buffer;
+		capture.collect();
+	}
+
+	bool captureOutdated() {
+		ringbuffer::FrameRing<float> *buffer = capture.acquire(handoff::UI_READER);
+		bool outdated = !buffer || ((int)buffer->channels != captureChannels);
+		capture.release(handoff::UI_READER);
+		return outdated;
+	}
+
 	void process(const ProcessArgs &args) override {
+		int channels = std::max(inputs[INPUT].getChannels(), 1);
+		ringbuffer::FrameRing<float> *buffer = capture.acquire(handoff::AUDIO_READER);
+		if (buffer != in_Buffer) {
+			// a brake in progress restarts on the new capture
+			in_Buffer = buffer;
+			head = 0.0f;
+		}
+		if (!in_Buffer || ((int)in_Buffer->channels != channels)) {
+			if (captureChannels != channels) {
+				captureChannels = channels;
+#if defined(METAMODULE)
+				captureAsync.run_once();
+#endif
+			}
+		}
+		outputs[OUTPUT].setChannels(channels);
+		if (!in_Buffer) {
+			for (int c=0; c<channels; c++) outputs[OUTPUT].setVoltage(inputs[INPUT].getVoltage(c), c);
+			return;
+		}
+		// channels the capture does not hold yet pass through until it is rebuilt
+		int captured = std::min(channels, (int)in_Buffer->channels);
+		for (int c=captured; c<channels; c++) outputs[OUTPUT].setVoltage(inputs[INPUT].getVoltage(c), c);
 
 		if (trigTrigger.process(params[TRIG_PARAM].getValue() + inputs[TRIG_INPUT].getVoltage())) {
 			breakOn = true;
-			breakSamples = args.sampleRate*clamp(params[SPEED_PARAM].getValue() + inputs[SPEED_INPUT].getVoltage(),0.5f,3.0f);
+			breakSamples = args.sampleRate*clamp(params[SPEED_PARAM].getValue() + inputs[SPEED_INPUT].getVoltage(),0.5f,MAX_BREAK_TIME);
 			speedUp = 1.0f/breakSamples;
 			speed = 1.0f;
 			head = 0.0f;
-			in_Buffer.clear();
+			in_Buffer->clear();
 		}
 
 		if (trigTrigger.process(params[START_PARAM].getValue() + inputs[START_INPUT].getVoltage())) {
-			in_Buffer.clear();
+			in_Buffer->clear();
 			breakOn = false;
 			speed = 0.0f;
 			speedUp = 0.05f;
 		}
 
-		in_Buffer.push(inputs[INPUT].getVoltage());
+		float *in = in_Buffer->push();
+		for (int c=0; c<captured; c++) in[c] = inputs[INPUT].getVoltage(c);
 
 		if (breakOn) {
 			if (speed > 0.0f) {
 				int xi = head;
 				float xf = head - xi;
-				float crossfaded = crossfade(*(in_Buffer.startData()+xi), *(in_Buffer.startData()+xi+1), xf);
-				if (speed<=0.1f) {
-					outputs[OUTPUT].setVoltage(crossfaded*10.0f*speed);
-				}
-				else {
-					outputs[OUTPUT].setVoltage(crossfaded);
+				const float *a = in_Buffer->at(xi);
+				const float *b = in_Buffer->at(xi+1);
+				float gain = (speed<=0.1f) ? 10.0f*speed : 1.0f;
+				for (int c=0; c<captured; c++) {
+					outputs[OUTPUT].setVoltage(crossfade(a[c], b[c], xf)*gain, c);
 				}
 				speed = max(speed-speedUp,0.0f);
-				head = min (head+speed,(float)in_Buffer.size());
+				head = min (head+speed,(float)in_Buffer->size());
+				// frames behind the head are not read again
+				size_t consumed = head;
+				in_Buffer->startIncr(consumed);
+				head -= consumed;
 				lights[BREAK_LIGHT].setBrightness(0.0f);
 				lights[BREAK_LIGHT+1].setBrightness(0.0f);
 				lights[BREAK_LIGHT+2].setBrightness(1.0f);
 			}
 			else
 			{
-				outputs[OUTPUT].setVoltage(0.0f);
+				for (int c=0; c<captured; c++) outputs[OUTPUT].setVoltage(0.0f, c);
 				lights[BREAK_LIGHT].setBrightness(1.0f);
 				lights[BREAK_LIGHT+1].setBrightness(0.0f);
 				lights[BREAK_LIGHT+2].setBrightness(0.0f);
-				in_Buffer.clear();
+				in_Buffer->clear();
 			}
 		}
 		else {
+			const float *out = in_Buffer->front();
 			if (speed<1.0f) {
-				outputs[OUTPUT].setVoltage(*in_Buffer.startData()*speed);
+				for (int c=0; c<captured; c++) outputs[OUTPUT].setVoltage(out[c]*speed, c);
 				lights[BREAK_LIGHT].setBrightness(0.0f);
 				lights[BREAK_LIGHT+1].setBrightness(0.0f);
 				lights[BREAK_LIGHT+2].setBrightness(1.0f);
@@ -112,9 +180,9 @@ struct FREIN : BidooModule {
 				lights[BREAK_LIGHT].setBrightness(0.0f);
 				lights[BREAK_LIGHT+1].setBrightness(1.0f);
 				lights[BREAK_LIGHT+2].setBrightness(0.0f);
-				outputs[OUTPUT].setVoltage(*in_Buffer.startData());
+				for (int c=0; c<captured; c++) outputs[OUTPUT].setVoltage(out[c], c);
 			}
-			in_Buffer.startIncr(1);
+			in_Buffer->startIncr(1);
 		}
 	}
 };
@@ -135,6 +203,12 @@ struct FREINWidget : BidooWidget {
 		addInput(createInput<PJ301MPort>(Vec(10, 283.0f), module, FREIN::INPUT));
 		addOutput(createOutput<PJ301MPort>(Vec(10, 330), module, FREIN::OUTPUT));
 	}
+
+	void step() override {
+		FREIN *module = dynamic_cast<FREIN*>(this->module);
+		if (module && module->captureOutdated()) module->allocateCapture();
+		BidooWidget::step();
+	}
 };
 
 Model *modelFREIN = createModel<FREIN, FREINWidget>("FREIN");
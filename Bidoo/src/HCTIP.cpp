@@ -26,8 +26,6 @@ struct HCTIP : BidooModule {
 		NUM_LIGHTS
 	};
 
-	dsp::DoubleRingBuffer<float, BUFF_SIZE> in_Buffer;
-	dsp::DoubleRingBuffer<float, BUFF_SIZE> out_Buffer;
 	PitchShifter *pShifter = nullptr;
 
 	HCTIP() {
@@ -39,21 +37,13 @@ struct HCTIP : BidooModule {
 		delete pShifter;
 		pShifter = new PitchShifter();
 		pShifter->init(BUFF_SIZE, 8, e.sampleRate);
+		pShifter->amortized = true;
+		pShifter->fastKernel = true;
 	}
 
 	void process(const ProcessArgs &args) override {
-		in_Buffer.push(inputs[INPUT].getVoltage() / 10.0f);
-
-		if (in_Buffer.full()) {
-			pShifter->process(clamp(params[PITCH_PARAM].getValue() + inputs[PITCH_INPUT].getVoltage(), 0.5f, 2.0f), in_Buffer.startData(), out_Buffer.endData());
-			out_Buffer.endIncr(BUFF_SIZE);
-			in_Buffer.clear();
-		}
-
-		if (out_Buffer.size() > 0) {
-			outputs[OUTPUT].setVoltage(*out_Buffer.startData() * 5.0f);
-			out_Buffer.startIncr(1);
-		}
+		float pitch = clamp(params[PITCH_PARAM].getValue() + inputs[PITCH_INPUT].getVoltage(), 0.5f, 2.0f);
+		outputs[OUTPUT].setVoltage(pShifter->processSample(pitch, inputs[INPUT].getVoltage() / 10.0f) * 5.0f);
 	}
 
 	~HCTIP() {
@@ -5,56 +5,44 @@
 #include "dsp/resampler.hpp"
 
 using namespace std;
+using simd::float_4;
 
 #define pi 3.14159265359
+#define LIMBO_TABLE_SIZE 1024
 
+template <typename T>
 struct FilterStage {
-	float mem = 0.0;
+	T mem = 0.0f;
 
-	float Filter(float sample, float freq, float smpRate, float gain, int mode) {
-		float g = std::tan(pi*freq / smpRate);
-		float G = g / (1.0 + g);
-		float out;
+	// G is g / (1 + g)
+	T Filter(T sample, T G, T gain, T invTanhGain, int mode) {
+		T out;
 		if (mode == 0) {
 			out = (sample - mem) * G + mem;
 		} else {
-			out = (std::tanh(sample*gain) / std::tanh(gain) - mem) * G + mem;
+			out = (fastTanh(sample*gain) * invTanhGain - mem) * G + mem;
 		}
 		mem = out + (sample - mem) * G;
 		return out;
 	}
 };
 
+template <typename T>
 struct LadderFilter {
-	FilterStage stage1;
-	FilterStage stage2;
-	FilterStage stage3;
-	FilterStage stage4;
-	float q;
-	float freq;
-	float smpRate;
-	int mode = 0;
-	float gain = 1.0f;
-
-	void setParams(float freq, float q, float smpRate, float gain, int mode) {
-		this->freq = freq;
-		this->q = q;
-		this->smpRate = smpRate;
-		this->mode = mode;
-		this->gain = gain;
-	}
-
-	float calcOutput(float sample) {
-		float g = std::tan(pi*freq / smpRate);
-		float G = g / (1.0f + g);
-		G = G*G*G*G;
-		float S1 = stage1.mem / (1.0f + g);
-		float S2 = stage2.mem / (1.0f + g);
-		float S3 = stage3.mem / (1.0f + g);
-		float S4 = stage4.mem / (1.0f + g);
-		float S = G*G*G*S1 + G*G*S2 + G*S3 + S4;
+	FilterStage<T> stage1;
+	FilterStage<T> stage2;
+	FilterStage<T> stage3;
+	FilterStage<T> stage4;
+
+	// g is the prewarped cutoff tan(pi*freq/smpRate), tanhGain is tanh(gain)
+	T calcOutput(T sample, T g, T q, T gain, T tanhGain, int mode) {
+		T h = 1.0f / (1.0f + g);
+		T G1 = g * h;
+		T G = G1*G1*G1*G1;
+		T S = (G*G*G*stage1.mem + G*G*stage2.mem + G*stage3.mem + stage4.mem) * h;
+		T invTanhGain = 1.0f / tanhGain;
 		return stage4.Filter(stage3.Filter(stage2.Filter(stage1.Filter((sample - q * S) / (1.0f + q * G),
-			freq, smpRate, gain, mode), freq, smpRate, gain, mode), freq, smpRate, gain, mode), freq, smpRate, gain, mode);
+			G1, gain, invTanhGain, mode), G1, gain, invTanhGain, mode), G1, gain, invTanhGain, mode), G1, gain, invTanhGain, mode);
 	}
 };
 
@@ -85,7 +73,12 @@ struct LIMBO : BidooModule {
 		NUM_LIGHTS
 	};
 
-	LadderFilter lFilter, rFilter;
+	// up to 16 channels per side, four per float_4, the control ramps are
+	// shared by the same channels of both sides
+	LadderFilter<float_4> lFilters[4], rFilters[4];
+	ControlRamp4 cutoffRamps[4], qRamps[4], mugRamps[4], gainRamps[4], tanhGainRamps[4];
+	// prewarped cutoff over the cutoff control range
+	float cutoffTable[LIMBO_TABLE_SIZE + 1] = {};
 
 	///Tooltip
 	struct tpOnOff : ParamQuantity {
@@ -106,29 +99,73 @@ struct LIMBO : BidooModule {
 		configParam(CMOD_PARAM, -1.0f, 1.0f, 0.0f, "Freq. Mod", "%", 0.f, 100.f);
 		configParam<tpOnOff>(MODE_PARAM, 0.0f, 1.0f, 0.0f, "Linear");
 
-		configInput(IN_L, "In L");
-		configInput(IN_R, "In R");
+		configInput(IN_L, "In L (poly)");
+		configInput(IN_R, "In R (poly)");
 		configInput(CUTOFF_INPUT, "Cutoff");
 		configInput(Q_INPUT, "Q");
 		configInput(MUG_INPUT, "Mug");
 
-		configOutput(OUT_L, "Out L");
-		configOutput(OUT_R, "Out R");
+		configOutput(OUT_L, "Out L (poly)");
+		configOutput(OUT_R, "Out R (poly)");
+
+		controlRateSupported = true;
+	}
+
+	void onSampleRateChange(const SampleRateChangeEvent &e) override {
+		// kept below Nyquist, tan goes negative past it
+		for (int i = 0; i <= LIMBO_TABLE_SIZE; i++) {
+			float cfreq = std::min(std::pow(2.0f, rescale((float)i / LIMBO_TABLE_SIZE, 0.0f, 1.0f, 4.5f, 14.0f)), 0.45f * e.sampleRate);
+			cutoffTable[i] = std::tan(pi*cfreq / e.sampleRate);
+		}
+	}
+
+	float_4 cutoffCoefficient(float_4 cutoff) {
+		float_4 g;
+		for (int k = 0; k < 4; k++) {
+			float x = cutoff[k] * LIMBO_TABLE_SIZE;
+			int i = std::min((int)x, LIMBO_TABLE_SIZE - 1);
+			g[k] = crossfade(cutoffTable[i], cutoffTable[i + 1], x - i);
+		}
+		return g;
 	}
 
 	void process(const ProcessArgs &args) override {
-		float cfreq = std::pow(2.0f, rescale(clamp(params[CUTOFF_PARAM].getValue() + params[CMOD_PARAM].getValue() * inputs[CUTOFF_INPUT].getVoltage() * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f));
-		float q = 3.5f * clamp(params[Q_PARAM].getValue() + inputs[Q_INPUT].getVoltage() * 0.2f, 0.0f, 1.0f);
-		float g = pow(2.0f, rescale(clamp(params[MUG_PARAM].getValue() + inputs[MUG_INPUT].getVoltage() * 0.2f, 0.0f, 1.0f), 0.0f, 1.0f, 0.0f, 3.0f));
+		int channelsL = std::max(inputs[IN_L].getChannels(), 1);
+		int channelsR = std::max(inputs[IN_R].getChannels(), 1);
+		int channels = std::max(channelsL, channelsR);
+
+		if (controlRateTick()) {
+			for (int c = 0; c < channels; c += 4) {
+				float_4 cutoff = simd::clamp(params[CUTOFF_PARAM].getValue() + params[CMOD_PARAM].getValue() * inputs[CUTOFF_INPUT].getPolyVoltageSimd<float_4>(c) * 0.2f, 0.0f, 1.0f);
+				cutoffRamps[c / 4].setTarget(cutoffCoefficient(cutoff), controlRateDivision);
+				qRamps[c / 4].setTarget(3.5f * simd::clamp(params[Q_PARAM].getValue() + inputs[Q_INPUT].getPolyVoltageSimd<float_4>(c) * 0.2f, 0.0f, 1.0f), controlRateDivision);
+				float_4 mug = simd::clamp(params[MUG_PARAM].getValue() + inputs[MUG_INPUT].getPolyVoltageSimd<float_4>(c) * 0.2f, 0.0f, 1.0f);
+				float_4 g = dsp::approxExp2_taylor5(3.0f * mug);
+				mugRamps[c / 4].setTarget(g, controlRateDivision);
+				gainRamps[c / 4].setTarget(g / 3.0f, controlRateDivision);
+				tanhGainRamps[c / 4].setTarget(fastTanh(g / 3.0f), controlRateDivision);
+			}
+		}
+
 		int mode = (int)params[MODE_PARAM].getValue();
-		lFilter.setParams(cfreq, q, args.sampleRate, g / 3, mode);
-		rFilter.setParams(cfreq, q, args.sampleRate, g / 3, mode);
-		float inL = inputs[IN_L].getVoltage() * 0.2f;
-		float inR = inputs[IN_R].getVoltage() * 0.2f;
-		inL = lFilter.calcOutput(inL)*5.0f*(mode == 0 ? g : 1);
-		inR = rFilter.calcOutput(inR)*5.0f*(mode == 0 ? g : 1);
-		outputs[OUT_L].setVoltage(inL);
-		outputs[OUT_R].setVoltage(inR);
+		outputs[OUT_L].setChannels(channelsL);
+		outputs[OUT_R].setChannels(channelsR);
+		for (int c = 0; c < channels; c += 4) {
+			float_4 g = cutoffRamps[c / 4].process();
+			float_4 q = qRamps[c / 4].process();
+			float_4 mug = mugRamps[c / 4].process();
+			float_4 gain = gainRamps[c / 4].process();
+			float_4 tanhGain = tanhGainRamps[c / 4].process();
+			float_4 makeUp = 5.0f * (mode == 0 ? mug : 1.0f);
+			if (c < channelsL) {
+				float_4 in = inputs[IN_L].getVoltageSimd<float_4>(c) * 0.2f;
+				outputs[OUT_L].setVoltageSimd(lFilters[c / 4].calcOutput(in, g, q, gain, tanhGain, mode) * makeUp, c);
+			}
+			if (c < channelsR) {
+				float_4 in = inputs[IN_R].getVoltageSimd<float_4>(c) * 0.2f;
+				outputs[OUT_R].setVoltageSimd(rFilters[c / 4].calcOutput(in, g, q, gain, tanhGain, mode) * makeUp, c);
+			}
+		}
 	}
 
 };
@@ -9,35 +9,13 @@
 #include "CoreModules/async_thread.hh"
 #endif
 #include "dep/waves.hpp"
+#include "dep/handoff.hpp"
+#include "dep/loader.hpp"
+#include "dep/filters/svf.hpp"
 #include <atomic>
 
 using namespace std;
 
-#define pi 3.14159265359
-
-struct MultiFilter {
-	float q;
-	float freq;
-	float smpRate;
-	float hp = 0.0f, bp = 0.0f, lp = 0.0f, mem1 = 0.0f, mem2 = 0.0f;
-
-	void setParams(float freq, float q, float smpRate) {
-		this->freq = freq;
-		this->q = q;
-		this->smpRate = smpRate;
-	}
-
-	void calcOutput(float sample) {
-		float g = tan(pi*freq / smpRate);
-		float R = 1.0f / (2.0f*q);
-		hp = (sample - (2.0f*R + g)*mem1 - mem2) / (1.0f + 2.0f * R * g + g * g);
-		bp = g * hp + mem1;
-		lp = g * bp + mem2;
-		mem1 = g * hp + bp;
-		mem2 = g * bp + lp;
-	}
-};
-
 struct channel {
 	float start=0.0f;
 	float len=1.0f;
@@ -48,7 +26,6 @@ struct channel {
 	int filterType=0;
 	float q=0.1f;
 	float freq=1.0f;
-	MultiFilter filter;
 	int kill=-1;
 	bool active=false;
 
@@ -118,11 +95,14 @@ struct MAGMA : BidooModule {
 	channel channels[16];
 	int currentChannel=0;
 	dsp::SchmittTrigger triggers[16];
+	svf::PolySVF filters;
 	bool loading=false;
 	int sampleChannels;
 	int sampleRate;
 	int totalSampleCount;
-	vector<dsp::Frame<1>> playBuffer;
+	handoff::Handoff<waves::MonoSample> sampleBuffer;
+	const waves::Sample<1> noSample;
+	bool compactStorage = false;
 	bool play = false;
 	std::string lastPath;
 	std::string waveFileName;
@@ -132,7 +112,7 @@ struct MAGMA : BidooModule {
 
 #if defined(METAMODULE)
 	MetaModule::AsyncThread loadSampleAsync{this, [this]() {
-		this->loadSampleInternal();
+		loader::poll(this);
 	}};
 #endif
 
@@ -152,13 +132,18 @@ struct MAGMA : BidooModule {
 		configParam(PRESET_PARAM+1, 0.0f, 1.0f, 0.0f);
 		configParam(PRESET_PARAM+2, 0.0f, 1.0f, 0.0f);
 		configParam(PRESET_PARAM+3, 0.0f, 1.0f, 0.0f);
-		playBuffer.resize(0);
+	}
+
+	~MAGMA() override {
+		loader::cancel(this);
 	}
 
 	void process(const ProcessArgs &args) override;
 
-	void loadSample();
+	void loadSample(int priority = loader::PRIORITY_USER);
 	void loadSampleInternal();
+	void resample();
+	void resampleInternal();
 
 	void lock() {
 		bool expected = false;
@@ -204,6 +189,7 @@ struct MAGMA : BidooModule {
 	json_t *dataToJson() override {
 		json_t *rootJ = BidooModule::dataToJson();
 		json_object_set_new(rootJ, "lastPath", json_string(lastPath.c_str()));
+		json_object_set_new(rootJ, "compactStorage", json_boolean(compactStorage));
 		json_object_set_new(rootJ, "currentChannel", json_integer(currentChannel));
 		for (size_t i = 0; i<16 ; i++) {
 			json_t *channelJ = json_object();
@@ -223,6 +209,10 @@ struct MAGMA : BidooModule {
 
 	void dataFromJson(json_t *rootJ) override {
 		BidooModule::dataFromJson(rootJ);
+		json_t *compactStorageJ = json_object_get(rootJ, "compactStorage");
+		if (compactStorageJ) {
+			compactStorage = json_boolean_value(compactStorageJ);
+		}
 		json_t *currentChannelJ = json_object_get(rootJ, "currentChannel");
 		if (currentChannelJ) {
 			currentChannel = json_integer_value(currentChannelJ);
@@ -232,7 +222,7 @@ struct MAGMA : BidooModule {
 			lastPath = json_string_value(lastPathJ);
 			waveFileName = rack::system::getFilename(lastPath);
 			waveExtension = rack::system::getExtension(lastPath);
-			if (!lastPath.empty()) loadSample();
+			if (!lastPath.empty()) loadSample(loader::PRIORITY_PATCH);
 			for (size_t i = 0; i<16 ; i++) {
 				json_t *channelJ = json_object_get(rootJ, ("channel" + to_string(i)).c_str());
 				if (channelJ){
@@ -279,7 +269,7 @@ struct MAGMA : BidooModule {
 	}
 
 	void onSampleRateChange() override {
-		if (!lastPath.empty()) loadSample();
+		if (!lastPath.empty()) resample();
 	}
 };
 
@@ -294,30 +284,71 @@ void MAGMA::loadSampleInternal() {
 		lastPath = "";
 		waveFileName = "";
 		waveExtension = "";
-		loading = false;
 		return;
 	}
 	
-	lock();
-	playBuffer = waves::getMonoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, sampleChannels, sampleRate, totalSampleCount);
-	unlock();
-	loading = false;
+	waves::MonoSample *sample = new waves::MonoSample(waves::getMonoSample(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, sampleChannels, sampleRate, totalSampleCount, compactStorage));
+	if (!sampleBuffer.publish(sample)) delete sample;
+	sampleBuffer.collect();
+}
 
-	vector<dsp::Frame<1>>(playBuffer).swap(playBuffer);
+void MAGMA::loadSample(int priority) {
+	loader::Job job;
+	job.owner = this;
+	job.path = lastPath;
+	job.priority = priority;
+	job.load = [this]() {
+		this->loadSampleInternal();
+	};
+#if defined(METAMODULE)
+	job.wake = [this]() {
+		loadSampleAsync.run_once();
+	};
+#endif
+	loader::submit(job);
 }
 
-void MAGMA::loadSample() {
+void MAGMA::resampleInternal() {
+	waves::MonoSample *current = sampleBuffer.acquire(handoff::LOADER_READER);
+	waves::MonoSample held = current ? *current : nullptr;
+	sampleBuffer.release(handoff::LOADER_READER);
+	waves::MonoSample resampled = waves::resampleSample(held, APP->engine->getSampleRate(), compactStorage);
+	if (!resampled) {
+		loadSampleInternal();
+		return;
+	}
+	if (resampled == held) return;
+	totalSampleCount = resampled->sampleCount;
+	waves::MonoSample *sample = new waves::MonoSample(resampled);
+	if (!sampleBuffer.publish(sample)) delete sample;
+	sampleBuffer.collect();
+}
+
+void MAGMA::resample() {
+	// a slot of its own so a file load still pending is not replaced
+	loader::Job job;
+	job.owner = this;
+	job.slot = 1;
+	job.path = lastPath;
+	job.priority = loader::PRIORITY_RELOAD;
+	job.load = [this]() {
+		this->resampleInternal();
+	};
 #if defined(METAMODULE)
-	loadSampleAsync.run_once();
-#else
-	loadSampleInternal();
+	job.wake = [this]() {
+		loadSampleAsync.run_once();
+	};
 #endif
+	loader::submit(job);
 }
 
 void MAGMA::process(const ProcessArgs &args) {
 	if (loading) {
+		loading = false;
 		loadSample();
 	}
+	waves::MonoSample *sample = sampleBuffer.acquire(handoff::AUDIO_READER);
+	const waves::Sample<1> &playBuffer = sample ? **sample : noSample;
 	if (playBuffer.size()==0) {
 		lights[SAMPLE_LIGHT].setBrightness(1.0f);
 		lights[SAMPLE_LIGHT+1].setBrightness(0.0f);
@@ -417,6 +448,7 @@ void MAGMA::process(const ProcessArgs &args) {
 	outputs[POLY_OUTPUT].setChannels(c);
 
 	for (int i=0;i<c;i++) {
+		filters.active[i] = false;
 		float start = clamp(channels[i].start + (inputs[START_INPUT].isConnected() ? rescale(inputs[START_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f);
 		float len = clamp(channels[i].len + (inputs[LEN_INPUT].isConnected() ? rescale(inputs[LEN_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f);
 		float speed = clamp(channels[i].speed + (inputs[SPEED_INPUT].isConnected() ? rescale(inputs[SPEED_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 10.0f);
@@ -424,7 +456,7 @@ void MAGMA::process(const ProcessArgs &args) {
 		int gate = inputs[GATE_INPUT].isConnected() ? rescale(inputs[SPEED_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : channels[i].gate;
 		int filterType = inputs[FILTERTYPE_INPUT].isConnected() ? rescale(inputs[FILTERTYPE_INPUT].getVoltage(i),0.0f,10.0f,0.0f,3.0f) : channels[i].filterType;
 		float q = 10.0f *clamp(channels[i].q + (inputs[Q_INPUT].isConnected() ? rescale(inputs[Q_INPUT].getVoltage(i),0.0f,10.0f,0.1f,1.0f) : 0.0f), 0.1f, 1.0f);
-		float freq = std::pow(2.0f, rescale(clamp(channels[i].freq + (inputs[FREQ_INPUT].isConnected() ? rescale(inputs[FREQ_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f));
+		float pitch = rescale(clamp(channels[i].freq + (inputs[FREQ_INPUT].isConnected() ? rescale(inputs[FREQ_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f);
 
 		if ((!channels[i].active || (gate==1.0f)) && (triggers[i].process(inputs[TRIG_INPUT].getVoltage(i)))) {
 			channels[i].active = true;
@@ -445,21 +477,12 @@ void MAGMA::process(const ProcessArgs &args) {
 		if (channels[i].active && (playBuffer.size()!=0)) {
 			int xi = channels[i].head;
 			float xf = channels[i].head - xi;
-			float crossfaded = crossfade(playBuffer[xi].samples[0], playBuffer[xi + 1].samples[0], xf);
-			channels[i].filter.setParams(freq, q, args.sampleRate);
-			channels[i].filter.calcOutput(crossfaded);
-			if (filterType == 0.0f) {
-				outputs[POLY_OUTPUT].setVoltage(5.0f * crossfaded,i);
-			}
-			else if (filterType == 1.0f) {
-				outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.lp,i);
-			}
-			else if (filterType == 2.0f) {
-				outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.bp,i);
-			}
-			else {
-				outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.hp,i);
-			}
+			float crossfaded = crossfade(playBuffer.frame(xi).samples[0], playBuffer.frame(xi + 1).samples[0], xf);
+			filters.in[i] = crossfaded;
+			filters.pitch[i] = pitch;
+			filters.q[i] = q;
+			filters.mode[i] = filterType;
+			filters.active[i] = true;
 
 			channels[i].head += speed;
 			if ((channels[i].head >= (playBuffer.size()-1)) || (channels[i].head > ((start+len)*playBuffer.size()))) {
@@ -475,6 +498,13 @@ void MAGMA::process(const ProcessArgs &args) {
 			outputs[POLY_OUTPUT].setVoltage(0.0f,i);
 		}
 	}
+
+	filters.process(args.sampleTime, c);
+	for (int i=0;i<c;i++) {
+		if (filters.active[i]) {
+			outputs[POLY_OUTPUT].setVoltage(5.0f * filters.out[i],i);
+		}
+	}
 }
 
 struct MAGMAWidget : BidooWidget {
@@ -554,6 +584,13 @@ struct MAGMAWidget : BidooWidget {
   	}
   };
 
+	// sample rate reloads retire buffers from process(), free them here
+	void step() override {
+		MAGMA *module = dynamic_cast<MAGMA*>(this->module);
+		if (module) module->sampleBuffer.collect();
+		BidooWidget::step();
+	}
+
 	void onPathDrop(const PathDropEvent& e) override {
 		Widget::onPathDrop(e);
 		MAGMA *module = dynamic_cast<MAGMA*>(this->module);
@@ -563,12 +600,24 @@ struct MAGMAWidget : BidooWidget {
 		module->unlock();
 	}
 
+	struct MAGMACompactItem : MenuItem {
+		MAGMA *module;
+		void onAction(const event::Action &e) override {
+			module->lock();
+			module->compactStorage = !module->compactStorage;
+			if (!module->lastPath.empty()) module->loading = true;
+			module->unlock();
+		}
+	};
+
   void appendContextMenu(ui::Menu *menu) override {
 		BidooWidget::appendContextMenu(menu);
 		MAGMA *module = dynamic_cast<MAGMA*>(this->module);
 		assert(module);
 		menu->addChild(new MenuSeparator());
 		menu->addChild(construct<MAGMAItem>(&MenuItem::text, "Load sample", &MAGMAItem::module, module));
+		menu->addChild(createMenuLabel(loader::describe()));
+		menu->addChild(construct<MAGMACompactItem>(&MenuItem::text, "16-bit sample storage", &MenuItem::rightText, CHECKMARK(module->compactStorage), &MAGMACompactItem::module, module));
 	}
 };
 
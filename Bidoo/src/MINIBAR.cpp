@@ -1,9 +1,11 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
-#include "dsp/ringbuffer.hpp"
+#include "dep/ringbuffer.hpp"
+#include "dep/dynamics.hpp"
 #include "dsp/digital.hpp"
 
 using namespace std;
+using simd::float_4;
 
 struct MINIBAR : BidooModule {
 	enum ParamIds {
@@ -32,18 +34,19 @@ struct MINIBAR : BidooModule {
 		NUM_LIGHTS
 	};
 
-	dsp::DoubleRingBuffer<float,16384> vu_L_Buffer;
-	dsp::DoubleRingBuffer<float,512> rms_L_Buffer;
+	ringbuffer::RingBuffer<float,16384> vu_L_Buffer;
+	ringbuffer::RingBuffer<float,512> rms_L_Buffer;
 	float runningVU_L_Sum = 1e-6f, runningRMS_L_Sum = 1e-6f, rms_L = -96.3f, vu_L = -96.3f, peakL = -96.3f;
 	float in_L_dBFS = 1e-6f;
 
-	dsp::DoubleRingBuffer<float,16384> SC_vu_L_Buffer;
-	dsp::DoubleRingBuffer<float,512> SC_rms_L_Buffer;
+	ringbuffer::RingBuffer<float,16384> SC_vu_L_Buffer;
+	ringbuffer::RingBuffer<float,512> SC_rms_L_Buffer;
 	float SC_runningVU_L_Sum = 1e-6f, SC_runningRMS_L_Sum = 1e-6f, SC_rms_L = -96.3f, SC_vu_L = -96.3f, SC_peakL = -96.3f;
 	float SC_in_L_dBFS = 1e-6f;
 
 	float dist = 0.0f, gain = 1.0f, gaindB = 1.0f, ratio = 1.0f, threshold = 1.0f, knee = 0.0f;
-	float attackTime = 0.0f, releaseTime = 0.0f, makeup = 1.0f, previousPostGain = 1.0f, mix = 1.0f, mixDisplay = 1.0f;
+	float attackTime = 0.0f, releaseTime = 0.0f, makeup = 1.0f, mix = 1.0f, mixDisplay = 1.0f;
+	dynamics::GainComputer gainComputer;
 	int indexVU = 0, indexRMS = 0, lookAheadWriteIndex=0;
 	int maxIndexVU = 0, maxIndexRMS = 0, maxLookAheadWriteIndex=0;
 	float lookAhead;
@@ -80,17 +83,17 @@ void MINIBAR::process(const ProcessArgs &args) {
 	lights[BYPASS_LIGHT].setBrightness(bypass ? 1.0f : 0.0f);
 
 	if (indexVU>=16384) {
-		runningVU_L_Sum -= *vu_L_Buffer.startData();
+		runningVU_L_Sum -= vu_L_Buffer.front();
 		vu_L_Buffer.startIncr(1);
-		SC_runningVU_L_Sum -= *SC_vu_L_Buffer.startData();
+		SC_runningVU_L_Sum -= SC_vu_L_Buffer.front();
 		SC_vu_L_Buffer.startIncr(1);
 		indexVU--;
 	}
 
 	if (indexRMS>=512) {
-		runningRMS_L_Sum -= *rms_L_Buffer.startData();
+		runningRMS_L_Sum -= rms_L_Buffer.front();
 		rms_L_Buffer.startIncr(1);
-		SC_runningRMS_L_Sum -= *SC_rms_L_Buffer.startData();
+		SC_runningRMS_L_Sum -= SC_rms_L_Buffer.front();
 		SC_rms_L_Buffer.startIncr(1);
 		indexRMS--;
 	}
@@ -100,15 +103,12 @@ void MINIBAR::process(const ProcessArgs &args) {
 
 	buffL[lookAheadWriteIndex]=inputs[IN_L_INPUT].getVoltage();
 
-	if (inputs[IN_L_INPUT].isConnected())
-		in_L_dBFS = max(20.0f*log10((abs(inputs[IN_L_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		in_L_dBFS = -96.3f;
-
-	if (inputs[SC_L_INPUT].isConnected())
-		SC_in_L_dBFS = max(20.0f*log10((abs(inputs[SC_L_INPUT].getVoltage())+1e-6f) * 0.2f), -96.3f);
-	else
-		SC_in_L_dBFS = -96.3f;
+	// the input and the side chain in the first two lanes of a float_4
+	float_4 connected = float_4(inputs[IN_L_INPUT].isConnected(), inputs[SC_L_INPUT].isConnected(), 0.0f, 0.0f) != 0.0f;
+	float_4 level = float_4(inputs[IN_L_INPUT].getVoltage(), inputs[SC_L_INPUT].getVoltage(), 0.0f, 0.0f);
+	level = simd::ifelse(connected, dynamics::levelDb(level), -96.3f);
+	in_L_dBFS = level[0];
+	SC_in_L_dBFS = level[1];
 
 	float data_L = in_L_dBFS*in_L_dBFS;
 	float SC_data_L = SC_in_L_dBFS*SC_in_L_dBFS;
@@ -149,33 +149,10 @@ void MINIBAR::process(const ProcessArgs &args) {
 	else
 		SC_peakL -= 50.0f / args.sampleRate;
 
-	float slope = 1.0f/ratio-1.0f;
 	float maxIn = inputs[SC_L_INPUT].isConnected() ? SC_in_L_dBFS : in_L_dBFS;
-	float dist = maxIn-threshold;
-	float gcurve = 0.0f;
-
-	if (dist<-1.0f*knee/2.0f)
-		gcurve = maxIn;
-	else if ((dist > -1.0f * knee * 0.5f) && (dist < knee * 0.5f)) {
-		gcurve = maxIn + slope * pow(dist + knee *0.5f, 2.0f) / (2.0f * knee);
-	} else {
-		gcurve = maxIn + slope * dist;
-	}
-
-	float preGain = gcurve - maxIn;
-	float postGain = 0.0f;
-	float cAtt = exp(-1.0f/(attackTime * args.sampleRate * 0.001f));
-	float cRel = exp(-1.0f/(releaseTime * args.sampleRate * 0.001f));
-
-	if (preGain<previousPostGain) {
-		postGain = cAtt * previousPostGain + (1.0f-cAtt) * preGain;
-	} else {
-		postGain = cRel * previousPostGain + (1.0f-cRel) * preGain;
-	}
-
-	previousPostGain = postGain;
-	gaindB = makeup + postGain;
-	gain = pow(10.0f, gaindB/20.0f);
+	gainComputer.setTimes(attackTime, releaseTime, args.sampleRate);
+	gaindB = makeup + gainComputer.process(maxIn, threshold, ratio, knee);
+	gain = dynamics::dbToGain(gaindB);
 
 	mix = params[MIX_PARAM].getValue();
 	mixDisplay = mix*100.f;
@@ -9,35 +9,12 @@
 #include "CoreModules/async_thread.hh"
 #endif
 #include "dep/waves.hpp"
-#include <mutex>
+#include "dep/handoff.hpp"
+#include "dep/loader.hpp"
+#include "dep/filters/svf.hpp"
 
 using namespace std;
 
-#define pi 3.14159265359
-
-struct MultiFilter {
-	float q;
-	float freq;
-	float smpRate;
-	float hp = 0.0f, bp = 0.0f, lp = 0.0f, mem1 = 0.0f, mem2 = 0.0f;
-
-	void setParams(float freq, float q, float smpRate) {
-		this->freq = freq;
-		this->q = q;
-		this->smpRate = smpRate;
-	}
-
-	void calcOutput(float sample) {
-		float g = tan(pi*freq / smpRate);
-		float R = 1.0f / (2.0f*q);
-		hp = (sample - (2.0f*R + g)*mem1 - mem2) / (1.0f + 2.0f * R * g + g * g);
-		bp = g * hp + mem1;
-		lp = g * bp + mem2;
-		mem1 = g * hp + bp;
-		mem2 = g * bp + lp;
-	}
-};
-
 struct channel {
 	float start=0.0f;
 	float len=1.0f;
@@ -48,14 +25,13 @@ struct channel {
 	int filterType=0;
 	float q=0.1f;
 	float freq=1.0f;
-	MultiFilter filter;
 	std::string lastPath;
 	std::string waveFileName;
 	std::string waveExtension;
 	int sampleChannels;
 	int sampleRate;
 	int totalSampleCount;
-	vector<dsp::Frame<1>> playBuffer;
+	handoff::Handoff<waves::MonoSample> playBuffer;
 	bool active=false;
 	int kill=-1;
 
@@ -123,13 +99,13 @@ struct OAI : BidooModule {
 	channel channels[16];
 	int currentChannel=0;
 	dsp::SchmittTrigger triggers[16];
-	bool loading=false;
+	svf::PolySVF filters;
 	bool play = false;
-	std::mutex mylock;
+	bool compactStorage = false;
 
 #if defined(METAMODULE)
 	MetaModule::AsyncThread loadSampleAsync{this, [this]() {
-		this->loadSampleInternal();
+		loader::poll(this);
 	}};
 #endif
 
@@ -145,16 +121,29 @@ struct OAI : BidooModule {
 		configParam(FREQ_PARAM, 0.0f, 1.0f, 1.0f);
 		configParam(CHANNEL_PARAM, 0.0f, 15.0f, 0.0f);
 		configParam(KILL_PARAM, -1.0f, 15.0f, -1.0f);
+	}
 
-		for (int i=0; i<16; i++) {
-			channels[i].playBuffer.resize(0);
-		}
+	~OAI() override {
+		loader::cancel(this);
 	}
 
 	void process(const ProcessArgs &args) override;
 
-	void loadSample();
-	void loadSampleInternal();
+	void loadSample(int channel, int priority = loader::PRIORITY_USER);
+	void loadSampleInternal(int channel);
+	void resample();
+	void resampleInternal();
+
+	void collect() {
+		for (int i=0; i<16; i++) {
+			channels[i].playBuffer.collect();
+		}
+	}
+
+	void requestSample(int channel, const std::string &path) {
+		channels[channel].lastPath = path;
+		loadSample(channel);
+	}
 	void saveSample();
 
 	void onRandomize() override {
@@ -190,6 +179,7 @@ struct OAI : BidooModule {
 	json_t *dataToJson() override {
 		json_t *rootJ = BidooModule::dataToJson();
 		json_object_set_new(rootJ, "currentChannel", json_integer(currentChannel));
+		json_object_set_new(rootJ, "compactStorage", json_boolean(compactStorage));
 		for (size_t i = 0; i<16 ; i++) {
 			json_t *channelJ = json_object();
 			json_object_set_new(channelJ, "lastPath", json_string(channels[i].lastPath.c_str()));
@@ -216,6 +206,10 @@ struct OAI : BidooModule {
 
 	void dataFromJson(json_t *rootJ) override {
 		BidooModule::dataFromJson(rootJ);
+		json_t *compactStorageJ = json_object_get(rootJ, "compactStorage");
+		if (compactStorageJ) {
+			compactStorage = json_boolean_value(compactStorageJ);
+		}
 		for (size_t i = 0; i<16 ; i++) {
 			json_t *channelJ = json_object_get(rootJ, ("channel" + to_string(i)).c_str());
 			if (channelJ){
@@ -223,7 +217,6 @@ struct OAI : BidooModule {
 				if (lastPathJ) {
 					channels[i].lastPath = json_string_value(lastPathJ);
 					currentChannel = i;
-					if (!channels[i].lastPath.empty()) loadSample();
 				}
 				json_t *waveExtensionJ= json_object_get(channelJ, "waveExtension");
 				if (waveExtensionJ)
@@ -269,6 +262,8 @@ struct OAI : BidooModule {
 					channels[i].kill = json_integer_value(killJ);
 			}
 		}
+		// queued once the channel names are read, the jobs write them
+		reloadSamples(loader::PRIORITY_PATCH);
 		json_t *currentChannelJ = json_object_get(rootJ, "currentChannel");
 		if (currentChannelJ) {
 			currentChannel = json_integer_value(currentChannelJ);
@@ -284,42 +279,83 @@ struct OAI : BidooModule {
 		params[KILL_PARAM].setValue(channels[currentChannel].kill);
 	}
 
-	void onSampleRateChange() override {
-		int tmpChannel=currentChannel;
-		for (size_t i = 0; i<16 ; i++) {
-			currentChannel = i;
-			if (!channels[i].lastPath.empty()) loadSample();
+	void reloadSamples(int priority = loader::PRIORITY_USER) {
+		for (int i = 0; i<16 ; i++) {
+			if (!channels[i].lastPath.empty()) loadSample(i, priority);
 		}
-		currentChannel=tmpChannel;
+	}
+
+	void onSampleRateChange() override {
+		resample();
 	}
 };
 
-void OAI::loadSampleInternal() {
+void OAI::loadSampleInternal(int i) {
 	APP->engine->yieldWorkers();
-	channels[currentChannel].playBuffer = waves::getMonoWav(channels[currentChannel].lastPath, APP->engine->getSampleRate(), channels[currentChannel].waveFileName, channels[currentChannel].waveExtension,
-	 channels[currentChannel].sampleChannels, channels[currentChannel].sampleRate, channels[currentChannel].totalSampleCount);
-	loading = false;
-
-	vector<dsp::Frame<1>>(channels[currentChannel].playBuffer).swap(channels[currentChannel].playBuffer);
+	waves::MonoSample *buffer = new waves::MonoSample(waves::getMonoSample(channels[i].lastPath, APP->engine->getSampleRate(), channels[i].waveFileName, channels[i].waveExtension,
+	 channels[i].sampleChannels, channels[i].sampleRate, channels[i].totalSampleCount, compactStorage));
+	if (!channels[i].playBuffer.publish(buffer)) delete buffer;
+	channels[i].playBuffer.collect();
 }
 
-void OAI::loadSample() {
+void OAI::loadSample(int channel, int priority) {
+	// one job per channel, a channel loaded again before its turn only loads
+	// the last file
+	loader::Job job;
+	job.owner = this;
+	job.slot = channel;
+	job.path = channels[channel].lastPath;
+	job.priority = priority;
+	job.load = [this, channel]() {
+		this->loadSampleInternal(channel);
+	};
 #if defined(METAMODULE)
-	loadSampleAsync.run_once();
-#else
-	loadSampleInternal();
+	job.wake = [this]() {
+		loadSampleAsync.run_once();
+	};
 #endif
+	loader::submit(job);
 }
 
-void OAI::process(const ProcessArgs &args) {
-#if !defined(METAMODULE)
-	mylock.lock();
-	if (loading) {
-		loadSample();
+void OAI::resampleInternal() {
+	for (int i=0; i<16; i++) {
+		if (channels[i].lastPath.empty()) continue;
+		waves::MonoSample *current = channels[i].playBuffer.acquire(handoff::LOADER_READER);
+		waves::MonoSample held = current ? *current : nullptr;
+		channels[i].playBuffer.release(handoff::LOADER_READER);
+		waves::MonoSample resampled = waves::resampleSample(held, APP->engine->getSampleRate(), compactStorage);
+		if (!resampled) {
+			loadSampleInternal(i);
+			continue;
+		}
+		if (resampled == held) continue;
+		channels[i].totalSampleCount = resampled->sampleCount;
+		waves::MonoSample *buffer = new waves::MonoSample(resampled);
+		if (!channels[i].playBuffer.publish(buffer)) delete buffer;
+		channels[i].playBuffer.collect();
 	}
-	mylock.unlock();
+}
+
+void OAI::resample() {
+	// after the channel slots so a file load still pending is not replaced
+	loader::Job job;
+	job.owner = this;
+	job.slot = 16;
+	job.priority = loader::PRIORITY_RELOAD;
+	job.load = [this]() {
+		this->resampleInternal();
+	};
+#if defined(METAMODULE)
+	job.wake = [this]() {
+		loadSampleAsync.run_once();
+	};
 #endif
-	if (channels[currentChannel].playBuffer.size()==0) {
+	loader::submit(job);
+}
+
+void OAI::process(const ProcessArgs &args) {
+	waves::MonoSample *current = channels[currentChannel].playBuffer.acquire(handoff::AUDIO_READER);
+	if (!current || ((*current)->size()==0)) {
 		lights[SAMPLE_LIGHT].setBrightness(1.0f);
 		lights[SAMPLE_LIGHT+1].setBrightness(0.0f);
 		lights[SAMPLE_LIGHT+2].setBrightness(0.0f);
@@ -358,7 +394,10 @@ void OAI::process(const ProcessArgs &args) {
 	outputs[POLY_OUTPUT].setChannels(c);
 
 	for (int i=0;i<c;i++) {
-		if (channels[i].playBuffer.size()>0) {
+		filters.active[i] = false;
+		waves::MonoSample *buffer = channels[i].playBuffer.acquire(handoff::AUDIO_READER);
+		if (buffer && ((*buffer)->size()>0)) {
+			const waves::Sample<1> &playBuffer = **buffer;
 			float start = clamp(channels[i].start + (inputs[START_INPUT].isConnected() ? rescale(inputs[START_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f);
 			float len = clamp(channels[i].len + (inputs[LEN_INPUT].isConnected() ? rescale(inputs[LEN_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f);
 			float speed = clamp(channels[i].speed + (inputs[SPEED_INPUT].isConnected() ? rescale(inputs[SPEED_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 10.0f);
@@ -366,11 +405,11 @@ void OAI::process(const ProcessArgs &args) {
 			int gate = inputs[GATE_INPUT].isConnected() ? rescale(inputs[GATE_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : channels[i].gate;
 			int filterType = inputs[FILTERTYPE_INPUT].isConnected() ? rescale(inputs[FILTERTYPE_INPUT].getVoltage(i),0.0f,10.0f,0.0f,3.0f) : channels[i].filterType;
 			float q = 10.0f *clamp(channels[i].q + (inputs[Q_INPUT].isConnected() ? rescale(inputs[Q_INPUT].getVoltage(i),0.0f,10.0f,0.1f,1.0f) : 0.0f), 0.1f, 1.0f);
-			float freq = std::pow(2.0f, rescale(clamp(channels[i].freq + (inputs[FREQ_INPUT].isConnected() ? rescale(inputs[FREQ_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f));
+			float pitch = rescale(clamp(channels[i].freq + (inputs[FREQ_INPUT].isConnected() ? rescale(inputs[FREQ_INPUT].getVoltage(i),0.0f,10.0f,0.0f,1.0f) : 0.0f), 0.0f, 1.0f), 0.0f, 1.0f, 4.5f, 14.0f);
 
 			if ((!channels[i].active || (gate==1.0f)) && (triggers[i].process(inputs[TRIG_INPUT].getVoltage(i)))) {
 				channels[i].active = true;
-				channels[i].head = start * channels[i].playBuffer.size();
+				channels[i].head = start * playBuffer.size();
 			}
 			else if ((gate==0.0f) && (inputs[TRIG_INPUT].getVoltage(i) == 0.0f)) {
 				channels[i].active = false;
@@ -387,26 +426,17 @@ void OAI::process(const ProcessArgs &args) {
 			if (channels[i].active) {
 				int xi = channels[i].head;
 				float xf = channels[i].head - xi;
-				float crossfaded = crossfade(channels[i].playBuffer[xi].samples[0], channels[i].playBuffer[xi + 1].samples[0], xf);
-				channels[i].filter.setParams(freq, q, args.sampleRate);
-				channels[i].filter.calcOutput(crossfaded);
-				if (filterType == 0.0f) {
-					outputs[POLY_OUTPUT].setVoltage(5.0f * crossfaded,i);
-				}
-				else if (filterType == 1.0f) {
-					outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.lp,i);
-				}
-				else if (filterType == 2.0f) {
-					outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.bp,i);
-				}
-				else {
-					outputs[POLY_OUTPUT].setVoltage(5.0f * channels[i].filter.hp,i);
-				}
+				float crossfaded = crossfade(playBuffer.frame(xi).samples[0], playBuffer.frame(xi + 1).samples[0], xf);
+				filters.in[i] = crossfaded;
+				filters.pitch[i] = pitch;
+				filters.q[i] = q;
+				filters.mode[i] = filterType;
+				filters.active[i] = true;
 
 				channels[i].head += speed;
-				if ((channels[i].head >= (channels[i].playBuffer.size()-1)) || (channels[i].head > ((start+len)*channels[i].playBuffer.size()))) {
+				if ((channels[i].head >= (playBuffer.size()-1)) || (channels[i].head > ((start+len)*playBuffer.size()))) {
 					if (loop && (gate==0.0f)) {
-						channels[i].head = start*channels[i].playBuffer.size();
+						channels[i].head = start*playBuffer.size();
 					}
 					else {
 						channels[i].active=false;
@@ -418,6 +448,13 @@ void OAI::process(const ProcessArgs &args) {
 			}
 		}
 	}
+
+	filters.process(args.sampleTime, c);
+	for (int i=0;i<c;i++) {
+		if (filters.active[i]) {
+			outputs[POLY_OUTPUT].setVoltage(5.0f * filters.out[i],i);
+		}
+	}
 }
 
 struct OAIWidget : BidooWidget {
@@ -468,19 +505,13 @@ struct OAIWidget : BidooWidget {
 		#ifndef METAMODULE
 		char *path = osdialog_file(OSDIALOG_OPEN, dir.c_str(), NULL, NULL);
   		if (path) {
-				module->mylock.lock();
-				module->channels[module->currentChannel].lastPath = path;
-  			module->loading=true;
-				module->mylock.unlock();
+				module->requestSample(module->currentChannel, path);
   			free(path);
   		}
 		#else
 		async_osdialog_file(OSDIALOG_OPEN, dir.c_str(), NULL, NULL, [this](char *path) {
 			if (path) {
-				module->mylock.lock();
-				module->channels[module->currentChannel].lastPath = path;
-				module->loading=true;
-				module->mylock.unlock();
+				module->requestSample(module->currentChannel, path);
 				free(path);
 			}
 		});
@@ -488,21 +519,36 @@ struct OAIWidget : BidooWidget {
   	}
   };
 
+	// sample rate reloads retire buffers from process(), free them here
+	void step() override {
+		OAI *module = dynamic_cast<OAI*>(this->module);
+		if (module) module->collect();
+		BidooWidget::step();
+	}
+
 	void onPathDrop(const PathDropEvent& e) override {
 		Widget::onPathDrop(e);
 		OAI *module = dynamic_cast<OAI*>(this->module);
-		module->mylock.lock();
-		module->channels[module->currentChannel].lastPath = e.paths[0];
-		module->loading = true;
-		module->mylock.unlock();
+		module->requestSample(module->currentChannel, e.paths[0]);
 	}
 
+	struct OAICompactItem : MenuItem {
+		OAI *module;
+		void onAction(const event::Action &e) override {
+			module->compactStorage = !module->compactStorage;
+			module->reloadSamples();
+			module->collect();
+		}
+	};
+
   void appendContextMenu(ui::Menu *menu) override {
 		BidooWidget::appendContextMenu(menu);
 		OAI *module = dynamic_cast<OAI*>(this->module);
 		assert(module);
 		menu->addChild(new MenuSeparator());
 		menu->addChild(construct<OAIItem>(&MenuItem::text, "Load sample", &OAIItem::module, module));
+		menu->addChild(createMenuLabel(loader::describe()));
+		menu->addChild(construct<OAICompactItem>(&MenuItem::text, "16-bit sample storage", &MenuItem::rightText, CHECKMARK(module->compactStorage), &OAICompactItem::module, module));
 	}
 };
 
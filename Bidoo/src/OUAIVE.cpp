@@ -5,6 +5,8 @@
 #include <cmath>
 #include <mutex>
 #include "dep/waves.hpp"
+#include "dep/handoff.hpp"
+#include "dep/loader.hpp"
 #include <algorithm> // For std::min
 #include <atomic> // For std::atomic
 
@@ -18,6 +20,17 @@
 using namespace rack;
 using namespace std;
 
+struct OUAIVESample {
+	waves::StereoSample wav;
+	waves::Stream *stream = NULL;
+	int channels = 0;
+	int totalSampleCount = 0;
+
+	~OUAIVESample() {
+		delete stream;
+	}
+};
+
 struct OUAIVE : BidooModule {
 	enum ParamIds {
 		NB_SLICES_PARAM,
@@ -52,11 +65,13 @@ struct OUAIVE : BidooModule {
   int sampleRate;
   int totalSampleCount=0;
 	float samplePos = 0.0f;
-	vector<dsp::Frame<2>> playBuffer;
+	handoff::Handoff<OUAIVESample> playBuffer;
 	std::string lastPath;
 	std::string waveFileName;
 	std::string waveExtension;
 	bool loading = false;
+	bool streaming = false;
+	bool compactStorage = false;
 	int trigMode = 0; // 0 trig 1 gate, 2 sliced
 	int sliceIndex = -1;
 	int sliceLength = 0;
@@ -67,7 +82,6 @@ struct OUAIVE : BidooModule {
 	dsp::SchmittTrigger trigModeTrigger;
 	dsp::SchmittTrigger readModeTrigger;
 	dsp::SchmittTrigger posResetTrigger;
-	std::atomic<bool> locked{false};
 	bool first = true;
 	int eoc=0;
 	bool pulse = false;
@@ -75,8 +89,16 @@ struct OUAIVE : BidooModule {
 	
 #if defined(METAMODULE)
 	MetaModule::AsyncThread loadSampleAsync{this, [this]() {
-		this->loadSampleInternal();
+		loader::poll(this);
 	}};
+
+	// started while a stream is published, see loadSampleInternal()
+	MetaModule::AsyncThread streamAsync{this, [this]() {
+		this->fillStream();
+	}};
+#else
+	// declared last so it is joined before the buffers go away
+	waves::StreamWorker streamWorker;
 #endif
 
 	OUAIVE() {
@@ -98,24 +120,27 @@ struct OUAIVE : BidooModule {
 		configOutput(OUTL_OUTPUT, "Out L");
 		configOutput(OUTR_OUTPUT, "Out R");
 		configOutput(EOC_OUTPUT, "EOC");
+	}
 
-		playBuffer.resize(0);
+	~OUAIVE() override {
+		loader::cancel(this);
 	}
 
 	void process(const ProcessArgs &args) override;
 
-	void loadSample();
+	void loadSample(int priority = loader::PRIORITY_USER);
 	void loadSampleInternal();
-
-	void lock() {
-		bool expected = false;
-		while (!locked.compare_exchange_strong(expected, true)) {
-			expected = false;
-		}
-	}
-
-	void unlock() {
-		locked.store(false);
+	void resample();
+	void resampleInternal();
+
+	// false when no stream is published
+	bool fillStream() {
+		OUAIVESample *sample = playBuffer.acquire(handoff::WORKER_READER);
+		bool streamed = sample && sample->stream;
+		if (streamed) sample->stream->fill();
+		playBuffer.release(handoff::WORKER_READER);
+		playBuffer.collect();
+		return streamed;
 	}
 
 	json_t *dataToJson() override {
@@ -123,15 +148,25 @@ struct OUAIVE : BidooModule {
 		json_object_set_new(rootJ, "lastPath", json_string(lastPath.c_str()));
 		json_object_set_new(rootJ, "trigMode", json_integer(trigMode));
 		json_object_set_new(rootJ, "readMode", json_integer(readMode));
+		json_object_set_new(rootJ, "streaming", json_boolean(streaming));
+		json_object_set_new(rootJ, "compactStorage", json_boolean(compactStorage));
 		return rootJ;
 	}
 
 	void dataFromJson(json_t *rootJ) override {
 		BidooModule::dataFromJson(rootJ);
+		json_t *streamingJ = json_object_get(rootJ, "streaming");
+		if (streamingJ) {
+			streaming = json_boolean_value(streamingJ);
+		}
+		json_t *compactStorageJ = json_object_get(rootJ, "compactStorage");
+		if (compactStorageJ) {
+			compactStorage = json_boolean_value(compactStorageJ);
+		}
 		json_t *lastPathJ = json_object_get(rootJ, "lastPath");
 		if (lastPathJ) {
 			lastPath = json_string_value(lastPathJ);
-			if (!lastPath.empty()) loadSample();
+			if (!lastPath.empty()) loadSample(loader::PRIORITY_PATCH);
 		}
 		json_t *trigModeJ = json_object_get(rootJ, "trigMode");
 		if (trigModeJ) {
@@ -144,38 +179,127 @@ struct OUAIVE : BidooModule {
 	}
 
 	void onSampleRateChange() override {
-		if (!lastPath.empty()) loadSample();
+		if (!lastPath.empty()) resample();
 	}
 };
 
 void OUAIVE::loadSampleInternal() {
-	if (lastPath.empty()) {
-		loading = false;
-		return;
-	}
+	if (lastPath.empty()) return;
 
 	APP->engine->yieldWorkers();
-	lock();
-	playBuffer = waves::getStereoWav(lastPath, APP->engine->getSampleRate(), 
-		waveFileName, waveExtension, channels, sampleRate, totalSampleCount);
-	unlock();
-	loading = false;
+	OUAIVESample *sample = new OUAIVESample;
+	if (streaming) {
+		sample->stream = new waves::Stream;
+		if (sample->stream->open(lastPath)) {
+			waveFileName = rack::system::getFilename(lastPath);
+			waveExtension = rack::system::getExtension(waveFileName);
+			sampleRate = sample->stream->sampleRate;
+			sample->channels = sample->stream->channels;
+			sample->totalSampleCount = sample->stream->sampleCount;
+		}
+		else {
+			// AIFF files and unreadable headers are decoded in RAM
+			delete sample->stream;
+			sample->stream = NULL;
+		}
+	}
+	if (!sample->stream) {
+		sample->wav = waves::getStereoSample(lastPath, APP->engine->getSampleRate(),
+			waveFileName, waveExtension, sample->channels, sampleRate, sample->totalSampleCount, compactStorage);
+	}
 
-	vector<dsp::Frame<2>>(playBuffer).swap(playBuffer);
+	// the stream worker only runs while a stream is published
+	bool streamed = sample->stream != NULL;
+	if (!playBuffer.publish(sample)) {
+		delete sample;
+	}
+	else if (streamed) {
+#if defined(METAMODULE)
+		streamAsync.start();
+#else
+		streamWorker.start([this]() {
+			return this->fillStream();
+		});
+#endif
+	}
+#if defined(METAMODULE)
+	else {
+		streamAsync.stop();
+	}
+#endif
+	playBuffer.collect();
 }
 
-void OUAIVE::loadSample() {
+void OUAIVE::loadSample(int priority) {
+	loader::Job job;
+	job.owner = this;
+	job.path = lastPath;
+	job.priority = priority;
+	job.load = [this]() {
+		this->loadSampleInternal();
+	};
 #if defined(METAMODULE)
-	loadSampleAsync.run_once();
-#else
-	loadSampleInternal();
+	job.wake = [this]() {
+		loadSampleAsync.run_once();
+	};
 #endif
+	loader::submit(job);
+}
+
+void OUAIVE::resampleInternal() {
+	OUAIVESample *current = playBuffer.acquire(handoff::LOADER_READER);
+	// streams play at the file rate whatever the engine rate
+	bool streamed = current && current->stream;
+	waves::StereoSample wav = current ? current->wav : nullptr;
+	int channels = current ? current->channels : 0;
+	playBuffer.release(handoff::LOADER_READER);
+	if (streamed) return;
+
+	waves::StereoSample resampled = waves::resampleSample(wav, APP->engine->getSampleRate(), compactStorage);
+	if (!resampled) {
+		loadSampleInternal();
+		return;
+	}
+	if (resampled == wav) return;
+	OUAIVESample *sample = new OUAIVESample;
+	sample->wav = resampled;
+	sample->channels = channels;
+	sample->totalSampleCount = resampled->sampleCount;
+	if (!playBuffer.publish(sample)) delete sample;
+	playBuffer.collect();
+}
+
+void OUAIVE::resample() {
+	// a slot of its own so a file load still pending is not replaced
+	loader::Job job;
+	job.owner = this;
+	job.slot = 1;
+	job.path = lastPath;
+	job.priority = loader::PRIORITY_RELOAD;
+	job.load = [this]() {
+		this->resampleInternal();
+	};
+#if defined(METAMODULE)
+	job.wake = [this]() {
+		loadSampleAsync.run_once();
+	};
+#endif
+	loader::submit(job);
 }
 
 void OUAIVE::process(const ProcessArgs &args) {
 	if (loading) {
+		loading = false;
 		loadSample();
 	}
+
+	OUAIVESample *sample = playBuffer.acquire(handoff::AUDIO_READER);
+	waves::Stream *stream = sample ? sample->stream : NULL;
+	channels = sample ? sample->channels : 0;
+	totalSampleCount = sample ? sample->totalSampleCount : 0;
+	// streamed frames stay at the file rate
+	float rate = stream ? stream->sampleRate * args.sampleTime : 1.0f;
+
 	if (trigModeTrigger.process(roundf(params[TRIG_MODE_PARAM].getValue()))) {
 		trigMode = (((int)trigMode + 1) % 3);
 	}
@@ -219,36 +343,54 @@ void OUAIVE::process(const ProcessArgs &args) {
 		samplePos = 0.0f;
 	}
 
+	if (stream) {
+		// where the next trigger will jump to
+		if (trigMode == 2) {
+			int next = (sliceIndex + 1) % nbSlices;
+			stream->setHint((readMode != 1) ? next * sliceLength : (next + 1) * sliceLength - 1);
+		}
+		else if (trigMode == 0) {
+			stream->setHint(inputs[POS_INPUT].isConnected() ? (int)clamp(inputs[POS_INPUT].getVoltage() * (totalSampleCount-1.0f) * 0.1f, 0.0f, totalSampleCount - 1.0f) : ((readMode != 1) ? 0 : totalSampleCount - 1));
+		}
+	}
+
 	if (play && (samplePos>=0) && (samplePos < totalSampleCount)) {
 		int xi = static_cast<int>(samplePos);
 		float xf = samplePos - xi;
         
-		if (xi < playBuffer.size()) {
-			// Acquire lock only once before processing both channels
-			lock();
-			
+		dsp::Frame<2> frame0, frame1;
+		bool valid = false;
+		if (stream) {
+			// an underrun reads silent frames
+			stream->setPlayHead(xi, readMode == 1);
+			stream->read(xi, frame0);
+			stream->read(std::min(xi + 1, totalSampleCount - 1), frame1);
+			valid = true;
+		}
+		else if (xi < (int)sample->wav->size()) {
+			const waves::Sample<2> &wav = *sample->wav;
+			frame0 = wav.frame(xi);
+			frame1 = (xi + 1 < (int)wav.size()) ? wav.frame(xi + 1) : frame0;
+			valid = true;
+		}
+
+		if (valid) {
 			if (channels == 1) {
 				// Mono processing
-				float nextSample = (xi + 1 < playBuffer.size()) ? 
-					playBuffer[xi + 1].samples[0] : 
-					playBuffer[xi].samples[0];
-				float crossfaded = crossfade(playBuffer[xi].samples[0], nextSample, xf);
+				float crossfaded = crossfade(frame0.samples[0], frame1.samples[0], xf);
 				
 				// Set both outputs with the same value
 				float outputVoltage = 5.0f * crossfaded;
-				unlock();
 				outputs[OUTL_OUTPUT].setVoltage(outputVoltage);
 				outputs[OUTR_OUTPUT].setVoltage(outputVoltage);
 			}
 			else if (channels == 2) {
 				// Stereo processing
-				// Get sample data for both channels while holding the lock only once
-				float sample0L = playBuffer[xi].samples[0];
-				float sample0R = playBuffer[xi].samples[1];
+				float sample0L = frame0.samples[0];
+				float sample0R = frame0.samples[1];
 				
-				float sample1L = (xi + 1 < playBuffer.size()) ? playBuffer[xi + 1].samples[0] : sample0L;
-				float sample1R = (xi + 1 < playBuffer.size()) ? playBuffer[xi + 1].samples[1] : sample0R;
-				unlock();
+				float sample1L = frame1.samples[0];
+				float sample1R = frame1.samples[1];
 				
 				if (outputs[OUTL_OUTPUT].isConnected() && outputs[OUTR_OUTPUT].isConnected()) {
 					// Both outputs connected - process as stereo
@@ -273,9 +415,9 @@ void OUAIVE::process(const ProcessArgs &args) {
 
 		if (trigMode == 0) {
 			if (readMode != 1)
-				samplePos = samplePos + speed;
+				samplePos = samplePos + speed * rate;
 			else
-				samplePos = samplePos - speed;
+				samplePos = samplePos - speed * rate;
 			//manage eof readMode
 			if ((readMode == 0) && (samplePos >= totalSampleCount))
 					play = false;
@@ -287,9 +429,9 @@ void OUAIVE::process(const ProcessArgs &args) {
 		else if (trigMode == 2)
 		{
 			if (readMode != 1)
-				samplePos = samplePos + speed;
+				samplePos = samplePos + speed * rate;
 			else
-				samplePos = samplePos - speed;
+				samplePos = samplePos - speed * rate;
 
 			//manage eof readMode
 			if ((readMode == 0) && ((samplePos >= (sliceIndex+1) * sliceLength) || (samplePos >= totalSampleCount)))
@@ -358,23 +500,25 @@ struct OUAIVEDisplay : OpaqueWidget {
 
 	void drawLayer(const DrawArgs& args, int layer) override {
 		if (layer == 1) {
-			if (module && module->playBuffer.size() > 0) {
-				// Copy buffer outside of lock to minimize lock time
-				module->lock();
-				size_t bufferSize = std::min(size_t(module->totalSampleCount), module->playBuffer.size());
-				std::vector<float> vL(bufferSize);
-				std::vector<float> vR(bufferSize);
-				
-				// Batch copy the data while holding the lock
-				for (size_t i = 0; i < bufferSize; i++) {
-					vL[i] = module->playBuffer[i].samples[0];
-					if (module->channels > 1) {
-						vR[i] = module->playBuffer[i].samples[1];
+			OUAIVESample *sample = module ? module->playBuffer.acquire(handoff::UI_READER) : NULL;
+			if (sample && (sample->stream || (sample->wav->size() > 0))) {
+				// a streamed file is not in RAM, only the play line and slices are drawn
+				size_t bufferSize = sample->stream ? size_t(sample->totalSampleCount) : std::min(size_t(sample->totalSampleCount), sample->wav->size());
+				size_t waveSize = sample->stream ? 0 : bufferSize;
+				std::vector<float> vL(waveSize);
+				std::vector<float> vR(waveSize);
+
+				for (size_t i = 0; i < waveSize; i++) {
+					dsp::Frame<2> frame = sample->wav->frame(i);
+					vL[i] = frame.samples[0];
+					if (sample->channels > 1) {
+						vR[i] = frame.samples[1];
 					} else {
-						vR[i] = module->playBuffer[i].samples[0]; // Copy mono to both channels
+						vR[i] = frame.samples[0]; // Copy mono to both channels
 					}
 				}
-				module->unlock();
+				module->playBuffer.release(handoff::UI_READER);
+				module->playBuffer.collect();
 				
 				nvgFontSize(args.vg, 14);
 				nvgFillColor(args.vg, YELLOW_BIDOO);
@@ -460,7 +604,7 @@ struct OUAIVEDisplay : OpaqueWidget {
 					size_t inc = std::max(bufferSize/zoomWidth/4,1.f);
 					nvgScissor(args.vg, 0, b.pos.y, width, height);
 					nvgBeginPath(args.vg);
-					for (size_t i = 0; i < bufferSize; i+=inc) {
+					for (size_t i = 0; i < waveSize; i+=inc) {
 						float x, y;
 						x = (float)i/bufferSize;
 						y = (-1.f)*vL[i] / 2.0f + 0.5f;
@@ -482,7 +626,7 @@ struct OUAIVEDisplay : OpaqueWidget {
 					b = Rect(Vec(zoomLeftAnchor, height+10), Vec(zoomWidth, height));
 					nvgScissor(args.vg, 0, b.pos.y, width, height);
 					nvgBeginPath(args.vg);
-					for (size_t i = 0; i < bufferSize; i+=inc) {
+					for (size_t i = 0; i < waveSize; i+=inc) {
 						float x, y;
 						x = (float)i/bufferSize;
 						y = (-1.f)*vR[i] / 2.0f + 0.5f;
@@ -597,6 +741,22 @@ struct OUAIVEWidget : BidooWidget {
   	}
   };
 
+  struct OUAIVEStreamingItem : MenuItem {
+  	OUAIVE *module;
+  	void onAction(const event::Action &e) override {
+  		module->streaming = !module->streaming;
+  		if (!module->lastPath.empty()) module->loading = true;
+  	}
+  };
+
+  struct OUAIVECompactItem : MenuItem {
+  	OUAIVE *module;
+  	void onAction(const event::Action &e) override {
+  		module->compactStorage = !module->compactStorage;
+  		if (!module->lastPath.empty()) module->loading = true;
+  	}
+  };
+
   void appendContextMenu(ui::Menu *menu) override {
 		BidooWidget::appendContextMenu(menu);
 		OUAIVE *module = dynamic_cast<OUAIVE*>(this->module);
@@ -604,6 +764,15 @@ struct OUAIVEWidget : BidooWidget {
 
 		menu->addChild(new MenuSeparator());
 		menu->addChild(construct<OUAIVEItem>(&MenuItem::text, "Load sample", &OUAIVEItem::module, module));
+		menu->addChild(createMenuLabel(loader::describe()));
+		menu->addChild(construct<OUAIVEStreamingItem>(&MenuItem::text, "Stream from disk", &MenuItem::rightText, CHECKMARK(module->streaming), &OUAIVEStreamingItem::module, module));
+		menu->addChild(construct<OUAIVECompactItem>(&MenuItem::text, "16-bit sample storage", &MenuItem::rightText, CHECKMARK(module->compactStorage), &OUAIVECompactItem::module, module));
+
+		OUAIVESample *sample = module->playBuffer.acquire(handoff::UI_READER);
+		if (sample && sample->stream) {
+			menu->addChild(createMenuLabel("Stream underruns: " + std::to_string(sample->stream->underruns.load())));
+		}
+		module->playBuffer.release(handoff::UI_READER);
 	}
 
 	void onPathDrop(const PathDropEvent& e) override {
@@ -3,34 +3,10 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
 #include "dsp/resampler.hpp"
+#include "dep/filters/svf.hpp"
 
 using namespace std;
-
-#define pi 3.14159265359
-
-
-struct MultiFilter {
-	float q;
-	float freq;
-	float smpRate;
-	float hp = 0.0f, bp = 0.0f, lp = 0.0f, mem1 = 0.0f, mem2 = 0.0f;
-
-	void setParams(float freq, float q, float smpRate) {
-		this->freq = freq;
-		this->q = q;
-		this->smpRate = smpRate;
-	}
-
-	void calcOutput(float sample) {
-		float g = tan(pi*freq / smpRate);
-		float R = 1.0f / (2.0f*q);
-		hp = (sample - (2.0f*R + g)*mem1 - mem2) / (1.0f + 2.0f * R * g + g * g);
-		bp = g * hp + mem1;
-		lp = g * bp + mem2;
-		mem1 = g * hp + bp;
-		mem2 = g * bp + lp;
-	}
-};
+using simd::float_4;
 
 struct PERCO : BidooModule {
 	enum ParamIds {
@@ -56,7 +32,9 @@ struct PERCO : BidooModule {
 		NUM_LIGHTS
 	};
 
-	MultiFilter filter;
+	svf::PolySVF filters;
+	// prewarped cutoff, four channels per ramp
+	ControlRamp4 gRamps[4], qRamps[4];
 
 	PERCO() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -64,33 +42,51 @@ struct PERCO : BidooModule {
 		configParam(Q_PARAM, .1f, 1.f, .1f, "Q", "%", 0.f, 100.f);
 		configParam(CMOD_PARAM, -1.f, 1.f, 0.f, "Freq. Mod", "%", 0.f, 100.f);
 
-		configInput(IN, "In");
+		configInput(IN, "In (poly)");
 		configInput(CUTOFF_INPUT, "Cutoff");
 		configInput(Q_INPUT, "Q");
 
-		configOutput(OUT_LP, "Out L");
-		configOutput(OUT_BP, "Out BP");
-		configOutput(OUT_HP, "Out HP");
+		configOutput(OUT_LP, "Out LP (poly)");
+		configOutput(OUT_BP, "Out BP (poly)");
+		configOutput(OUT_HP, "Out HP (poly)");
+
+		controlRateSupported = true;
 	}
 
 	void process(const ProcessArgs &args) override {
-
-		float freqCvParam = params[CMOD_PARAM].getValue();
-		freqCvParam = dsp::quadraticBipolar(freqCvParam);
-		float freqParam = params[CUTOFF_PARAM].getValue();
-		freqParam = freqParam * 10.f - 5.f;
-
-		float pitch = freqParam + inputs[CUTOFF_INPUT].getVoltage() * freqCvParam;
-		float cutoff = dsp::FREQ_C4 * std::pow(2.f, pitch);
-		cutoff = clamp(cutoff, 1.f, 8000.f);
-
-		float q = 10.0f * clamp(params[Q_PARAM].getValue() + inputs[Q_INPUT].getVoltage() * 0.2f, 0.1f, 1.0f);
-		filter.setParams(cutoff, q, args.sampleRate);
-		float in = inputs[IN].getVoltage() * 0.2f;
-		filter.calcOutput(in);
-		outputs[OUT_LP].setVoltage(filter.lp * 5.0f);
-		outputs[OUT_HP].setVoltage(filter.hp * 5.0f);
-		outputs[OUT_BP].setVoltage(filter.bp * 5.0f);
+		int channels = std::max(inputs[IN].getChannels(), 1);
+
+		if (controlRateTick()) {
+			float freqCvParam = params[CMOD_PARAM].getValue();
+			freqCvParam = dsp::quadraticBipolar(freqCvParam);
+			float freqParam = params[CUTOFF_PARAM].getValue();
+			freqParam = freqParam * 10.f - 5.f;
+
+			for (int c = 0; c < channels; c += 4) {
+				// C4 * 2^pitch kept within 1 Hz and 8 kHz
+				float_4 pitch = freqParam + inputs[CUTOFF_INPUT].getPolyVoltageSimd<float_4>(c) * freqCvParam;
+				pitch = simd::clamp(pitch + std::log2(dsp::FREQ_C4), 0.f, std::log2(8000.f));
+				gRamps[c / 4].setTarget(svf::prewarp(pitch, args.sampleTime), controlRateDivision);
+				qRamps[c / 4].setTarget(10.0f * simd::clamp(params[Q_PARAM].getValue() + inputs[Q_INPUT].getPolyVoltageSimd<float_4>(c) * 0.2f, 0.1f, 1.0f), controlRateDivision);
+			}
+		}
+
+		for (int c = 0; c < channels; c += 4) {
+			filters.g[c / 4] = gRamps[c / 4].process();
+			qRamps[c / 4].process().store(&filters.q[c]);
+			float_4 in = inputs[IN].getVoltageSimd<float_4>(c) * 0.2f;
+			in.store(&filters.in[c]);
+		}
+		filters.processG(channels);
+
+		outputs[OUT_LP].setChannels(channels);
+		outputs[OUT_HP].setChannels(channels);
+		outputs[OUT_BP].setChannels(channels);
+		for (int c = 0; c < channels; c += 4) {
+			outputs[OUT_LP].setVoltageSimd(filters.filters[c / 4].lp * 5.0f, c);
+			outputs[OUT_HP].setVoltageSimd(filters.filters[c / 4].hp * 5.0f, c);
+			outputs[OUT_BP].setVoltageSimd(filters.filters[c / 4].bp * 5.0f, c);
+		}
 	}
 
 };
@@ -9,6 +9,8 @@
 #include "CoreModules/async_thread.hh"
 #endif
 #include "dep/waves.hpp"
+#include "dep/handoff.hpp"
+#include "dep/loader.hpp"
 #include <atomic>
 
 using namespace std;
@@ -60,7 +62,9 @@ struct POUPRE : BidooModule {
 	int sampleChannels;
 	int sampleRate;
 	int totalSampleCount;
-	vector<dsp::Frame<1>> playBuffer;
+	handoff::Handoff<waves::MonoSample> sampleBuffer;
+	const waves::Sample<1> noSample;
+	bool compactStorage = false;
 	bool play = false;
 	std::string lastPath;
 	std::string waveFileName;
@@ -70,7 +74,7 @@ struct POUPRE : BidooModule {
 
 #if defined(METAMODULE)
 	MetaModule::AsyncThread loadSampleAsync{this, [this]() {
-		this->loadSampleInternal();
+		loader::poll(this);
 	}};
 #endif
 
@@ -86,14 +90,18 @@ struct POUPRE : BidooModule {
 		configParam(PRESET_PARAM+1, 0.0f, 1.0f, 0.0f);
 		configParam(PRESET_PARAM+2, 0.0f, 1.0f, 0.0f);
 		configParam(PRESET_PARAM+3, 0.0f, 1.0f, 0.0f);
+	}
 
-		playBuffer.resize(0);
+	~POUPRE() override {
+		loader::cancel(this);
 	}
 
 	void process(const ProcessArgs &args) override;
 
-	void loadSample();
+	void loadSample(int priority = loader::PRIORITY_USER);
 	void loadSampleInternal();
+	void resample();
+	void resampleInternal();
 
 	void lock() {
 		bool expected = false;
@@ -109,6 +117,7 @@ struct POUPRE : BidooModule {
 	json_t *dataToJson() override {
 		json_t *rootJ = BidooModule::dataToJson();
 		json_object_set_new(rootJ, "lastPath", json_string(lastPath.c_str()));
+		json_object_set_new(rootJ, "compactStorage", json_boolean(compactStorage));
 		json_object_set_new(rootJ, "currentChannel", json_integer(currentChannel));
 		for (size_t i = 0; i<16 ; i++) {
 			json_t *channelJ = json_object();
@@ -124,6 +133,10 @@ struct POUPRE : BidooModule {
 
 	void dataFromJson(json_t *rootJ) override {
 		BidooModule::dataFromJson(rootJ);
+		json_t *compactStorageJ = json_object_get(rootJ, "compactStorage");
+		if (compactStorageJ) {
+			compactStorage = json_boolean_value(compactStorageJ);
+		}
 		json_t *lastPathJ = json_object_get(rootJ, "lastPath");
 		json_t *currentChannelJ = json_object_get(rootJ, "currentChannel");
 		if (currentChannelJ) {
@@ -133,7 +146,7 @@ struct POUPRE : BidooModule {
 			lastPath = json_string_value(lastPathJ);
 			waveFileName = rack::system::getFilename(lastPath);
 			waveExtension = rack::system::getExtension(lastPath);
-			if (!lastPath.empty()) loadSample();
+			if (!lastPath.empty()) loadSample(loader::PRIORITY_PATCH);
 			for (size_t i = 0; i<16 ; i++) {
 				json_t *channelJ = json_object_get(rootJ, ("channel" + to_string(i)).c_str());
 				if (channelJ){
@@ -163,7 +176,7 @@ struct POUPRE : BidooModule {
 	}
 
 	void onSampleRateChange() override {
-		if (!lastPath.empty()) loadSample();
+		if (!lastPath.empty()) resample();
 	}
 };
 
@@ -178,30 +191,71 @@ void POUPRE::loadSampleInternal() {
 		lastPath = "";
 		waveFileName = "";
 		waveExtension = "";
-		loading = false;
 		return;
 	}
 	
-	lock();
-	playBuffer = waves::getMonoWav(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, sampleChannels, sampleRate, totalSampleCount);
-	unlock();
-	loading = false;
+	waves::MonoSample *sample = new waves::MonoSample(waves::getMonoSample(lastPath, APP->engine->getSampleRate(), waveFileName, waveExtension, sampleChannels, sampleRate, totalSampleCount, compactStorage));
+	if (!sampleBuffer.publish(sample)) delete sample;
+	sampleBuffer.collect();
+}
+
+void POUPRE::loadSample(int priority) {
+	loader::Job job;
+	job.owner = this;
+	job.path = lastPath;
+	job.priority = priority;
+	job.load = [this]() {
+		this->loadSampleInternal();
+	};
+#if defined(METAMODULE)
+	job.wake = [this]() {
+		loadSampleAsync.run_once();
+	};
+#endif
+	loader::submit(job);
+}
 
-	vector<dsp::Frame<1>>(playBuffer).swap(playBuffer);
+void POUPRE::resampleInternal() {
+	waves::MonoSample *current = sampleBuffer.acquire(handoff::LOADER_READER);
+	waves::MonoSample held = current ? *current : nullptr;
+	sampleBuffer.release(handoff::LOADER_READER);
+	waves::MonoSample resampled = waves::resampleSample(held, APP->engine->getSampleRate(), compactStorage);
+	if (!resampled) {
+		loadSampleInternal();
+		return;
+	}
+	if (resampled == held) return;
+	totalSampleCount = resampled->sampleCount;
+	waves::MonoSample *sample = new waves::MonoSample(resampled);
+	if (!sampleBuffer.publish(sample)) delete sample;
+	sampleBuffer.collect();
 }
 
-void POUPRE::loadSample() {
+void POUPRE::resample() {
+	// a slot of its own so a file load still pending is not replaced
+	loader::Job job;
+	job.owner = this;
+	job.slot = 1;
+	job.path = lastPath;
+	job.priority = loader::PRIORITY_RELOAD;
+	job.load = [this]() {
+		this->resampleInternal();
+	};
 #if defined(METAMODULE)
-	loadSampleAsync.run_once();
-#else
-	loadSampleInternal();
+	job.wake = [this]() {
+		loadSampleAsync.run_once();
+	};
 #endif
+	loader::submit(job);
 }
 
 void POUPRE::process(const ProcessArgs &args) {
 	if (loading) {
+		loading = false;
 		loadSample();
 	}
+	waves::MonoSample *sample = sampleBuffer.acquire(handoff::AUDIO_READER);
+	const waves::Sample<1> &playBuffer = sample ? **sample : noSample;
 	if (playBuffer.size()==0) {
 		lights[SAMPLE_LIGHT].setBrightness(1.0f);
 		lights[SAMPLE_LIGHT+1].setBrightness(0.0f);
@@ -305,7 +359,7 @@ void POUPRE::process(const ProcessArgs &args) {
 		if (active[i] && (playBuffer.size()!=0)) {
 			int xi = channels[i].head;
 			float xf = channels[i].head - xi;
-			outputs[POLY_OUTPUT].setVoltage(5.0f * crossfade(playBuffer[xi].samples[0], playBuffer[xi + 1].samples[0], xf),i);
+			outputs[POLY_OUTPUT].setVoltage(5.0f * crossfade(playBuffer.frame(xi).samples[0], playBuffer.frame(xi + 1).samples[0], xf),i);
 			channels[i].head += speed;
 			if ((channels[i].head >= (playBuffer.size()-1)) || (channels[i].head > ((start+len)*playBuffer.size()))) {
 				if (loop && (gate==0.0f)) {
@@ -383,6 +437,13 @@ struct POUPREWidget : BidooWidget {
   	}
   };
 
+	// sample rate reloads retire buffers from process(), free them here
+	void step() override {
+		POUPRE *module = dynamic_cast<POUPRE*>(this->module);
+		if (module) module->sampleBuffer.collect();
+		BidooWidget::step();
+	}
+
 	void onPathDrop(const PathDropEvent& e) override {
 		Widget::onPathDrop(e);
 		POUPRE *module = dynamic_cast<POUPRE*>(this->module);
@@ -392,12 +453,24 @@ struct POUPREWidget : BidooWidget {
 		module->unlock();
 	}
 
+	struct POUPRECompactItem : MenuItem {
+		POUPRE *module;
+		void onAction(const event::Action &e) override {
+			module->lock();
+			module->compactStorage = !module->compactStorage;
+			if (!module->lastPath.empty()) module->loading = true;
+			module->unlock();
+		}
+	};
+
   void appendContextMenu(ui::Menu *menu) override {
 		BidooWidget::appendContextMenu(menu);
 		POUPRE *module = dynamic_cast<POUPRE*>(this->module);
 		assert(module);
 		menu->addChild(new MenuSeparator());
 		menu->addChild(construct<POUPREItem>(&MenuItem::text, "Load sample", &POUPREItem::module, module));
+		menu->addChild(createMenuLabel(loader::describe()));
+		menu->addChild(construct<POUPRECompactItem>(&MenuItem::text, "16-bit sample storage", &MenuItem::rightText, CHECKMARK(module->compactStorage), &POUPRECompactItem::module, module));
 	}
 };
 
@@ -1,6 +1,6 @@
 #include "plugin.hpp"
 #include "BidooComponents.hpp"
-#include "dsp/ringbuffer.hpp"
+#include "dep/ringbuffer.hpp"
 #include "dep/freeverb/revmodel.hpp"
 #include "dep/filters/pitchshifter.h"
 #include "dsp/digital.hpp"
@@ -8,6 +8,7 @@
 #define REIBUFF_SIZE 512
 
 using namespace std;
+using simd::float_4;
 
 struct REI : BidooModule {
 	enum ParamIds {
@@ -45,8 +46,7 @@ struct REI : BidooModule {
 		NUM_LIGHTS
 	};
 
-	dsp::DoubleRingBuffer<float, REIBUFF_SIZE> in_Buffer;
-	dsp::DoubleRingBuffer<float, 2 * REIBUFF_SIZE> pin_Buffer;
+	ringbuffer::RingBuffer<float, 2 * REIBUFF_SIZE> pin_Buffer;
 	revmodel revprocessor;
 	dsp::SchmittTrigger freezeTrigger;
 	bool freeze = false;
@@ -88,6 +88,9 @@ struct REI : BidooModule {
 		delete pShifter;
 		pShifter = new PitchShifter();
 		pShifter->init(REIBUFF_SIZE, 4, e.sampleRate);
+		pShifter->amortized = true;
+		pShifter->fastKernel = true;
+		revprocessor.setsamplerate(e.sampleRate);
 	}
 
 	void process(const ProcessArgs &args) override {
@@ -112,7 +115,7 @@ struct REI : BidooModule {
 		float fact = clamp(params[SHIMM_PARAM].getValue() + rescale(inputs[SHIMM_INPUT].getVoltage(), 0.0f, 10.0f, 0.0f, 1.0f), 0.0f, 1.0f)*3.0f;
 
 		if (pin_Buffer.size() > REIBUFF_SIZE) {
-			revprocessor.process(inL, inR, fact*(*pin_Buffer.startData()), outL, outR, wOutL, wOutR);
+			revprocessor.process(inL, inR, fact*pin_Buffer.front(), outL, outR, wOutL, wOutR);
 			pin_Buffer.startIncr(1);
 		} else {
 			revprocessor.process(inL, inR, 0.0f, outL, outR, wOutL, wOutR);
@@ -122,17 +125,15 @@ struct REI : BidooModule {
 			outL = clamp(outL, -7.0f, 7.0f);
 			outR = clamp(outR, -7.0f, 7.0f);
 		} else {
-			outL = tanh(outL / 5.0f)*7.0f;
-			outR = tanh(outR / 5.0f)*7.0f;
+			// both channels in one exp, tanh(x) = 1 - 2/(exp(2x) + 1)
+			float_4 x = float_4(outL, outR, 0.0f, 0.0f) * 0.4f;
+			float_4 t = 1.0f - 2.0f / (simd::exp(x) + 1.0f);
+			outL = t[0]*7.0f;
+			outR = t[1]*7.0f;
 		}
 
-		in_Buffer.push((outL + outR)*0.05f);
-
-		if (in_Buffer.full()) {
-			pShifter->process(clamp(params[SHIMMPITCH_PARAM].getValue() + inputs[SHIMMPITCH_INPUT].getVoltage(), 0.5f, 4.0f), in_Buffer.startData(), pin_Buffer.endData());
-			pin_Buffer.endIncr(in_Buffer.size());
-			in_Buffer.clear();
-		}
+		float shimmPitch = clamp(params[SHIMMPITCH_PARAM].getValue() + inputs[SHIMMPITCH_INPUT].getVoltage(), 0.5f, 4.0f);
+		pin_Buffer.push(pShifter->processSample(shimmPitch, (outL + outR)*0.05f));
 
 		outputs[OUT_L_OUTPUT].setVoltage(outL);
 		outputs[OUT_R_OUTPUT].setVoltage(outR);
@@ -113,8 +113,8 @@ struct ZINC : BidooModule {
 		NUM_LIGHTS
 	};
 
-	ZBiquad* iFilter[BANDS2];
-	ZBiquad* cFilter[BANDS2];
+	ZBiquad iFilter[BANDS2];
+	ZBiquad cFilter[BANDS2];
 	float_4 mem[BANDS4] = { 0.0f };
 	float_4 freq[BANDS4] = { {125.0f, 185.0f, 270.0f, 350.0f}, {430.0f, 530.0f, 630.0f, 780.0f},
 						  {950.0f, 1150.0f, 1380.0f, 1680.0f}, {2070.0f, 2780.0f, 3800.0f, 6400.0f} };
@@ -122,6 +122,12 @@ struct ZINC : BidooModule {
 	const float slewMin = 0.001f;
 	const float slewMax = 500.0f;
 	const float shapeScale = 0.1f;
+	float filtersQ = -1.0f;
+	float filtersSampleRate = 0.0f;
+	float envAttack = -1.0f;
+	float envDecay = -1.0f;
+	float envAttackCoeff = 0.0f;
+	float envDecayCoeff = 0.0f;
 
 	ZINC() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -139,61 +145,62 @@ struct ZINC : BidooModule {
 		configParam(Q3_PARAM, 1.f, 10.f, 5.f, "Q", "dB", 0.f, 1.f);
 		configParam(Q4_PARAM, 1.f, 10.f, 5.f, "Q", "dB", 0.f, 1.f);
 
-		for (int i = 0; i < BANDS2; i++) {
-			iFilter[i] = new ZBiquad(freq[i%4] / APP->engine->getSampleRate(), {5.0f}, {6.0f});
-			cFilter[i] = new ZBiquad(freq[i%4] / APP->engine->getSampleRate(), {5.0f}, {6.0f});
-		}
-
 		configInput(IN_MOD, "Modulator");
 		configInput(IN_CARR, "Carrier");
 		configOutput(OUT, "Out");
 	}
 
-	~ZINC() override {
+	// coefficients only depend on Q and the sample rate, all stages share the Q1 knob
+	void updateFilters(const float q, const float sampleRate) {
+		filtersQ = q;
+		filtersSampleRate = sampleRate;
 		for (int i = 0; i < BANDS2; i++) {
-			delete iFilter[i];
-			delete cFilter[i];
+			iFilter[i].setBiquad(freq[i%4] / sampleRate, {q}, {6.0f});
+			cFilter[i].setBiquad(freq[i%4] / sampleRate, {q}, {6.0f});
 		}
 	}
 
+	void updateEnvelopes(const float attack, const float decay, const float sampleRate) {
+		envAttack = attack;
+		envDecay = decay;
+		envAttackCoeff = slewMax * powf(slewMin / slewMax, attack) * shapeScale / sampleRate;
+		envDecayCoeff = slewMax * powf(slewMin / slewMax, decay) * shapeScale / sampleRate;
+	}
+
+	void onSampleRateChange(const SampleRateChangeEvent &e) override {
+		updateFilters(params[Q1_PARAM].getValue(), e.sampleRate);
+		updateEnvelopes(params[ATTACK_PARAM].getValue(), params[DECAY_PARAM].getValue(), e.sampleRate);
+	}
+
 	void process(const ProcessArgs &args) override {
-		float inM = inputs[IN_MOD].getVoltage() / 5.0f;
-		float inC = inputs[IN_CARR].getVoltage() / 5.0f;
+		float inM = inputs[IN_MOD].getVoltage() / 5.0f * params[GMOD_PARAM].getValue();
+		float inC = inputs[IN_CARR].getVoltage() / 5.0f * params[GCARR_PARAM].getValue();
 		float attack = params[ATTACK_PARAM].getValue();
 		float decay = params[DECAY_PARAM].getValue();
-		float slewAttack = slewMax * powf(slewMin / slewMax, attack);
-		float slewDecay = slewMax * powf(slewMin / slewMax, decay);
-		float_4 q1 = {params[Q1_PARAM].getValue()};
-		float_4 q2 = {params[Q1_PARAM].getValue()};
-		float_4 q3 = {params[Q1_PARAM].getValue()};
-		float_4 q4 = {params[Q1_PARAM].getValue()};
-		float out = 0.0f;
+		float q = params[Q1_PARAM].getValue();
+
+		if ((q != filtersQ) || (args.sampleRate != filtersSampleRate)) {
+			updateFilters(q, args.sampleRate);
+			updateEnvelopes(attack, decay, args.sampleRate);
+		}
+		else if ((attack != envAttack) || (decay != envDecay)) {
+			updateEnvelopes(attack, decay, args.sampleRate);
+		}
+
+		float_4 out = 0.0f;
 
 		for (int i = 0; i < BANDS4; i++) {
 			float_4 coeff = mem[i];
-			iFilter[i]->setQ(q1);
-			iFilter[i + BANDS4]->setQ(q2);
-			float_4 peak = abs(iFilter[i + BANDS4]->process(iFilter[i]->process(inM * params[GMOD_PARAM].getValue())));
-			for (int j=0; j<4; j++) {
-				if (peak[j] > coeff[j]) {
-					coeff[j] += slewAttack * shapeScale * (peak[j] - coeff[j]) / args.sampleRate;
-					if (coeff[j] > peak[j])
-						coeff[j] = peak[j];
-				} else if (peak[j] < coeff[j]) {
-					coeff[j] -= slewDecay * shapeScale * (coeff[j] - peak[j]) / args.sampleRate;
-					if (coeff[j] < peak[j])
-						coeff[j] = peak[j];
-				}
-			}
+			float_4 peak = simd::fabs(iFilter[i + BANDS4].process(iFilter[i].process(inM)));
+			float_4 up = simd::fmin(coeff + envAttackCoeff * (peak - coeff), peak);
+			float_4 down = simd::fmax(coeff - envDecayCoeff * (coeff - peak), peak);
+			coeff = simd::ifelse(peak > coeff, up, down);
 			peaks[i] = peak;
 			mem[i] = coeff;
-			cFilter[i]->setQ(q3);
-			cFilter[i + BANDS4]->setQ(q4);
 			float_4 bg = {params[BG_PARAM + i*4].getValue(), params[BG_PARAM + i*4+1].getValue(), params[BG_PARAM + i*4+2].getValue(), params[BG_PARAM + i*4+3].getValue()};
-			float_4 corr = cFilter[i + BANDS4]->process(cFilter[i]->process(inC*params[GCARR_PARAM].getValue())) * coeff * bg;
-			out += corr[0]+corr[1]+corr[2]+corr[3];
+			out += cFilter[i + BANDS4].process(cFilter[i].process(inC)) * coeff * bg;
 		}
-		outputs[OUT].setVoltage(out * 5.0f * params[G_PARAM].getValue());
+		outputs[OUT].setVoltage((out[0] + out[1] + out[2] + out[3]) * 5.0f * params[G_PARAM].getValue());
 	}
 };
 
@@ -0,0 +1,106 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "dsp/common.hpp"
+
+namespace dynamics {
+
+using rack::simd::float_4;
+using rack::simd::int32_4;
+
+// log2 of a normal x > 0, the exponent bits plus a degree 5 minimax
+// polynomial of the mantissa. Within 1.5e-5 of log2(x), 9e-5 dB, over
+// [2^-16, 2^16), all levelDb reads above its floor. Further out the rounding
+// of the result adds up to half an ulp.
+inline float_4 fastLog2(float_4 x) {
+	int32_4 i = int32_4::cast(x);
+	float_4 e = float_4((i >> 23) - 127);
+	float_4 u = float_4::cast((i & 0x007FFFFF) | 0x3F800000) - 1.0f;
+	return e + u * (1.44196547f + u * (-0.70966143f + u * (0.41759159f + u * (-0.19626464f + u * 0.04638330f))));
+}
+
+// 2^x for x in [-126, 128), the integer part in the exponent bits times a
+// degree 4 minimax polynomial of the fraction. Within 3e-6 relative, 3e-5 dB.
+inline float_4 fastExp2(float_4 x) {
+	float_4 xf = rack::simd::floor(x);
+	float_4 f = x - xf;
+	float_4 yi = float_4::cast((int32_4(xf) + 127) << 23);
+	return yi * (1.0f + f * (0.69304484f + f * (0.24128022f + f * (0.05224245f + f * 0.01342670f))));
+}
+
+inline float fastExp2(float x) {
+	float xf = std::floor(x);
+	float f = x - xf;
+	int32_t i = ((int32_t)xf + 127) << 23;
+	float yi;
+	std::memcpy(&yi, &i, sizeof(yi));
+	return yi * (1.0f + f * (0.69304484f + f * (0.24128022f + f * (0.05224245f + f * 0.01342670f))));
+}
+
+// level in dBFS of four signals, 5V being 0 dBFS, floored at -96.3 dB
+inline float_4 levelDb(float_4 v) {
+	return rack::simd::fmax(6.02059991f * fastLog2((rack::simd::fabs(v) + 1e-6f) * 0.2f), -96.3f);
+}
+
+// linear gain of a level in dB
+inline float_4 dbToGain(float_4 dB) {
+	return fastExp2(dB * 0.16609640f);
+}
+
+inline float dbToGain(float dB) {
+	return fastExp2(dB * 0.16609640f);
+}
+
+// Soft knee gain computer and one pole attack/release smoothing of the gain
+// change, in dB. The smoothing coefficients are only evaluated again when a
+// time or the sample rate moves. BAR and MINIBAR are stereo linked, a single
+// gain from the louder detector is applied to both channels, so there is one
+// gain computer per module and it stays scalar: a float_4 one would carry a
+// single live lane, and the per sample work left here is a few compares and
+// multiplies against the log2 and exp2 the detectors and dbToGain run.
+struct GainComputer {
+	float attackTime = 0.0f, releaseTime = 0.0f, sampleRate = 0.0f;
+	float cAtt = 0.0f, cRel = 0.0f;
+	float previousPostGain = 1.0f;
+
+	// times in ms
+	void setTimes(float attack, float release, float rate) {
+		if ((attack != attackTime) || (rate != sampleRate)) {
+			cAtt = std::exp(-1.0f/(attack * rate * 0.001f));
+		}
+		if ((release != releaseTime) || (rate != sampleRate)) {
+			cRel = std::exp(-1.0f/(release * rate * 0.001f));
+		}
+		attackTime = attack;
+		releaseTime = release;
+		sampleRate = rate;
+	}
+
+	// gain change in dB for a detector level of maxIn dB, makeup excluded
+	float process(float maxIn, float threshold, float ratio, float knee) {
+		float slope = 1.0f/ratio-1.0f;
+		float dist = maxIn-threshold;
+		float preGain = 0.0f;
+
+		if (dist<-1.0f*knee/2.0f)
+			preGain = 0.0f;
+		else if ((dist > -1.0f * knee * 0.5f) && (dist < knee * 0.5f)) {
+			float d = dist + knee * 0.5f;
+			preGain = slope * d * d / (2.0f * knee);
+		} else {
+			preGain = slope * dist;
+		}
+
+		float postGain = 0.0f;
+		if (preGain<previousPostGain) {
+			postGain = cAtt * previousPostGain + (1.0f-cAtt) * preGain;
+		} else {
+			postGain = cRel * previousPostGain + (1.0f-cRel) * preGain;
+		}
+		previousPostGain = postGain;
+		return postGain;
+	}
+};
+
+}
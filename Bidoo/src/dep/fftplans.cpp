@@ -0,0 +1,69 @@
+#include "fftplans.hpp"
+#include <string.h>
+#include <vector>
+#include <mutex>
+
+namespace fftplans {
+
+  struct Plan {
+    PFFFT_Setup *setup;
+    int size;
+    pffft_transform_t type;
+  };
+
+  struct Pool {
+    int size;
+    std::vector<float*> buffers;
+  };
+
+  static std::mutex plansLock;
+  static std::vector<Plan> plans;
+  static std::vector<Pool> pools;
+
+  PFFFT_Setup *acquire(int size, pffft_transform_t type) {
+    std::lock_guard<std::mutex> guard(plansLock);
+    for (Plan &plan : plans) {
+      if ((plan.size == size) && (plan.type == type)) {
+        return plan.setup;
+      }
+    }
+    PFFFT_Setup *setup = pffft_new_setup(size, type);
+    if (setup != NULL) {
+      plans.push_back({setup, size, type});
+    }
+    return setup;
+  }
+
+  float *acquireBuffer(int size) {
+    float *buffer = NULL;
+    {
+      std::lock_guard<std::mutex> guard(plansLock);
+      for (Pool &pool : pools) {
+        if ((pool.size == size) && !pool.buffers.empty()) {
+          buffer = pool.buffers.back();
+          pool.buffers.pop_back();
+          break;
+        }
+      }
+    }
+    if (buffer == NULL) {
+      buffer = (float*)pffft_aligned_malloc(size*sizeof(float));
+      if (buffer == NULL) return NULL;
+    }
+    memset(buffer, 0, size*sizeof(float));
+    return buffer;
+  }
+
+  void releaseBuffer(float *buffer, int size) {
+    if (buffer == NULL) return;
+    std::lock_guard<std::mutex> guard(plansLock);
+    for (Pool &pool : pools) {
+      if (pool.size == size) {
+        pool.buffers.push_back(buffer);
+        return;
+      }
+    }
+    pools.push_back({size, {buffer}});
+  }
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "pffft/pffft.h"
+
+namespace fftplans {
+
+// Process-wide pffft setups keyed by size and transform type. A setup is
+// built the first time its size is asked for and owned by the cache for the
+// life of the process, so recreating a consumer (sample rate change, patch
+// reload) or a one shot transform does not rebuild the twiddles. Callers
+// never free it.
+PFFFT_Setup *acquire(int size, pffft_transform_t type);
+
+// Zeroed, SIMD aligned float buffers recycled through per size free lists,
+// NULL when the allocation fails.
+float *acquireBuffer(int size);
+
+void releaseBuffer(float *buffer, int size);
+
+}
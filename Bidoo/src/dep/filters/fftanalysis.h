@@ -2,6 +2,7 @@
 #include <math.h>
 #include <stdio.h>
 #include "../pffft/pffft.h"
+#include "../fftplans.hpp"
 #include <vector>
 #include <algorithm>
 #include <mutex>
@@ -13,6 +14,7 @@ struct FfftAnalysis {
 	float *gInFIFO;
 	float *gFFTworksp;
 	float *gFFTworkspOut;
+	float *gFFTscratch;
 	float *gAnaMagn;
 	float gSum;
 	float sampleRate;
@@ -28,24 +30,25 @@ struct FfftAnalysis {
 		this->depth = depth;
 		this->osamp = osamp;
 		this->sampleRate = sampleRate;
-		pffftSetup = pffft_new_setup(fftFrameSize, PFFFT_REAL);
+		pffftSetup = fftplans::acquire(fftFrameSize, PFFFT_REAL);
 		fftFrameSize2 = fftFrameSize/2;
 		stepSize = fftFrameSize/osamp;
 		inFifoLatency = fftFrameSize-stepSize;
 		invFftFrameSize = 1.0f/fftFrameSize;
 
 		gInFIFO = (float*)calloc(fftFrameSize,sizeof(float));
-		gFFTworksp = (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
-		gFFTworkspOut =  (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
+		gFFTworksp = fftplans::acquireBuffer(fftFrameSize);
+		gFFTworkspOut = fftplans::acquireBuffer(fftFrameSize);
+		gFFTscratch = fftplans::acquireBuffer(fftFrameSize);
 		gAnaMagn = (float*)calloc(fftFrameSize,sizeof(float));
 	}
 
 	~FfftAnalysis() {
-		pffft_destroy_setup(pffftSetup);
 		free(gInFIFO);
 		free(gAnaMagn);
-		pffft_aligned_free(gFFTworksp);
-		pffft_aligned_free(gFFTworkspOut);
+		fftplans::releaseBuffer(gFFTworksp, fftFrameSize);
+		fftplans::releaseBuffer(gFFTworkspOut, fftFrameSize);
+		fftplans::releaseBuffer(gFFTscratch, fftFrameSize);
 	}
 
 	void process(const float *input, vector<vector<float>> *result, vector<float> *sum, int min, int max) {
@@ -64,7 +67,7 @@ struct FfftAnalysis {
 						gFFTworksp[k] = gInFIFO[k] * window;
 					}
 
-					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, NULL, PFFFT_FORWARD);
+					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, gFFTscratch, PFFFT_FORWARD);
 					gSum = 0;
 
 					for (k = 0; k <= fftFrameSize2; k++) {
@@ -2,6 +2,7 @@
 #include <math.h>
 #include <stdio.h>
 #include "../pffft/pffft.h"
+#include "../fftplans.hpp"
 
 using namespace std;
 
@@ -11,6 +12,7 @@ struct FFTFilter {
 	float *gOutFIFO;
 	float *gFFTworksp;
 	float *gFFTworkspOut;
+	float *gFFTscratch;
 	float *gLastPhase;
 	float *gSumPhase;
 	float *gOutputAccum;
@@ -29,7 +31,7 @@ struct FFTFilter {
 		this->fftFrameSize = fftFrameSize;
 		this->osamp = osamp;
 		this->sampleRate = sampleRate;
-		pffftSetup = pffft_new_setup(fftFrameSize, PFFFT_REAL);
+		pffftSetup = fftplans::acquire(fftFrameSize, PFFFT_REAL);
 		fftFrameSize2 = fftFrameSize/2;
 		stepSize = fftFrameSize/osamp;
 		freqPerBin = sampleRate/(double)fftFrameSize;
@@ -42,8 +44,9 @@ struct FFTFilter {
 
 		gInFIFO = (float*)calloc(fftFrameSize,sizeof(float));
 		gOutFIFO =  (float*)calloc(fftFrameSize,sizeof(float));
-		gFFTworksp = (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
-		gFFTworkspOut =  (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
+		gFFTworksp = fftplans::acquireBuffer(fftFrameSize);
+		gFFTworkspOut = fftplans::acquireBuffer(fftFrameSize);
+		gFFTscratch = fftplans::acquireBuffer(fftFrameSize);
 		gLastPhase = (float*)calloc((fftFrameSize/2+1),sizeof(float));
 		gSumPhase = (float*)calloc((fftFrameSize/2+1),sizeof(float));
 		gOutputAccum = (float*)calloc(2*fftFrameSize,sizeof(float));
@@ -54,7 +57,6 @@ struct FFTFilter {
 	}
 
 	~FFTFilter() {
-		pffft_destroy_setup(pffftSetup);
 		free(gInFIFO);
 		free(gOutFIFO);
 		free(gLastPhase);
@@ -64,8 +66,9 @@ struct FFTFilter {
 		free(gAnaMagn);
 		free(gSynFreq);
 		free(gSynMagn);
-		pffft_aligned_free(gFFTworksp);
-		pffft_aligned_free(gFFTworkspOut);
+		fftplans::releaseBuffer(gFFTworksp, fftFrameSize);
+		fftplans::releaseBuffer(gFFTworkspOut, fftFrameSize);
+		fftplans::releaseBuffer(gFFTscratch, fftFrameSize);
 	}
 
 	void process(const float pitchShift, const float *input, float *output) {
@@ -92,7 +95,7 @@ struct FFTFilter {
 
 					/* ***************** ANALYSIS ******************* */
 					/* do transform */
-					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, NULL, PFFFT_FORWARD);
+					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, gFFTscratch, PFFFT_FORWARD);
 
 					/* this is the analysis step */
 					for (k = 0; k <= fftFrameSize2; k++) {
@@ -182,7 +185,7 @@ struct FFTFilter {
 					// for (k = fftFrameSize+2; k < 2*fftFrameSize; k++) gFFTworksp[k] = 0.0f;
 
 					/* do inverse transform */
-					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut , NULL, PFFFT_BACKWARD);
+					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut , gFFTscratch, PFFFT_BACKWARD);
 
 					/* do windowing and add to output accumulator */
 					for(k=0; k < fftFrameSize; k++) {
@@ -2,12 +2,14 @@
 #include <math.h>
 #include <stdio.h>
 #include "../pffft/pffft.h"
+#include "../fftplans.hpp"
 
 using namespace std;
 
 struct FftSynth {
 	float *gFFTworksp;
 	float *gFFTworkspOut;
+	float *gFFTscratch;
 	float *gOutputAccum;
 	float sampleRate;
 	PFFFT_Setup *pffftSetup;
@@ -20,7 +22,7 @@ struct FftSynth {
 		this->fftFrameSize = fftFrameSize;
 		this->osamp = osamp;
 		this->sampleRate = sampleRate;
-		pffftSetup = pffft_new_setup(fftFrameSize, PFFFT_REAL);
+		pffftSetup = fftplans::acquire(fftFrameSize, PFFFT_REAL);
 		fftFrameSize2 = fftFrameSize/2;
 		stepSize = fftFrameSize/osamp;
 		freqPerBin = sampleRate/(double)fftFrameSize;
@@ -31,16 +33,17 @@ struct FftSynth {
 		invPi = 1.0f/M_PI;
 		invOsamp = 1.0f/osamp;
 
-		gFFTworksp = (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
-		gFFTworkspOut =  (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
+		gFFTworksp = fftplans::acquireBuffer(fftFrameSize);
+		gFFTworkspOut = fftplans::acquireBuffer(fftFrameSize);
+		gFFTscratch = fftplans::acquireBuffer(fftFrameSize);
 		gOutputAccum = (float*)calloc(2*fftFrameSize,sizeof(float));
 	}
 
 	~FftSynth() {
-		pffft_destroy_setup(pffftSetup);
 		free(gOutputAccum);
-		pffft_aligned_free(gFFTworksp);
-		pffft_aligned_free(gFFTworkspOut);
+		fftplans::releaseBuffer(gFFTworksp, fftFrameSize);
+		fftplans::releaseBuffer(gFFTworkspOut, fftFrameSize);
+		fftplans::releaseBuffer(gFFTscratch, fftFrameSize);
 	}
 
 	void process(const float * magn, float *output) {
@@ -54,7 +57,7 @@ struct FftSynth {
 		}
 
 
-		pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut , 0, PFFFT_BACKWARD);
+		pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut , gFFTscratch, PFFFT_BACKWARD);
 
 		for(k=0; k < fftFrameSize; k++) {
 			window = -0.5f * cos(2.0f * M_PI *(double)k * invFftFrameSize) + 0.5f;
@@ -2,14 +2,29 @@
 #include <math.h>
 #include <stdio.h>
 #include "../pffft/pffft.h"
+#include "../fftplans.hpp"
+#include "dsp/common.hpp"
 
 using namespace std;
+using rack::simd::float_4;
 
 struct PitchShifter {
+	enum FrameStage {
+		FRAME_IDLE,
+		FRAME_FORWARD,
+		FRAME_ANALYSIS,
+		FRAME_SHIFT,
+		FRAME_SYNTHESIS,
+		FRAME_INVERSE
+	};
+
 	float *gInFIFO;
 	float *gOutFIFO;
+	float *gOutPending;
+	float *gFrame;
 	float *gFFTworksp;
 	float *gFFTworkspOut;
+	float *gFFTscratch;
 	float *gLastPhase;
 	float *gSumPhase;
 	float *gOutputAccum;
@@ -17,6 +32,9 @@ struct PitchShifter {
 	float *gAnaMagn;
 	float *gSynFreq;
 	float *gSynMagn;
+	float *gWindow;
+	float *gOutWindow;
+	float *gBinAdvance;
 	float sampleRate;
 	PFFFT_Setup *pffftSetup;
 	long gRover = false;
@@ -24,6 +42,19 @@ struct PitchShifter {
 	double freqPerBin, expct, invOsamp, invFftFrameSize, invFftFrameSize2, invPi;
 	long fftFrameSize, osamp, i,k, qpd, index, inFifoLatency, stepSize, fftFrameSize2;
 
+	// amortized scheduling: the frame collected at a hop boundary is processed
+	// a slice at a time during the next hop, its output is played one hop later
+	bool amortized = false;
+	int stage = FRAME_IDLE;
+	long stageBin = 0;
+	long binsPerSlice = 1;
+	float framePitch = 1.0f;
+
+	// float32 kernel with tabulated windows and polynomial atan2/sincos, the
+	// double precision path is kept as reference
+	bool fastKernel = false;
+	float anaScale, synScale;
+
 	PitchShifter() {
 
 	}
@@ -33,7 +64,7 @@ struct PitchShifter {
 		this->osamp = osamp;
 		this->sampleRate = sampleRate;
 
-		pffftSetup = pffft_new_setup(fftFrameSize, PFFFT_REAL);
+		pffftSetup = fftplans::acquire(fftFrameSize, PFFFT_REAL);
 
 		fftFrameSize2 = fftFrameSize/2;
 		stepSize = fftFrameSize/osamp;
@@ -45,10 +76,21 @@ struct PitchShifter {
 		invFftFrameSize2 = 1.0f/fftFrameSize2;
 		invPi = 1.0f/M_PI;
 
+		// forward, shift and inverse take one slice each, analysis and synthesis share the rest of the hop
+		long binSlices = max((stepSize - 4) / 2, 1L);
+		binsPerSlice = (fftFrameSize2 + binSlices - 1) / binSlices;
+		binsPerSlice = (binsPerSlice + 3) & ~3L;
+
+		anaScale = osamp * 0.5f * invPi;
+		synScale = 2.0 * M_PI * invOsamp / freqPerBin;
+
 		gInFIFO = new float[fftFrameSize] {0.f};
 		gOutFIFO =  new float[fftFrameSize] {0.f};
-		gFFTworksp = (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
-		gFFTworkspOut =  (float*)pffft_aligned_malloc(fftFrameSize*sizeof(float));
+		gOutPending = new float[stepSize] {0.f};
+		gFrame = new float[fftFrameSize] {0.f};
+		gFFTworksp = fftplans::acquireBuffer(fftFrameSize);
+		gFFTworkspOut = fftplans::acquireBuffer(fftFrameSize);
+		gFFTscratch = fftplans::acquireBuffer(fftFrameSize);
 		gLastPhase = new float[fftFrameSize2+1] {0.f};
 		gSumPhase = new float[fftFrameSize2+1] {0.f};
 		gOutputAccum = new float[2*fftFrameSize] {0.f};
@@ -56,12 +98,26 @@ struct PitchShifter {
 		gAnaMagn = new float[fftFrameSize] {0.f};
 		gSynFreq = new float[fftFrameSize] {0.f};
 		gSynMagn = new float[fftFrameSize] {0.f};
+		gWindow = new float[fftFrameSize];
+		gOutWindow = new float[fftFrameSize];
+		gBinAdvance = new float[fftFrameSize2];
+
+		for (long n = 0; n < fftFrameSize; n++) {
+			double w = -0.5 * cos(2.0f * M_PI * (double)n * invFftFrameSize) + 0.5f;
+			gWindow[n] = w;
+			gOutWindow[n] = 2.0f * w * invFftFrameSize2 * invOsamp;
+		}
+
+		for (long n = 0; n < fftFrameSize2; n++) {
+			gBinAdvance[n] = wrap((double)n*expct);
+		}
 	}
 
 	~PitchShifter() {
-		pffft_destroy_setup(pffftSetup);
 		delete[] gInFIFO;
 		delete[] gOutFIFO;
+		delete[] gOutPending;
+		delete[] gFrame;
 		delete[] gLastPhase;
 		delete[] gSumPhase;
 		delete[] gOutputAccum;
@@ -69,90 +125,246 @@ struct PitchShifter {
 		delete[] gAnaMagn;
 		delete[] gSynFreq;
 		delete[] gSynMagn;
-		pffft_aligned_free(gFFTworksp);
-		pffft_aligned_free(gFFTworkspOut);
+		delete[] gWindow;
+		delete[] gOutWindow;
+		delete[] gBinAdvance;
+		fftplans::releaseBuffer(gFFTworksp, fftFrameSize);
+		fftplans::releaseBuffer(gFFTworkspOut, fftFrameSize);
+		fftplans::releaseBuffer(gFFTscratch, fftFrameSize);
 	}
 
-	void process(const float pitchShift, const float *input, float *output) {
+	static double wrap(double x) {
+		return x - 2.0 * M_PI * floor(x / (2.0 * M_PI) + 0.5);
+	}
+
+	static float_4 wrap(float_4 x) {
+		return x - float_4(2.0f * M_PI) * rack::simd::floor(x * float_4(0.5f / M_PI) + 0.5f);
+	}
+
+	// |error| < 1e-5 rad
+	static float_4 fastAtan2(float_4 y, float_4 x) {
+		float_4 ax = rack::simd::fabs(x);
+		float_4 ay = rack::simd::fabs(y);
+		float_4 a = rack::simd::fmin(ax, ay) / (rack::simd::fmax(ax, ay) + 1e-30f);
+		float_4 s = a * a;
+		float_4 r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+		r = rack::simd::ifelse(ay > ax, float_4(M_PI_2) - r, r);
+		r = rack::simd::ifelse(x < 0.0f, float_4(M_PI) - r, r);
+		return rack::simd::ifelse(y < 0.0f, -r, r);
+	}
+
+	// x in [-pi, pi], |error| < 4e-6
+	static void fastSinCos(float_4 x, float_4 &s, float_4 &c) {
+		float_4 hi = x > float_4(M_PI_2);
+		float_4 lo = x < float_4(-M_PI_2);
+		float_4 folded = rack::simd::ifelse(hi, float_4(M_PI) - x, rack::simd::ifelse(lo, float_4(-M_PI) - x, x));
+		float_4 x2 = folded * folded;
+		s = folded * (1.0f + x2 * (-1.0f/6.0f + x2 * (1.0f/120.0f + x2 * (-1.0f/5040.0f + x2 * (1.0f/362880.0f)))));
+		c = 1.0f + x2 * (-0.5f + x2 * (1.0f/24.0f + x2 * (-1.0f/720.0f + x2 * (1.0f/40320.0f - x2 * (1.0f/3628800.0f)))));
+		c = rack::simd::ifelse(hi | lo, -c, c);
+	}
+
+	void forwardFast() {
+		for (long n = 0; n < fftFrameSize; n += 4) {
+			(float_4::load(gFrame + n) * float_4::load(gWindow + n)).store(gFFTworksp + n);
+		}
+
+		pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, gFFTscratch, PFFFT_FORWARD);
+	}
+
+	void analysisFast(long start, long end) {
+		const float *o = gFFTworkspOut;
+		for (long n = start; n < end; n += 4) {
+			const float *b = o + 2*n;
+			float_4 re(b[0], b[2], b[4], b[6]);
+			float_4 im(b[1], b[3], b[5], b[7]);
+			float_4 p = fastAtan2(im, re);
+			float_4 t = p - float_4::load(gLastPhase + n);
+			p.store(gLastPhase + n);
+			t = wrap(t - float_4::load(gBinAdvance + n));
+			float_4 bin((float)n, (float)(n+1), (float)(n+2), (float)(n+3));
+			(2.0f * rack::simd::sqrt(re*re + im*im)).store(gAnaMagn + n);
+			((bin + t * anaScale) * (float)freqPerBin).store(gAnaFreq + n);
+		}
+	}
+
+	void synthesisFast(long start, long end) {
+		float_4 s, c;
+		for (long n = start; n < end; n += 4) {
+			float_4 m = float_4::load(gSynMagn + n);
+			if (n == 0) m[0] = 0.0f;
+			float_4 p = wrap(float_4::load(gSumPhase + n) + float_4::load(gSynFreq + n) * synScale);
+			p.store(gSumPhase + n);
+			fastSinCos(p, s, c);
+			s *= m;
+			c *= m;
+			float *b = gFFTworksp + 2*n;
+			b[0] = c[0]; b[1] = s[0];
+			b[2] = c[1]; b[3] = s[1];
+			b[4] = c[2]; b[5] = s[2];
+			b[6] = c[3]; b[7] = s[3];
+		}
+	}
+
+	void inverseFast(float *out) {
+		pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut , gFFTscratch, PFFFT_BACKWARD);
+		for (long n = 0; n < fftFrameSize; n += 4) {
+			(float_4::load(gOutputAccum + n) + float_4::load(gOutWindow + n) * float_4::load(gFFTworkspOut + n)).store(gOutputAccum + n);
+		}
+
+		memcpy(out, gOutputAccum, stepSize*sizeof(float));
+		memmove(gOutputAccum, gOutputAccum+stepSize, fftFrameSize*sizeof(float));
+	}
 
-			for (i = 0; i < fftFrameSize; i++) {
-				gInFIFO[gRover] = input[i];
-
-				if(gRover >= inFifoLatency)  // [bsp] 09Mar2019: this fixes the noise burst issue in REI
-					 output[i] = gOutFIFO[gRover-inFifoLatency];
-				else
-					 output[i] = 0.0f;
-
-				gRover++;
-
-				if (gRover >= fftFrameSize) {
-					gRover = inFifoLatency;
-
-					memset(gFFTworksp, 0, fftFrameSize*sizeof(float));
-					memset(gFFTworkspOut, 0, fftFrameSize*sizeof(float));
-
-					for (k = 0; k < fftFrameSize;k++) {
-						window = -0.5 * cos(2.0f * M_PI * (double)k * invFftFrameSize) + 0.5f;
-						gFFTworksp[k] = gInFIFO[k] * window;
-					}
-
-					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, NULL, PFFFT_FORWARD);
-
-					for (k = 0; k < fftFrameSize2; k++) {
-						real = gFFTworkspOut[2*k];
-						imag = gFFTworkspOut[2*k+1];
-						magn = 2.*sqrt(real*real + imag*imag);
-						phase = atan2(imag,real);
-						tmp = phase - gLastPhase[k];
-						gLastPhase[k] = phase;
-						tmp -= (double)k*expct;
-						qpd = tmp * invPi;
-						if (qpd >= 0) qpd += qpd&1;
-						else qpd -= qpd&1;
-						tmp -= M_PI*(double)qpd;
-						tmp = osamp * tmp * invPi * 0.5f;
-						tmp = (double)k*freqPerBin + tmp*freqPerBin;
-						gAnaMagn[k] = magn;
-						gAnaFreq[k] = tmp;
-					}
-
-					memset(gSynMagn, 0, fftFrameSize*sizeof(float));
-					memset(gSynFreq, 0, fftFrameSize*sizeof(float));
-
-					for (k = 0; k < fftFrameSize2; k++) {
-						index = k*pitchShift;
-						if (index < fftFrameSize2) {
-							gSynMagn[index] += gAnaMagn[k];
-							gSynFreq[index] = gAnaFreq[k] * pitchShift;
-						}
-					}
-
-					memset(gFFTworksp, 0, fftFrameSize*sizeof(float));
-					memset(gFFTworkspOut, 0, fftFrameSize*sizeof(float));
-
-					for (k = 0; k < fftFrameSize2; k++) {
-						magn = k==0 ? 0 : gSynMagn[k];
-						tmp = gSynFreq[k];
-						tmp -= (double)k*freqPerBin;
-						tmp /= freqPerBin;
-						tmp = 2.0f * M_PI * tmp * invOsamp;
-						tmp += (double)k*expct;
-						gSumPhase[k] += tmp;
-						phase = gSumPhase[k];
-						gFFTworksp[2*k] = magn*cos(phase);
-						gFFTworksp[2*k+1] = magn*sin(phase);
-					}
-
-					pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut , NULL, PFFFT_BACKWARD);
-					for(k=0; k < fftFrameSize; k++) {
-						window = -0.5f * cos(2.0f * M_PI *(double)k * invFftFrameSize) + 0.5f;
-						gOutputAccum[k] += 2.0f * window * gFFTworkspOut[k] * invFftFrameSize2 * invOsamp;
-					}
-
-					for (k = 0; k < stepSize; k++) gOutFIFO[k] = gOutputAccum[k];
-					memmove(gOutputAccum, gOutputAccum+stepSize, fftFrameSize*sizeof(float));
-					for (k = 0; k < inFifoLatency; k++) gInFIFO[k] = gInFIFO[k+stepSize];
-				}
+	void forward() {
+		memset(gFFTworkspOut, 0, fftFrameSize*sizeof(float));
+
+		for (long n = 0; n < fftFrameSize; n++) {
+			double w = -0.5 * cos(2.0f * M_PI * (double)n * invFftFrameSize) + 0.5f;
+			gFFTworksp[n] = gFrame[n] * w;
+		}
+
+		pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut, gFFTscratch, PFFFT_FORWARD);
+	}
+
+	void analysis(long start, long end) {
+		for (long n = start; n < end; n++) {
+			double re = gFFTworkspOut[2*n];
+			double im = gFFTworkspOut[2*n+1];
+			double m = 2.*sqrt(re*re + im*im);
+			double p = atan2(im,re);
+			double t = p - gLastPhase[n];
+			gLastPhase[n] = p;
+			t -= (double)n*expct;
+			long q = t * invPi;
+			if (q >= 0) q += q&1;
+			else q -= q&1;
+			t -= M_PI*(double)q;
+			t = osamp * t * invPi * 0.5f;
+			t = (double)n*freqPerBin + t*freqPerBin;
+			gAnaMagn[n] = m;
+			gAnaFreq[n] = t;
+		}
+	}
+
+	void shift(const float pitchShift) {
+		memset(gSynMagn, 0, fftFrameSize*sizeof(float));
+		memset(gSynFreq, 0, fftFrameSize*sizeof(float));
+
+		for (long n = 0; n < fftFrameSize2; n++) {
+			long idx = n*pitchShift;
+			if (idx < fftFrameSize2) {
+				gSynMagn[idx] += gAnaMagn[n];
+				gSynFreq[idx] = gAnaFreq[n] * pitchShift;
 			}
+		}
+
+		memset(gFFTworksp, 0, fftFrameSize*sizeof(float));
+	}
+
+	void synthesis(long start, long end) {
+		for (long n = start; n < end; n++) {
+			double m = n==0 ? 0 : gSynMagn[n];
+			double t = gSynFreq[n];
+			t -= (double)n*freqPerBin;
+			t /= freqPerBin;
+			t = 2.0f * M_PI * t * invOsamp;
+			t += (double)n*expct;
+			gSumPhase[n] += t;
+			double p = gSumPhase[n];
+			gFFTworksp[2*n] = m*cos(p);
+			gFFTworksp[2*n+1] = m*sin(p);
+		}
+	}
+
+	void inverse(float *out) {
+		memset(gFFTworkspOut, 0, fftFrameSize*sizeof(float));
+
+		pffft_transform_ordered(pffftSetup, gFFTworksp, gFFTworkspOut , gFFTscratch, PFFFT_BACKWARD);
+		for (long n = 0; n < fftFrameSize; n++) {
+			double w = -0.5f * cos(2.0f * M_PI *(double)n * invFftFrameSize) + 0.5f;
+			gOutputAccum[n] += 2.0f * w * gFFTworkspOut[n] * invFftFrameSize2 * invOsamp;
+		}
+
+		for (long n = 0; n < stepSize; n++) out[n] = gOutputAccum[n];
+		memmove(gOutputAccum, gOutputAccum+stepSize, fftFrameSize*sizeof(float));
+	}
+
+	// runs one bounded slice of the pending frame, returns false once the frame is done
+	bool step() {
+		switch (stage) {
+			case FRAME_FORWARD:
+				if (fastKernel) forwardFast();
+				else forward();
+				stage = FRAME_ANALYSIS;
+				stageBin = 0;
+				return true;
+			case FRAME_ANALYSIS:
+				if (fastKernel) analysisFast(stageBin, min(stageBin + binsPerSlice, fftFrameSize2));
+				else analysis(stageBin, min(stageBin + binsPerSlice, fftFrameSize2));
+				stageBin += binsPerSlice;
+				if (stageBin >= fftFrameSize2) stage = FRAME_SHIFT;
+				return true;
+			case FRAME_SHIFT:
+				shift(framePitch);
+				stage = FRAME_SYNTHESIS;
+				stageBin = 0;
+				return true;
+			case FRAME_SYNTHESIS:
+				if (fastKernel) synthesisFast(stageBin, min(stageBin + binsPerSlice, fftFrameSize2));
+				else synthesis(stageBin, min(stageBin + binsPerSlice, fftFrameSize2));
+				stageBin += binsPerSlice;
+				if (stageBin >= fftFrameSize2) stage = FRAME_INVERSE;
+				return true;
+			case FRAME_INVERSE:
+				if (fastKernel) inverseFast(gOutPending);
+				else inverse(gOutPending);
+				stage = FRAME_IDLE;
+				return false;
+			default:
+				return false;
+		}
+	}
+
+	float processSample(const float pitchShift, const float input) {
+		float output = 0.0f;
+
+		gInFIFO[gRover] = input;
+
+		if(gRover >= inFifoLatency)  // [bsp] 09Mar2019: this fixes the noise burst issue in REI
+			output = gOutFIFO[gRover-inFifoLatency];
+
+		gRover++;
+
+		if (gRover >= fftFrameSize) {
+			gRover = inFifoLatency;
+
+			memcpy(gFrame, gInFIFO, fftFrameSize*sizeof(float));
+			memmove(gInFIFO, gInFIFO+stepSize, inFifoLatency*sizeof(float));
+			framePitch = pitchShift;
+
+			if (amortized) {
+				// a slice budget that does not fit the hop must not drop the frame
+				while (step()) {}
+				memcpy(gOutFIFO, gOutPending, stepSize*sizeof(float));
+				stage = FRAME_FORWARD;
+			}
+			else {
+				stage = FRAME_FORWARD;
+				while (step()) {}
+				memcpy(gOutFIFO, gOutPending, stepSize*sizeof(float));
+			}
+		}
+		else if (amortized) {
+			step();
+		}
+
+		return output;
+	}
+
+	void process(const float pitchShift, const float *input, float *output) {
+		for (i = 0; i < fftFrameSize; i++) {
+			output[i] = processSample(pitchShift, input[i]);
+		}
 	}
 };
@@ -0,0 +1,105 @@
+#pragma once
+#include "dsp/approx.hpp"
+
+namespace svf {
+
+// Trapezoidal state variable filter, the MultiFilter of the modules written
+// for any sample type so a float_4 runs four filters at once, each lane with
+// its own cutoff and Q. g is the prewarped cutoff tan(pi*freq/smpRate).
+template <typename T>
+struct SVF {
+	T hp = 0.0f, bp = 0.0f, lp = 0.0f, mem1 = 0.0f, mem2 = 0.0f;
+
+	void process(T sample, T g, T q) {
+		T k = 1.0f / q;
+		hp = (sample - (k + g) * mem1 - mem2) / (1.0f + k * g + g * g);
+		bp = g * hp + mem1;
+		lp = g * bp + mem2;
+		mem1 = g * hp + bp;
+		mem2 = g * bp + lp;
+	}
+};
+
+// Prewarped coefficient of a cutoff given as log2 of the frequency in Hz,
+// kept below Nyquist, tan goes negative past it.
+inline rack::simd::float_4 prewarp(rack::simd::float_4 pitch, float sampleTime) {
+	rack::simd::float_4 w = rack::simd::fmin(rack::dsp::approxExp2_taylor5(pitch) * sampleTime, 0.45f) * float(M_PI);
+	return rack::simd::sin(w) / rack::simd::cos(w);
+}
+
+enum Mode {
+	BYPASS,
+	LOWPASS,
+	BANDPASS,
+	HIGHPASS
+};
+
+// Sixteen SVF voices, voice v in lane v % 4 of filters[v / 4]. Callers fill
+// the per voice inputs, run process once per sample and read either out or
+// the states of the filters. The cutoff is given as log2 of the frequency in
+// Hz, the prewarped coefficient of a group is only evaluated again when one
+// of its pitches or the sample rate moves. Callers ramping the coefficient
+// at control rate write g themselves and run processG instead. Voices at or
+// above the channel count and the ones not active keep their state, as a
+// voice that isn't processed.
+struct PolySVF {
+	typedef rack::simd::float_4 float_4;
+
+	SVF<float_4> filters[4];
+	float in[16] = {};
+	float pitch[16] = {};
+	float q[16];
+	int mode[16] = {};
+	bool active[16];
+	float out[16] = {};
+
+	// coefficients and the pitches they were evaluated for, NAN to force it
+	float_4 g[4] = {};
+	float_4 gPitch[4];
+	float gSampleTime = 0.0f;
+
+	PolySVF() {
+		for (int v = 0; v < 16; v++) {
+			q[v] = 1.0f;
+			active[v] = true;
+		}
+		for (int k = 0; k < 4; k++) gPitch[k] = NAN;
+	}
+
+	void process(float sampleTime, int channels) {
+		bool rateChanged = sampleTime != gSampleTime;
+		gSampleTime = sampleTime;
+		for (int k = 0; 4 * k < channels; k++) {
+			float_4 p = float_4::load(&pitch[4 * k]);
+			if (rateChanged || rack::simd::movemask(p != gPitch[k])) {
+				gPitch[k] = p;
+				g[k] = prewarp(p, sampleTime);
+			}
+		}
+		processG(channels);
+	}
+
+	// runs the voices with the coefficients in g, pitch is left unread
+	void processG(int channels) {
+		for (int k = 0; 4 * k < channels; k++) {
+			float_4 x = float_4::load(&in[4 * k]);
+			SVF<float_4> f = filters[k];
+			f.process(x, g[k], float_4::load(&q[4 * k]));
+			float_4 run = (float_4(4 * k, 4 * k + 1, 4 * k + 2, 4 * k + 3) < float(channels))
+				& (float_4(active[4 * k], active[4 * k + 1], active[4 * k + 2], active[4 * k + 3]) != 0.0f);
+			filters[k].hp = rack::simd::ifelse(run, f.hp, filters[k].hp);
+			filters[k].bp = rack::simd::ifelse(run, f.bp, filters[k].bp);
+			filters[k].lp = rack::simd::ifelse(run, f.lp, filters[k].lp);
+			filters[k].mem1 = rack::simd::ifelse(run, f.mem1, filters[k].mem1);
+			filters[k].mem2 = rack::simd::ifelse(run, f.mem2, filters[k].mem2);
+
+			float_4 m(mode[4 * k], mode[4 * k + 1], mode[4 * k + 2], mode[4 * k + 3]);
+			float_4 y = rack::simd::ifelse(m == float(BYPASS), x, f.hp);
+			y = rack::simd::ifelse(m == float(LOWPASS), f.lp, y);
+			y = rack::simd::ifelse(m == float(BANDPASS), f.bp, y);
+			y.store(&out[4 * k]);
+		}
+	}
+};
+
+}
@@ -11,29 +11,22 @@ allpass::allpass()
 	buffer = 0;
 	bufidx = 0;
 	bufsize = 0;
-	allocated = false;
+	feedback = 0;
 };
 
 allpass::~allpass()
 {
-	if (allocated) delete[] buffer;
+	delete[] buffer;
 };
 
-void allpass::setbuffer(float *buf, int size)
+void allpass::setsize(int size)
 {
-	buffer = buf;
-	bufidx = 0;
+	if (size < 1) size = 1;
+	delete[] buffer;
+	buffer = new float[size];
 	bufsize = size;
-	allocated = false;
-}
-
-void allpass::changebuffer(float *buf, int size)
-	{
-		if (allocated) {delete[] buffer;}
-		buffer = new float[size];
-		bufsize = size;
-		bufidx = 0;
-		allocated = true;
+	bufidx = 0;
+	mute();
 }
 
 void allpass::mute()
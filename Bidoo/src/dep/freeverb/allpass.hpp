@@ -11,8 +11,7 @@ struct allpass
 {
 	allpass();
 	~allpass();
-	void	setbuffer(float *buf, int size);
-	void	changebuffer(float *buf, int size);
+	void	setsize(int size);
 	inline float process(float inp);
 	void	mute();
 	void	setfeedback(float val);
@@ -21,7 +20,6 @@ struct allpass
 	float	*buffer;
 	int		bufsize;
 	int		bufidx;
-	bool	allocated;
 };
 
 inline float allpass::process(float input)
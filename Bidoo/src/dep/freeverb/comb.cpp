@@ -8,38 +8,36 @@
 
 comb::comb()
 {
+	feedback = 0;
 	filterstore = 0;
+	damp1 = 0;
+	damp2 = 1;
 	bufsize = 0;
 	bufidx = 0;
 	buffer = 0;
-	allocated = false;
+	for (int k=0; k<4; k++)
+		delay[k] = 0;
 }
 
 comb::~comb()
 {
-	filterstore = 0;
-	bufidx = 0;
-	if (allocated) delete[] buffer;
+	delete[] buffer;
 }
 
-
-void comb::setbuffer(float *buf, int size)
+void comb::setdelays(const int *delays)
 {
-	buffer = buf;
-	bufidx = 0;
-	bufsize = size;
-	filterstore = 0;
-	allocated = false;
-}
-
-void comb::changebuffer(float *buf, int size)
+	int size = 1;
+	for (int k=0; k<4; k++)
 	{
-		if (allocated) {delete[] buffer;}
-		buffer = new float[size];
-		bufsize = size;
-		bufidx = 0;
-		filterstore = 0;
-		allocated = true;
+		delay[k] = delays[k];
+		if (delay[k] > size) size = delay[k];
+	}
+
+	delete[] buffer;
+	buffer = new rack::simd::float_4[size];
+	bufsize = size;
+	bufidx = 0;
+	mute();
 }
 
 void comb::mute()
@@ -57,7 +55,7 @@ void comb::setdamp(float val)
 
 float comb::getdamp()
 {
-	return damp1;
+	return damp1[0];
 }
 
 void comb::setfeedback(float val)
@@ -67,7 +65,7 @@ void comb::setfeedback(float val)
 
 float comb::getfeedback()
 {
-	return feedback;
+	return feedback[0];
 }
 
 // ends
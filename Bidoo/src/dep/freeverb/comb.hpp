@@ -7,36 +7,48 @@
 #ifndef _comb_
 #define _comb_
 
+#include "dsp/common.hpp"
+
+// Four comb filters in the lanes of a float_4. The lanes share one delay
+// line of float_4 frames and one write index, each lane reads its own delay
+// back from it, so a sample of the four combs is one store and four loads.
+
 struct comb
 {
 	comb();
 	~comb();
-	void	setbuffer(float *buf, int size);
-	void	changebuffer(float *buf, int size);
-	inline float	process(float inp);
+	void	setdelays(const int *delays);
+	inline rack::simd::float_4	process(rack::simd::float_4 inp);
+	inline float	tap(int k);
 	void	mute();
 	void	setdamp(float val);
 	float	getdamp();
 	void	setfeedback(float val);
 	float	getfeedback();
-	float	feedback;
-	float	filterstore;
-	float	damp1;
-	float	damp2;
-	float	*buffer;
+	rack::simd::float_4	feedback;
+	rack::simd::float_4	filterstore;
+	rack::simd::float_4	damp1;
+	rack::simd::float_4	damp2;
+	rack::simd::float_4	*buffer;
 	int		bufsize;
 	int		bufidx;
-	bool	allocated;
+	int		delay[4];
 };
 
 
 // Big to inline - but crucial for speed
 
-inline float comb::process(float input)
+inline float comb::tap(int k)
+{
+	int i = bufidx - delay[k];
+	if (i<0) i += bufsize;
+	return buffer[i][k];
+}
+
+inline rack::simd::float_4 comb::process(rack::simd::float_4 input)
 {
-	float output;
+	rack::simd::float_4 output(tap(0), tap(1), tap(2), tap(3));
 
-	output = buffer[bufidx];
 	filterstore = (output*damp2) + (filterstore*damp1);
 	buffer[bufidx] = input + (filterstore*feedback);
 
@@ -7,43 +7,24 @@
 #include "revmodel.hpp"
 #include <math.h>
 
+// Delay tunings at 44.1KHz, scaled by setsamplerate
+static const int combtuning[2][numcombs] = {
+	{combtuningL1, combtuningL2, combtuningL3, combtuningL4, combtuningL5, combtuningL6, combtuningL7, combtuningL8},
+	{combtuningR1, combtuningR2, combtuningR3, combtuningR4, combtuningR5, combtuningR6, combtuningR7, combtuningR8}
+};
+static const int allpasstuning[2][numallpasses] = {
+	{allpasstuningL1, allpasstuningL2, allpasstuningL3, allpasstuningL4},
+	{allpasstuningR1, allpasstuningR2, allpasstuningR3, allpasstuningR4}
+};
+
 revmodel::revmodel()
 {
-	// Tie the components to their buffers
-	combL[0].setbuffer(bufcombL1,combtuningL1);
-	combR[0].setbuffer(bufcombR1,combtuningR1);
-	combL[1].setbuffer(bufcombL2,combtuningL2);
-	combR[1].setbuffer(bufcombR2,combtuningR2);
-	combL[2].setbuffer(bufcombL3,combtuningL3);
-	combR[2].setbuffer(bufcombR3,combtuningR3);
-	combL[3].setbuffer(bufcombL4,combtuningL4);
-	combR[3].setbuffer(bufcombR4,combtuningR4);
-	combL[4].setbuffer(bufcombL5,combtuningL5);
-	combR[4].setbuffer(bufcombR5,combtuningR5);
-	combL[5].setbuffer(bufcombL6,combtuningL6);
-	combR[5].setbuffer(bufcombR6,combtuningR6);
-	combL[6].setbuffer(bufcombL7,combtuningL7);
-	combR[6].setbuffer(bufcombR7,combtuningR7);
-	combL[7].setbuffer(bufcombL8,combtuningL8);
-	combR[7].setbuffer(bufcombR8,combtuningR8);
-	allpassL[0].setbuffer(bufallpassL1,allpasstuningL1);
-	allpassR[0].setbuffer(bufallpassR1,allpasstuningR1);
-	allpassL[1].setbuffer(bufallpassL2,allpasstuningL2);
-	allpassR[1].setbuffer(bufallpassR2,allpasstuningR2);
-	allpassL[2].setbuffer(bufallpassL3,allpasstuningL3);
-	allpassR[2].setbuffer(bufallpassR3,allpasstuningR3);
-	allpassL[3].setbuffer(bufallpassL4,allpasstuningL4);
-	allpassR[3].setbuffer(bufallpassR4,allpasstuningR4);
-
 	// Set default values
-	allpassL[0].setfeedback(0.5f);
-	allpassR[0].setfeedback(0.5f);
-	allpassL[1].setfeedback(0.5f);
-	allpassR[1].setfeedback(0.5f);
-	allpassL[2].setfeedback(0.5f);
-	allpassR[2].setfeedback(0.5f);
-	allpassL[3].setfeedback(0.5f);
-	allpassR[3].setfeedback(0.5f);
+	for (int i=0; i<numallpasses; i++)
+	{
+		allpassL[i].setfeedback(0.5f);
+		allpassR[i].setfeedback(0.5f);
+	}
 
 	// safely initialize all values first
 	wet = initialwet * scalewet;	
@@ -56,8 +37,8 @@ revmodel::revmodel()
 	// now we can call update after all values are initialized
 	update();
 
-	// Buffer will be full of rubbish - so we MUST mute them
-	mute();
+	// Allocates and clears the delay lines
+	setsamplerate(44100.0f);
 }
 
 void revmodel::mute()
@@ -65,11 +46,8 @@ void revmodel::mute()
 	if (getmode() >= freezemode)
 		return;
 
-	for (int i=0;i<numcombs;i++)
-	{
-		combL[i].mute();
-		combR[i].mute();
-	}
+	for (int i=0; i<2*numcombs/4; i++)
+		combs[i].mute();
 	for (int i=0;i<numallpasses;i++)
 	{
 		allpassL[i].mute();
@@ -83,22 +61,8 @@ void revmodel::processreplace(float *inputL, float *inputR, float *outputL, floa
 
 	while(numsamples-- > 0)
 	{
-		outL = outR = 0;
 		input = (*inputL + *inputR) * gain;
-
-		// Accumulate comb filters in parallel
-		for(int i=0; i<numcombs; i++)
-		{
-			outL += combL[i].process(input);
-			outR += combR[i].process(input);
-		}
-
-		// Feed through allpasses in series
-		for(int i=0; i<numallpasses; i++)
-		{
-			outL = allpassL[i].process(outL);
-			outR = allpassR[i].process(outR);
-		}
+		tick(input, outL, outR);
 
 		// Calculate output REPLACING anything already there
 		*outputL = outL*wet1 + outR*wet2 + *inputL*dry;
@@ -118,22 +82,8 @@ void revmodel::processmix(float *inputL, float *inputR, float *outputL, float *o
 
 	while(numsamples-- > 0)
 	{
-		outL = outR = 0;
 		input = (*inputL + *inputR) * gain;
-
-		// Accumulate comb filters in parallel
-		for(int i=0; i<numcombs; i++)
-		{
-			outL += combL[i].process(input);
-			outR += combR[i].process(input);
-		}
-
-		// Feed through allpasses in series
-		for(int i=0; i<numallpasses; i++)
-		{
-			outL = allpassL[i].process(outL);
-			outR = allpassR[i].process(outR);
-		}
+		tick(input, outL, outR);
 
 		// Calculate output MIXING with anything already there
 		*outputL += outL*wet1 + outR*wet2 + *inputL*dry;
@@ -149,26 +99,21 @@ void revmodel::processmix(float *inputL, float *inputR, float *outputL, float *o
 
 void revmodel::process(const float inL, const float inR, const float fbIn, float &outputL, float &outputR, float &wOutputL, float &wOutputR)
 {
-	float outL = 0.0f, outR = 0.0f;
-	float input = (inL + inR + fbIn) * gain;
-	// Accumulate comb filters in parallel
-	for(int i=0; i<numcombs; i++)
-	{
-		outL += combL[i].process(input);
-		outR += combR[i].process(input);
-	}
-
-	// Feed through allpasses in series
-	for(int i=0; i<numallpasses; i++)
-	{
-		outL = allpassL[i].process(outL);
-		outR = allpassR[i].process(outR);
-	}
+	float outL, outR;
+	tick((inL + inR + fbIn) * gain, outL, outR);
 
-	outputL = outL*wet1 + outR*wet2 + inL*dry;
-	outputR = outR*wet1 + outL*wet2 + inR*dry;
 	wOutputL = outL*wet1 + outR*wet2;
 	wOutputR = outR*wet1 + outL*wet2;
+	outputL = wOutputL + inL*dry;
+	outputR = wOutputR + inR*dry;
+}
+
+// Block version, fbIn may be NULL
+
+void revmodel::process(const float *inL, const float *inR, const float *fbIn, float *outputL, float *outputR, float *wOutputL, float *wOutputR, long numsamples)
+{
+	for (long i=0; i<numsamples; i++)
+		process(inL[i], inR[i], fbIn ? fbIn[i] : 0.0f, outputL[i], outputR[i], wOutputL[i], wOutputR[i]);
 }
 
 void revmodel::update()
@@ -193,16 +138,10 @@ void revmodel::update()
 		gain = fixedgain;
 	}
 
-	for(i=0; i<numcombs; i++)
-	{
-		combL[i].setfeedback(roomsize1);
-		combR[i].setfeedback(roomsize1);
-	}
-
-	for(i=0; i<numcombs; i++)
+	for(i=0; i<2*numcombs/4; i++)
 	{
-		combL[i].setdamp(damp1);
-		combR[i].setdamp(damp1);
+		combs[i].setfeedback(roomsize1);
+		combs[i].setdamp(damp1);
 	}
 }
 
@@ -279,72 +218,27 @@ float revmodel::getmode()
 		return 0;
 }
 
-void revmodel::setsamplerate(const float samplerate) {
+// Resizes the delay lines for the rate and clears them, the parameters are
+// kept. Allocates, call it off the audio thread.
 
+void revmodel::setsamplerate(const float samplerate)
+{
 	sampleRate = samplerate;
-	float coeff = sampleRate/44100.0;
-
-	int mctL1 = round(coeff * combtuningL1);
-	int mctR1 = round(coeff * combtuningR1);
-	int mctL2 = round(coeff * combtuningL2);
-	int mctR2 = round(coeff * combtuningR2);
-	int mctL3 = round(coeff * combtuningL3);
-	int mctR3 = round(coeff * combtuningR3);
-	int mctL4 = round(coeff * combtuningL4);
-	int mctR4 = round(coeff * combtuningR4);
-	int mctL5 = round(coeff * combtuningL5);
-	int mctR5 = round(coeff * combtuningR5);
-	int mctL6 = round(coeff * combtuningL6);
-	int mctR6 = round(coeff * combtuningR6);
-	int mctL7 = round(coeff * combtuningL7);
-	int mctR7 = round(coeff * combtuningR7);
-	int mctL8 = round(coeff * combtuningL8);
-	int mctR8 = round(coeff * combtuningR8);
-
-	int maptL1 = round(coeff * allpasstuningL1);
-	int maptR1 = round(coeff * allpasstuningR1);
-	int maptL2 = round(coeff * allpasstuningL2);
-	int maptR2 = round(coeff * allpasstuningR2);
-	int maptL3 = round(coeff * allpasstuningL3);
-	int maptR3 = round(coeff * allpasstuningR3);
-	int maptL4 = round(coeff * allpasstuningL4);
-	int maptR4 = round(coeff * allpasstuningR4);
-
-	mute();
-
-	combL[0].changebuffer(bufcombL1,mctL1);
-	combR[0].changebuffer(bufcombR1,mctR1);
-	combL[1].changebuffer(bufcombL2,mctL2);
-	combR[1].changebuffer(bufcombR2,mctR2);
-	combL[2].changebuffer(bufcombL3,mctL3);
-	combR[2].changebuffer(bufcombR3,mctR3);
-	combL[3].changebuffer(bufcombL4,mctL4);
-	combR[3].changebuffer(bufcombR4,mctR4);
-	combL[4].changebuffer(bufcombL5,mctL5);
-	combR[4].changebuffer(bufcombR5,mctR5);
-	combL[5].changebuffer(bufcombL6,mctL6);
-	combR[5].changebuffer(bufcombR6,mctR6);
-	combL[6].changebuffer(bufcombL7,mctL7);
-	combR[6].changebuffer(bufcombR7,mctR7);
-	combL[7].changebuffer(bufcombL8,mctL8);
-	combR[7].changebuffer(bufcombR8,mctR8);
-
-	allpassL[0].changebuffer(bufallpassL1,maptL1);
-	allpassR[0].changebuffer(bufallpassR1,maptR1);
-	allpassL[1].changebuffer(bufallpassL2,maptL2);
-	allpassR[1].changebuffer(bufallpassR2,maptR2);
-	allpassL[2].changebuffer(bufallpassL3,maptL3);
-	allpassR[2].changebuffer(bufallpassR3,maptR3);
-	allpassL[3].changebuffer(bufallpassL4,maptL4);
-	allpassR[3].changebuffer(bufallpassR4,maptR4);
-
-	setwet(initialwet);
-	setroomsize(initialroom);
-	setdry(initialdry);
-	setdamp(initialdamp);
-	setwidth(initialwidth);
-	setmode(initialmode);
+	float coeff = sampleRate/44100.0f;
 
+	for (int i=0; i<2*numcombs/4; i++)
+	{
+		int delays[4];
+		for (int k=0; k<4; k++)
+			delays[k] = (int)roundf(coeff * combtuning[k%2][2*i + k/2]);
+		combs[i].setdelays(delays);
+	}
+
+	for (int i=0; i<numallpasses; i++)
+	{
+		allpassL[i].setsize((int)roundf(coeff * allpasstuning[0][i]));
+		allpassR[i].setsize((int)roundf(coeff * allpasstuning[1][i]));
+	}
 }
 
 //ends
@@ -19,6 +19,7 @@ public:
 			void	processmix(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip);
 			void	processreplace(float *inputL, float *inputR, float *outputL, float *outputR, long numsamples, int skip);
 			void  process(const float inL, const float inR, const float fbIn, float &outputL, float &outputR, float &wOutputL, float &wOutputR);
+			void  process(const float *inL, const float *inR, const float *fbIn, float *outputL, float *outputR, float *wOutputL, float *wOutputR, long numsamples);
 			void	setroomsize(float value);
 			float	getroomsize();
 			void	setdamp(float value);
@@ -34,6 +35,7 @@ public:
 			void	setsamplerate(const float samplerate);
 private:
 			void	update();
+	inline	void	tick(float input, float &outputL, float &outputR);
 private:
 	float	gain;
 	float	roomsize,roomsize1;
@@ -44,46 +46,40 @@ private:
 	float	mode;
 	float sampleRate;
 
-	// The following are all declared inline
-	// to remove the need for dynamic allocation
-	// with its subsequent error-checking messiness
-
-	// Comb filters
-	comb	combL[numcombs];
-	comb	combR[numcombs];
+	// The 16 comb filters run as four float_4, lanes {L, R, L, R} so the
+	// combs sharing a delay line have close tunings. The delay lines are
+	// allocated by setsamplerate.
+	comb	combs[2*numcombs/4];
 
 	// Allpass filters
 	allpass	allpassL[numallpasses];
 	allpass	allpassR[numallpasses];
+};
 
-	// Buffers for the combs
-	float	bufcombL1[combtuningL1];
-	float	bufcombR1[combtuningR1];
-	float	bufcombL2[combtuningL2];
-	float	bufcombR2[combtuningR2];
-	float	bufcombL3[combtuningL3];
-	float	bufcombR3[combtuningR3];
-	float	bufcombL4[combtuningL4];
-	float	bufcombR4[combtuningR4];
-	float	bufcombL5[combtuningL5];
-	float	bufcombR5[combtuningR5];
-	float	bufcombL6[combtuningL6];
-	float	bufcombR6[combtuningR6];
-	float	bufcombL7[combtuningL7];
-	float	bufcombR7[combtuningR7];
-	float	bufcombL8[combtuningL8];
-	float	bufcombR8[combtuningR8];
+// One sample of the combs and allpasses, input already scaled by gain
 
-	// Buffers for the allpasses
-	float	bufallpassL1[allpasstuningL1];
-	float	bufallpassR1[allpasstuningR1];
-	float	bufallpassL2[allpasstuningL2];
-	float	bufallpassR2[allpasstuningR2];
-	float	bufallpassL3[allpasstuningL3];
-	float	bufallpassR3[allpasstuningR3];
-	float	bufallpassL4[allpasstuningL4];
-	float	bufallpassR4[allpasstuningR4];
-};
+inline void revmodel::tick(float input, float &outputL, float &outputR)
+{
+	rack::simd::float_4 in = input;
+	rack::simd::float_4 acc = 0;
+
+	// Accumulate comb filters in parallel
+	for(int i=0; i<2*numcombs/4; i++)
+		acc += combs[i].process(in);
+
+	float outL = acc[0] + acc[2];
+	float outR = acc[1] + acc[3];
+
+	// Feed through allpasses in series
+	for(int i=0; i<numallpasses; i++)
+	{
+		outL = allpassL[i].process(outL);
+		outR = allpassR[i].process(outR);
+	}
+
+	outputL = outL;
+	outputR = outR;
+}
 
 #endif//_revmodel_
 
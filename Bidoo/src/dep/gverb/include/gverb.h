@@ -23,6 +23,7 @@ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include "dsp/common.hpp"
 #include "gverbdsp.h"
 #include "gverb.h"
 #include "ladspa-util.h"
@@ -35,6 +36,7 @@ typedef struct {
   float taillevel;
   float earlylevel;
   ty_damper *inputdamper;
+  ty_damper *rinputdamper;
   float maxroomsize;
   float roomsize;
   float revtime;
@@ -43,30 +45,43 @@ typedef struct {
   ty_fixeddelay **fdndels;
   float *fdngains;
   int *fdnlens;
-  ty_damper **fdndamps;
   float fdndamping;
+  float fdndampdelay[FDNORDER];
   ty_diffuser **ldifs;
   ty_diffuser **rdifs;
   ty_fixeddelay *tapdelay;
   int *taps;
   float *tapgains;
-  float *d;
-  float *u;
-  float *f;
   double alpha;
+  /* parameter changes glide over this many samples, the ones made before
+     the first sample apply at once */
+  int glide;
+  int remaining;
+  int started;
+  float largestdelaytarget;
+  float largestdelaystep;
+  float fdngaintargets[FDNORDER];
+  float fdngainsteps[FDNORDER];
+  float tapgaintargets[FDNORDER];
+  float tapgainsteps[FDNORDER];
 } ty_gverb;
 
+static const float gverb_fdnfactors[FDNORDER] = {1.000000f, 0.816490f, 0.707100f, 0.632450f};
+static const float gverb_tapfactors[FDNORDER] = {0.410f, 0.300f, 0.155f, 0.000f};
+
 
 ty_gverb *gverb_new(int, float, float, float, float, float, float, float, float);
 void gverb_free(ty_gverb *);
 void gverb_flush(ty_gverb *);
 static void gverb_do(ty_gverb *, float, float *, float *);
+static void gverb_do_stereo(ty_gverb *, float, float, float *, float *);
 static void gverb_set_roomsize(ty_gverb *, float);
 static void gverb_set_revtime(ty_gverb *, float);
 static void gverb_set_damping(ty_gverb *, float);
 static void gverb_set_inputbandwidth(ty_gverb *, float);
 static void gverb_set_earlylevel(ty_gverb *, float);
 static void gverb_set_taillevel(ty_gverb *, float);
+static void gverb_set_glide(ty_gverb *, int);
 
 /*
  * This FDN reverb can be made smoother by setting matrix elements at the
@@ -91,57 +106,120 @@ static void gverb_set_taillevel(ty_gverb *, float);
  * be 0.5, say.
  */
 
-static inline void gverb_fdnmatrix(float *a, float *b)
+static inline rack::simd::float_4 gverb_fdnmatrix(rack::simd::float_4 a)
 {
-  const float dl0 = a[0], dl1 = a[1], dl2 = a[2], dl3 = a[3];
+  typedef rack::simd::float_4 float_4;
 
-  b[0] = 0.5f*(+dl0 + dl1 - dl2 - dl3);
-  b[1] = 0.5f*(+dl0 - dl1 - dl2 + dl3);
-  b[2] = 0.5f*(-dl0 + dl1 - dl2 + dl3);
-  b[3] = 0.5f*(+dl0 + dl1 + dl2 + dl3);
+  return 0.5f*(float_4(a[0])*float_4(+1.0f, +1.0f, -1.0f, +1.0f)
+	       + float_4(a[1])*float_4(+1.0f, -1.0f, +1.0f, +1.0f)
+	       + float_4(a[2])*float_4(-1.0f, -1.0f, -1.0f, +1.0f)
+	       + float_4(a[3])*float_4(-1.0f, +1.0f, +1.0f, +1.0f));
 }
 
-static inline void gverb_do(ty_gverb *p, float x, float *yl, float *yr)
+/*
+ * Room size and reverb time only recompute the delay lengths and gains when
+ * they move. The new gains are reached linearly over the glide and the delay
+ * lengths follow the interpolated largest delay sample by sample, so a
+ * control rate update doesn't jump the lines.
+ */
+
+static inline void gverb_set_lengths(ty_gverb *p)
 {
-  float z;
   unsigned int i;
-  float lsum,rsum,sum,sign;
 
-    if ((x != x) || fabsf(x) > 100000.0f) {
-    x = 0.0f;
+  for(i = 0; i < FDNORDER; i++) {
+    p->fdnlens[i] = f_round(gverb_fdnfactors[i]*p->largestdelay);
+    p->taps[i] = 5+f_round(gverb_tapfactors[i]*p->largestdelay);
   }
+}
 
-  z = damper_do(p->inputdamper, x);
+static inline void gverb_glide_step(ty_gverb *p)
+{
+  unsigned int i;
 
-  z = diffuser_do(p->ldifs[0],z);
+  if (--p->remaining == 0) {
+    p->largestdelay = p->largestdelaytarget;
+    for(i = 0; i < FDNORDER; i++) {
+      p->fdngains[i] = p->fdngaintargets[i];
+      p->tapgains[i] = p->tapgaintargets[i];
+    }
+  } else {
+    p->largestdelay += p->largestdelaystep;
+    for(i = 0; i < FDNORDER; i++) {
+      p->fdngains[i] += p->fdngainsteps[i];
+      p->tapgains[i] += p->tapgainsteps[i];
+    }
+  }
+  gverb_set_lengths(p);
+}
+
+static inline void gverb_retarget(ty_gverb *p)
+{
+  unsigned int i;
 
+  p->largestdelaytarget = p->rate * p->roomsize * 0.00294f;
   for(i = 0; i < FDNORDER; i++) {
-    p->u[i] = p->tapgains[i]*fixeddelay_read(p->tapdelay,p->taps[i]);
+    p->fdngaintargets[i] = -powf((float)p->alpha, f_round(gverb_fdnfactors[i]*p->largestdelaytarget));
+    p->tapgaintargets[i] = powf((float)p->alpha, 5+f_round(gverb_tapfactors[i]*p->largestdelaytarget));
   }
-  fixeddelay_write(p->tapdelay,z);
 
-  for(i = 0; i < FDNORDER; i++) {
-    p->d[i] = damper_do(p->fdndamps[i],
-			p->fdngains[i]*fixeddelay_read(p->fdndels[i],
-						       p->fdnlens[i]));
+  if ((p->glide > 1) && p->started) {
+    p->remaining = p->glide;
+    p->largestdelaystep = (p->largestdelaytarget - p->largestdelay) / p->glide;
+    for(i = 0; i < FDNORDER; i++) {
+      p->fdngainsteps[i] = (p->fdngaintargets[i] - p->fdngains[i]) / p->glide;
+      p->tapgainsteps[i] = (p->tapgaintargets[i] - p->tapgains[i]) / p->glide;
+    }
+  } else {
+    p->remaining = 1;
+    gverb_glide_step(p);
   }
+}
 
-  sum = 0.0f;
-  sign = 1.0f;
-  for(i = 0; i < FDNORDER; i++) {
-    sum += sign*(p->taillevel*p->d[i] + p->earlylevel*p->u[i]);
-    sign = -sign;
+/*
+ * The tapped delay and the four FDN lines run as one float_4, lane i being
+ * line i. Returns the early reflections and tail sum fed to the output
+ * diffusers.
+ */
+
+static inline float gverb_fdn(ty_gverb *p, float z)
+{
+  typedef rack::simd::float_4 float_4;
+  float_4 u,d,f,s;
+  unsigned int i;
+
+  if (p->remaining > 0) {
+    gverb_glide_step(p);
   }
-  sum += x*p->earlylevel;
-  lsum = sum;
-  rsum = sum;
+  p->started = 1;
+
+  u = float_4(fixeddelay_read(p->tapdelay,p->taps[0]),
+	      fixeddelay_read(p->tapdelay,p->taps[1]),
+	      fixeddelay_read(p->tapdelay,p->taps[2]),
+	      fixeddelay_read(p->tapdelay,p->taps[3]));
+  u *= float_4::load(p->tapgains);
+  fixeddelay_write(p->tapdelay,z);
+
+  d = float_4(fixeddelay_read(p->fdndels[0],p->fdnlens[0]),
+	      fixeddelay_read(p->fdndels[1],p->fdnlens[1]),
+	      fixeddelay_read(p->fdndels[2],p->fdnlens[2]),
+	      fixeddelay_read(p->fdndels[3],p->fdnlens[3]));
+  d *= float_4::load(p->fdngains);
+  d = d*(1.0f-p->fdndamping) + float_4::load(p->fdndampdelay)*p->fdndamping;
+  d.store(p->fdndampdelay);
 
-  gverb_fdnmatrix(p->d,p->f);
+  s = p->taillevel*d + p->earlylevel*u;
 
+  f = gverb_fdnmatrix(d) + u;
   for(i = 0; i < FDNORDER; i++) {
-    fixeddelay_write(p->fdndels[i],p->u[i]+p->f[i]);
+    fixeddelay_write(p->fdndels[i],f[i]);
   }
 
+  return(s[0] - s[1] + s[2] - s[3]);
+}
+
+static inline void gverb_diffuse(ty_gverb *p, float lsum, float rsum, float *yl, float *yr)
+{
   lsum = diffuser_do(p->ldifs[1],lsum);
   lsum = diffuser_do(p->ldifs[2],lsum);
   lsum = diffuser_do(p->ldifs[3],lsum);
@@ -153,42 +231,69 @@ static inline void gverb_do(ty_gverb *p, float x, float *yl, float *yr)
   *yr = rsum;
 }
 
-static inline void gverb_set_roomsize(ty_gverb *p, const float a)
+static inline void gverb_do(ty_gverb *p, float x, float *yl, float *yr)
 {
-  unsigned int i;
+  float z,sum;
 
-    if (a <= 1.0 || (a != a)) {
-    p->roomsize = 1.0;
-  } else {
-    p->roomsize = a;
+  if ((x != x) || fabsf(x) > 100000.0f) {
+    x = 0.0f;
   }
-  p->largestdelay = p->rate * p->roomsize * 0.00294f;
 
-  p->fdnlens[0] = f_round(1.000000f*p->largestdelay);
-  p->fdnlens[1] = f_round(0.816490f*p->largestdelay);
-  p->fdnlens[2] = f_round(0.707100f*p->largestdelay);
-  p->fdnlens[3] = f_round(0.632450f*p->largestdelay);
-  for(i = 0; i < FDNORDER; i++) {
-    p->fdngains[i] = -powf((float)p->alpha, p->fdnlens[i]);
-  }
+  z = damper_do(p->inputdamper, x);
 
-  p->taps[0] = 5+f_round(0.410f*p->largestdelay);
-  p->taps[1] = 5+f_round(0.300f*p->largestdelay);
-  p->taps[2] = 5+f_round(0.155f*p->largestdelay);
-  p->taps[3] = 5+f_round(0.000f*p->largestdelay);
+  z = diffuser_do(p->ldifs[0],z);
 
-  for(i = 0; i < FDNORDER; i++) {
-    p->tapgains[i] = powf((float)p->alpha, p->taps[i]);
+  sum = gverb_fdn(p, z) + x*p->earlylevel;
+
+  gverb_diffuse(p, sum, sum, yl, yr);
+}
+
+/*
+ * Stereo input, each side gets its own input damper and first diffuser
+ * before they are mixed into the FDN, and its own direct signal. The same
+ * signal on both sides gives the mono output.
+ */
+
+static inline void gverb_do_stereo(ty_gverb *p, float xl, float xr, float *yl, float *yr)
+{
+  float zl,zr,sum;
+
+  if ((xl != xl) || fabsf(xl) > 100000.0f) {
+    xl = 0.0f;
+  }
+  if ((xr != xr) || fabsf(xr) > 100000.0f) {
+    xr = 0.0f;
   }
 
+  zl = damper_do(p->inputdamper, xl);
+  zl = diffuser_do(p->ldifs[0],zl);
+  zr = damper_do(p->rinputdamper, xr);
+  zr = diffuser_do(p->rdifs[0],zr);
+
+  sum = gverb_fdn(p, 0.5f*(zl + zr));
+
+  gverb_diffuse(p, sum + xl*p->earlylevel, sum + xr*p->earlylevel, yl, yr);
+}
+
+static inline void gverb_set_roomsize(ty_gverb *p, const float a)
+{
+  float roomsize = (a <= 1.0 || (a != a)) ? 1.0f : fminf(a, p->maxroomsize);
+
+  if (roomsize == p->roomsize) {
+    return;
+  }
+  p->roomsize = roomsize;
+  gverb_retarget(p);
 }
 
 static inline void gverb_set_revtime(ty_gverb *p,float a)
 {
   float ga,gt;
   double n;
-  unsigned int i;
 
+  if (a == p->revtime) {
+    return;
+  }
   p->revtime = a;
 
   ga = 60.0;
@@ -197,26 +302,26 @@ static inline void gverb_set_revtime(ty_gverb *p,float a)
   n = p->rate*gt;
   p->alpha = (double)powf(ga,1.0f/n);
 
-  for(i = 0; i < FDNORDER; i++) {
-    p->fdngains[i] = -powf((float)p->alpha, p->fdnlens[i]);
-  }
+  gverb_retarget(p);
+}
 
+/* samples over which the following room size and reverb time changes glide,
+ * the control rate period of the caller */
+static inline void gverb_set_glide(ty_gverb *p, int samples)
+{
+  p->glide = samples;
 }
 
 static inline void gverb_set_damping(ty_gverb *p,float a)
 {
-  unsigned int i;
-
   p->fdndamping = a;
-  for(i = 0; i < FDNORDER; i++) {
-    damper_set(p->fdndamps[i],p->fdndamping);
-  }
 }
 
 static inline void gverb_set_inputbandwidth(ty_gverb *p,float a)
 {
   p->inputbandwidth = a;
   damper_set(p->inputdamper,1.0 - p->inputbandwidth);
+  damper_set(p->rinputdamper,1.0 - p->inputbandwidth);
 }
 
 static inline void gverb_set_earlylevel(ty_gverb *p,float a)
@@ -4,6 +4,14 @@
 
 #include "ladspa-util.h"
 
+/*
+ * The fixed delays hold the longest delay they can read, which for the FDN
+ * and tap lines runs to hundreds of KB, and wrap their indices with a
+ * compare. The diffusers are short, their buffers are rounded up to a power
+ * of two and their indices masked, size is the delay and mask the buffer
+ * length minus one.
+ */
+
 typedef struct {
   int size;
   int idx;
@@ -12,6 +20,7 @@ typedef struct {
 
 typedef struct {
   int size;
+  int mask;
   float coeff;
   int idx;
   float *buf;
@@ -41,16 +50,18 @@ void fixeddelay_flush(ty_fixeddelay *);
 
 int isprime(int);
 int nearest_prime(int, float);
+int delay_buffer_length(int);
 
 static inline float diffuser_do(ty_diffuser *p, float x)
 {
-  float y,w;
+  float y,w,d;
 
-  w = x - p->buf[p->idx]*p->coeff;
+  d = p->buf[(p->idx - p->size) & p->mask];
+  w = x - d*p->coeff;
   w = flush_to_zero(w);
-  y = p->buf[p->idx] + w*p->coeff;
+  y = d + w*p->coeff;
   p->buf[p->idx] = w;
-  p->idx = (p->idx + 1) % p->size;
+  p->idx = (p->idx + 1) & p->mask;
   return(y);
 }
 
@@ -58,14 +69,15 @@ static inline float fixeddelay_read(ty_fixeddelay *p, int n)
 {
   int i;
 
-  i = (p->idx - n + p->size) % p->size;
+  i = p->idx - n;
+  if (i < 0) i += p->size;
   return(p->buf[i]);
 }
 
 static inline void fixeddelay_write(ty_fixeddelay *p, float x)
 {
   p->buf[p->idx] = x;
-  p->idx = (p->idx + 1) % p->size;
+  if (++p->idx == p->size) p->idx = 0;
 }
 
 static inline void damper_set(ty_damper *p, float damping)
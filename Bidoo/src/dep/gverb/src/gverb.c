@@ -44,19 +44,26 @@ ty_gverb *gverb_new(int srate, float maxroomsize, float roomsize,
   p->rate = srate;
   p->fdndamping = damping;
   p->maxroomsize = maxroomsize;
-  p->roomsize = roomsize;
+  p->roomsize = fminf(roomsize, maxroomsize);
   p->revtime = revtime;
   p->earlylevel = earlylevel;
   p->taillevel = taillevel;
+  p->glide = 1;
+  p->remaining = 0;
+  p->started = 0;
 
-  p->maxdelay = p->rate*p->maxroomsize/340.0;
-  p->largestdelay = p->rate*p->roomsize/340.0;
+  /* same scale as gverb_set_roomsize, the lines are sized for the longest
+     delays they read at the max room size, plus one sample for a glide that
+     rounds past it */
+  p->maxdelay = p->rate*p->maxroomsize*0.00294f;
+  p->largestdelay = p->rate*p->roomsize*0.00294f;
 
 
   /* Input damper */
 
   p->inputbandwidth = inputbandwidth;
   p->inputdamper = damper_make(1.0 - p->inputbandwidth);
+  p->rinputdamper = damper_make(1.0 - p->inputbandwidth);
 
 
   /* FDN section */
@@ -64,15 +71,11 @@ ty_gverb *gverb_new(int srate, float maxroomsize, float roomsize,
 
   p->fdndels = (ty_fixeddelay **)calloc(FDNORDER, sizeof(ty_fixeddelay *));
   for(i = 0; i < FDNORDER; i++) {
-    p->fdndels[i] = fixeddelay_make((int)p->maxdelay+1000);
+    p->fdndels[i] = fixeddelay_make(f_round(gverb_fdnfactors[i]*p->maxdelay)+1);
   }
   p->fdngains = (float *)calloc(FDNORDER, sizeof(float));
   p->fdnlens = (int *)calloc(FDNORDER, sizeof(int));
-
-  p->fdndamps = (ty_damper **)calloc(FDNORDER, sizeof(ty_damper *));
-  for(i = 0; i < FDNORDER; i++) {
-    p->fdndamps[i] = damper_make(p->fdndamping);
-  }
+  memset(p->fdndampdelay, 0, FDNORDER * sizeof(float));
 
   ga = 60.0;
   gt = p->revtime;
@@ -95,10 +98,6 @@ ty_gverb *gverb_new(int srate, float maxroomsize, float roomsize,
     p->fdngains[i] = -powf((float)p->alpha,p->fdnlens[i]);
   }
 
-  p->d = (float *)calloc(FDNORDER, sizeof(float));
-  p->u = (float *)calloc(FDNORDER, sizeof(float));
-  p->f = (float *)calloc(FDNORDER, sizeof(float));
-
   /* Diffuser section */
 
   diffscale = (float)p->fdnlens[3]/(210+159+562+410);
@@ -143,7 +142,7 @@ ty_gverb *gverb_new(int srate, float maxroomsize, float roomsize,
 
   /* Tapped delay section */
 
-  p->tapdelay = fixeddelay_make(44000);
+  p->tapdelay = fixeddelay_make(6+f_round(gverb_tapfactors[0]*p->maxdelay));
   p->taps = (int *)calloc(FDNORDER, sizeof(int));
   p->tapgains = (float *)calloc(FDNORDER, sizeof(float));
 
@@ -164,19 +163,15 @@ void gverb_free(ty_gverb *p)
   int i;
 
   damper_free(p->inputdamper);
+  damper_free(p->rinputdamper);
   for(i = 0; i < FDNORDER; i++) {
     fixeddelay_free(p->fdndels[i]);
-    damper_free(p->fdndamps[i]);
     diffuser_free(p->ldifs[i]);
     diffuser_free(p->rdifs[i]);
   }
   free(p->fdndels);
   free(p->fdngains);
   free(p->fdnlens);
-  free(p->fdndamps);
-  free(p->d);
-  free(p->u);
-  free(p->f);
   free(p->ldifs);
   free(p->rdifs);
   free(p->taps);
@@ -190,15 +185,13 @@ void gverb_flush(ty_gverb *p)
   int i;
 
   damper_flush(p->inputdamper);
+  damper_flush(p->rinputdamper);
   for(i = 0; i < FDNORDER; i++) {
     fixeddelay_flush(p->fdndels[i]);
-    damper_flush(p->fdndamps[i]);
     diffuser_flush(p->ldifs[i]);
     diffuser_flush(p->rdifs[i]);
   }
-  memset(p->d, 0, FDNORDER * sizeof(float));
-  memset(p->u, 0, FDNORDER * sizeof(float));
-  memset(p->f, 0, FDNORDER * sizeof(float));
+  memset(p->fdndampdelay, 0, FDNORDER * sizeof(float));
   fixeddelay_flush(p->tapdelay);
 }
 
@@ -27,17 +27,28 @@
 #define TRUE 1
 #define FALSE 0
 
+/* smallest power of two above the longest delay, for the short diffusers */
+int delay_buffer_length(int size)
+{
+  int n = 1;
+
+  while (n <= size) n <<= 1;
+  return(n);
+}
+
 ty_diffuser *diffuser_make(int size, float coeff)
 {
   ty_diffuser *p;
-  int i;
+  int i,n;
 
+  n = delay_buffer_length(size);
   p = (ty_diffuser *)malloc(sizeof(ty_diffuser));
   p->size = size;
+  p->mask = n - 1;
   p->coeff = coeff;
   p->idx = 0;
-  p->buf = (float *)malloc(size*sizeof(float));
-  for (i = 0; i < size; i++) p->buf[i] = 0.0;
+  p->buf = (float *)malloc(n*sizeof(float));
+  for (i = 0; i < n; i++) p->buf[i] = 0.0;
   return(p);
 }
 
@@ -49,7 +60,7 @@ void diffuser_free(ty_diffuser *p)
 
 void diffuser_flush(ty_diffuser *p)
 {
-  memset(p->buf, 0, p->size * sizeof(float));
+  memset(p->buf, 0, (p->mask + 1) * sizeof(float));
 }
 
 ty_damper *damper_make(float damping)
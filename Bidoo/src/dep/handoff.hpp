@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+
+namespace handoff {
+
+// Each thread that reads a published buffer uses its own reader slot.
+enum Reader {
+	AUDIO_READER,
+	UI_READER,
+	WORKER_READER,
+	LOADER_READER,
+	NUM_READERS
+};
+
+// Lock-free publication of immutable buffers (decoded samples, images).
+// A writer builds a new buffer and publish() swaps it in with one atomic
+// exchange, readers pin the current buffer with acquire() through a hazard
+// slot, never waiting on the writer. Replaced buffers are parked in a retire
+// list and deleted by collect() once no reader pins them, collect() must not
+// be called from the audio thread.
+template <typename T>
+struct Handoff {
+	static const int RETIRED = 16;
+
+	std::atomic<T*> current{nullptr};
+	std::atomic<T*> hazards[NUM_READERS];
+	std::atomic<T*> retired[RETIRED];
+
+	Handoff() {
+		for (int i = 0; i < NUM_READERS; i++) hazards[i].store(nullptr);
+		for (int i = 0; i < RETIRED; i++) retired[i].store(nullptr);
+	}
+
+	~Handoff() {
+		delete current.load();
+		for (int i = 0; i < RETIRED; i++) {
+			T *p = retired[i].load();
+			if (p && (p != reserved())) delete p;
+		}
+	}
+
+	// pins and returns the current buffer for this reader, the pointer stays
+	// valid until the next acquire() or release() of the same reader
+	T *acquire(const Reader reader) {
+		T *p = current.load();
+		// already pinned by this reader, nothing to publish
+		if (p == hazards[reader].load(std::memory_order_relaxed)) return p;
+		while (true) {
+			hazards[reader].store(p);
+			T *q = current.load();
+			if (q == p) return p;
+			p = q;
+		}
+	}
+
+	void release(const Reader reader) {
+		hazards[reader].store(nullptr);
+	}
+
+	// swaps in a new buffer (may be null), returns false and leaves the current
+	// one in place when the retire list is full, the caller keeps ownership then
+	bool publish(T *buffer) {
+		int slot = -1;
+		for (int i = 0; i < RETIRED; i++) {
+			T *expected = nullptr;
+			if (retired[i].compare_exchange_strong(expected, reserved())) {
+				slot = i;
+				break;
+			}
+		}
+		if (slot < 0) return false;
+		T *old = current.exchange(buffer);
+		retired[slot].store(old);
+		return true;
+	}
+
+	// true when a publish() from this thread would find a free retire slot
+	bool canPublish() {
+		for (int i = 0; i < RETIRED; i++) {
+			if (!retired[i].load()) return true;
+		}
+		return false;
+	}
+
+	// deletes the retired buffers no reader pins anymore
+	void collect() {
+		for (int i = 0; i < RETIRED; i++) {
+			T *p = retired[i].load();
+			if (!p || (p == reserved()) || pinned(p)) continue;
+			if (retired[i].compare_exchange_strong(p, nullptr)) delete p;
+		}
+	}
+
+private:
+	bool pinned(T *p) {
+		for (int i = 0; i < NUM_READERS; i++) {
+			if (hazards[i].load() == p) return true;
+		}
+		return false;
+	}
+
+	static T *reserved() {
+		return reinterpret_cast<T*>(alignof(T));
+	}
+};
+
+}
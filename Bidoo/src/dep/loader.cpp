@@ -0,0 +1,195 @@
+#include "loader.hpp"
+#include <rack.hpp>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#if !defined(METAMODULE)
+#include <condition_variable>
+#include <thread>
+#endif
+
+namespace loader {
+
+  struct Pending {
+    Job job;
+    uint64_t sequence = 0;
+    double queued = 0.0;
+  };
+
+  static std::mutex queueLock;
+  static std::vector<Pending> queue;
+  static uint64_t sequence = 0;
+  static void *runningOwner = NULL;
+  static std::string lastPath;
+  static Stats stats;
+#if !defined(METAMODULE)
+  // signalled each time a job finishes, cancel() waits on it
+  static std::condition_variable finished;
+#endif
+
+  // a job on the path that just loaded goes first, then the most urgent,
+  // oldest first. -1 when the queue is empty.
+  static int next() {
+    int best = -1;
+    for (size_t i = 0; i < queue.size(); i++) {
+      const Job &job = queue[i].job;
+      if (!lastPath.empty() && (job.path == lastPath)) return i;
+      if (best < 0) {
+        best = i;
+        continue;
+      }
+      const Job &bestJob = queue[best].job;
+      if ((job.priority < bestJob.priority) || ((job.priority == bestJob.priority) && (queue[i].sequence < queue[best].sequence))) best = i;
+    }
+    return best;
+  }
+
+#if defined(METAMODULE)
+  // hands the next job to its owner's AsyncThread, called with the queue
+  // locked so the owner can't be past cancel() in its destructor
+  static void wakeNext() {
+    if (runningOwner) return;
+    int i = next();
+    if ((i >= 0) && queue[i].job.wake) queue[i].job.wake();
+  }
+#endif
+
+  static void runPending(void *owner) {
+    while (true) {
+      Pending pending;
+      {
+        std::lock_guard<std::mutex> guard(queueLock);
+        // one job at a time, the one finishing wakes the next owner
+        if (runningOwner) return;
+        int i = next();
+        if ((i < 0) || (owner && (queue[i].job.owner != owner))) return;
+        pending = std::move(queue[i]);
+        queue.erase(queue.begin() + i);
+        runningOwner = pending.job.owner;
+        stats.depth = queue.size();
+      }
+
+      double start = rack::system::getTime();
+      if (pending.job.load) pending.job.load();
+      if (pending.job.done) pending.job.done();
+      double stop = rack::system::getTime();
+
+      std::lock_guard<std::mutex> guard(queueLock);
+      runningOwner = NULL;
+      lastPath = pending.job.path;
+      stats.jobs++;
+      stats.lastWait = start - pending.queued;
+      stats.lastRun = stop - start;
+      stats.maxWait = std::max(stats.maxWait, stats.lastWait);
+      stats.maxRun = std::max(stats.maxRun, stats.lastRun);
+#if defined(METAMODULE)
+      int i = next();
+      if ((i >= 0) && (queue[i].job.owner != owner)) wakeNext();
+#else
+      finished.notify_all();
+      DEBUG("Bidoo loader: %s queued %.1f ms, loaded in %.1f ms, %d left", pending.job.path.c_str(), stats.lastWait * 1000.0, stats.lastRun * 1000.0, stats.depth);
+#endif
+    }
+  }
+
+  void poll(void *owner) {
+    runPending(owner);
+  }
+
+#if !defined(METAMODULE)
+  // jobs call into APP, the thread runs with the context of the thread that
+  // queued the first job
+  struct Worker {
+    std::thread thread;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    ~Worker() {
+      {
+        std::lock_guard<std::mutex> guard(queueLock);
+        stopping = true;
+      }
+      wake.notify_all();
+      if (thread.joinable()) thread.join();
+    }
+  };
+
+  // defined after the queue so it is joined before the queue goes away
+  static Worker worker;
+
+  static void work(rack::Context *context) {
+    rack::contextSet(context);
+    std::unique_lock<std::mutex> lock(queueLock);
+    while (!worker.stopping) {
+      if (queue.empty()) {
+        worker.wake.wait(lock);
+        continue;
+      }
+      lock.unlock();
+      poll(NULL);
+      lock.lock();
+    }
+  }
+#endif
+
+  void submit(const Job &job) {
+    {
+      std::lock_guard<std::mutex> guard(queueLock);
+      double now = rack::system::getTime();
+      bool replaced = false;
+      for (Pending &pending : queue) {
+        if ((pending.job.owner == job.owner) && (pending.job.slot == job.slot)) {
+          pending.job = job;
+          pending.sequence = sequence++;
+          pending.queued = now;
+          stats.replaced++;
+          replaced = true;
+          break;
+        }
+      }
+      if (!replaced) {
+        Pending pending;
+        pending.job = job;
+        pending.sequence = sequence++;
+        pending.queued = now;
+        queue.push_back(std::move(pending));
+      }
+      stats.depth = queue.size();
+      stats.maxDepth = std::max(stats.maxDepth, stats.depth);
+#if defined(METAMODULE)
+      wakeNext();
+#else
+      if (!worker.thread.joinable()) worker.thread = std::thread(work, rack::contextGet());
+#endif
+    }
+#if !defined(METAMODULE)
+    worker.wake.notify_one();
+#endif
+  }
+
+  void cancel(void *owner) {
+    std::unique_lock<std::mutex> lock(queueLock);
+    size_t count = queue.size();
+    queue.erase(std::remove_if(queue.begin(), queue.end(), [owner](const Pending &pending) { return pending.job.owner == owner; }), queue.end());
+    stats.cancelled += count - queue.size();
+    stats.depth = queue.size();
+#if defined(METAMODULE)
+    // a running job of the owner is on its own AsyncThread, the next one
+    // may now belong to another module
+    wakeNext();
+#else
+    finished.wait(lock, [owner]() { return runningOwner != owner; });
+#endif
+  }
+
+  Stats getStats() {
+    std::lock_guard<std::mutex> guard(queueLock);
+    return stats;
+  }
+
+  std::string describe() {
+    Stats s = getStats();
+    return rack::string::f("Loader: %d queued (max %d), last load %.0f ms after %.0f ms queued", s.depth, s.maxDepth, s.lastRun * 1000.0, s.lastWait * 1000.0);
+  }
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <cstdint>
+
+namespace loader {
+
+// Process-wide queue for sample and image loads, so a patch with several
+// sample modules reads its files one at a time in priority order instead of
+// every module hitting the disk on its own. On Rack the jobs run on one
+// loader thread. On MetaModule the queue is still run in one global order,
+// one job at a time, but each job runs on its owner's AsyncThread: the
+// loader wakes the owner of the next job, which runs it through
+// poll(this). A plugin can neither own an AsyncThread outside of a module
+// nor sleep or yield there, so a destructor waiting on a job running on
+// another module's thread could spin forever. Running a job on its owner's
+// thread keeps it covered by that thread's lifetime, and cancel() never
+// waits.
+
+enum Priority {
+  PRIORITY_USER,   // file picked, dropped or option changed from the menu
+  PRIORITY_PATCH,  // restored by dataFromJson
+  PRIORITY_RELOAD  // sample rate change
+};
+
+struct Job {
+  void *owner = NULL;
+  // OAI loads one file per channel, a module with a single file uses 0
+  int slot = 0;
+  std::string path;
+  int priority = PRIORITY_USER;
+  // runs on the loader thread
+  std::function<void()> load;
+  // runs on the loader thread once load returned, not for a replaced or
+  // cancelled job
+  std::function<void()> done;
+  // MetaModule: wakes the owner's AsyncThread once the job is next in the
+  // queue, left empty by owners that poll all the time. Called with the queue
+  // locked, it must not call back into the loader.
+  std::function<void()> wake;
+};
+
+// Queues a job. A job still pending for the same owner and slot is replaced,
+// and pending jobs on the path that just loaded run next so they hit the
+// sample cache instead of reading the file again.
+void submit(const Job &job);
+
+// Drops the owner's pending jobs, called from the module destructor before
+// anything the jobs touch goes away. On Rack it also waits for the owner's
+// running job, on MetaModule that job runs on the owner's AsyncThread, which
+// the module stops as it is destroyed.
+void cancel(void *owner);
+
+// Runs the queued jobs in order for as long as the next one belongs to the
+// owner, MetaModule modules call it from their AsyncThread. The Rack loader
+// thread passes NULL to run every job.
+void poll(void *owner);
+
+struct Stats {
+  int depth = 0;
+  int maxDepth = 0;
+  uint32_t jobs = 0;
+  uint32_t replaced = 0;
+  uint32_t cancelled = 0;
+  // seconds, wait is the time spent queued
+  double lastWait = 0.0;
+  double lastRun = 0.0;
+  double maxWait = 0.0;
+  double maxRun = 0.0;
+};
+
+Stats getStats();
+
+// one line summary for the context menus
+std::string describe();
+
+}
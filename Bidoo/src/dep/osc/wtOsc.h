@@ -1,6 +1,7 @@
 #include "dsp/resampler.hpp"
 #include "dsp/fir.hpp"
 #include "../pffft/pffft.h"
+#include "../fftplans.hpp"
 #include <algorithm>
 // #include <iostream>
 // #include <fstream>
@@ -59,20 +60,16 @@ inline void wtFrame::reset() {
 }
 
 void wtFrame::calcFFT() {
-  PFFFT_Setup *pffftSetup;
-	pffftSetup = pffft_new_setup(FS, PFFFT_REAL);
-	float *fftIn;
-	float *fftOut;
-	fftIn = (float*)pffft_aligned_malloc(FS*sizeof(float));
-	fftOut = (float*)pffft_aligned_malloc(FS*sizeof(float));
-	memset(fftIn, 0, FS*sizeof(float));
-	memset(fftOut, 0, FS*sizeof(float));
+  PFFFT_Setup *pffftSetup = fftplans::acquire(FS, PFFFT_REAL);
+	float *fftIn = fftplans::acquireBuffer(FS);
+	float *fftOut = fftplans::acquireBuffer(FS);
+	float *fftWork = fftplans::acquireBuffer(FS);
 
 	for (size_t k = 0; k < FS; k++) {
 		fftIn[k] = sample[k];
 	}
 
-	pffft_transform_ordered(pffftSetup, fftIn, fftOut, 0, PFFFT_FORWARD);
+	pffft_transform_ordered(pffftSetup, fftIn, fftOut, fftWork, PFFFT_FORWARD);
 
 	for (size_t k = 0; k < FS2; k++) {
 		if ((abs(fftOut[2*k])>1e-2f) || (abs(fftOut[2*k+1])>1e-2f)) {
@@ -87,35 +84,31 @@ void wtFrame::calcFFT() {
     }
 	}
 
-	pffft_destroy_setup(pffftSetup);
-	pffft_aligned_free(fftIn);
-	pffft_aligned_free(fftOut);
+	fftplans::releaseBuffer(fftIn, FS);
+	fftplans::releaseBuffer(fftOut, FS);
+	fftplans::releaseBuffer(fftWork, FS);
 }
 
 void wtFrame::calcIFFT() {
-  PFFFT_Setup *pffftSetup;
-	pffftSetup = pffft_new_setup(FS, PFFFT_REAL);
-	float *fftIn;
-	float *fftOut;
-	fftIn = (float*)pffft_aligned_malloc(FS*sizeof(float));
-	fftOut =  (float*)pffft_aligned_malloc(FS*sizeof(float));
-	memset(fftIn, 0, FS*sizeof(float));
-	memset(fftOut, 0, FS*sizeof(float));
+  PFFFT_Setup *pffftSetup = fftplans::acquire(FS, PFFFT_REAL);
+	float *fftIn = fftplans::acquireBuffer(FS);
+	float *fftOut = fftplans::acquireBuffer(FS);
+	float *fftWork = fftplans::acquireBuffer(FS);
 
 	for (size_t i = 0; i < FS2; i++) {
 		fftIn[2*i] = magnitude[i]*cos(phase[i]);
 		fftIn[2*i+1] = magnitude[i]*sin(phase[i]);
 	}
 
-	pffft_transform_ordered(pffftSetup, fftIn, fftOut, 0, PFFFT_BACKWARD);
+	pffft_transform_ordered(pffftSetup, fftIn, fftOut, fftWork, PFFFT_BACKWARD);
 
 	for (size_t i = 0; i < FS; i++) {
 		sample[i]=fftOut[i]*0.5f;
 	}
 
-	pffft_destroy_setup(pffftSetup);
-	pffft_aligned_free(fftIn);
-	pffft_aligned_free(fftOut);
+	fftplans::releaseBuffer(fftIn, FS);
+	fftplans::releaseBuffer(fftOut, FS);
+	fftplans::releaseBuffer(fftWork, FS);
 }
 
 void wtFrame::calcWav() {
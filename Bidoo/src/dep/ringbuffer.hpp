@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace ringbuffer {
+
+// Single copy replacement for dsp::DoubleRingBuffer, which writes every
+// element twice so that any window from the start is contiguous. Here start
+// and end run free and are masked on access, so the size stays exact across
+// the wrap with S elements of storage instead of 2*S. Elements are read by
+// offset from the start rather than through a pointer, block writes are
+// split in two copies at the wrap. S must be a power of two.
+template <typename T, size_t S>
+struct RingBuffer {
+	static_assert((S & (S - 1)) == 0, "RingBuffer size must be a power of two");
+
+	T data[S];
+	size_t start = 0;
+	size_t end = 0;
+
+	static size_t mask(size_t i) {
+		return i & (S - 1);
+	}
+
+	void push(T t) {
+		data[mask(end++)] = t;
+	}
+
+	void push(const T *t, size_t n) {
+		size_t e = mask(end);
+		size_t n1 = std::min(n, S - e);
+		std::memcpy(&data[e], t, sizeof(T) * n1);
+		std::memcpy(data, t + n1, sizeof(T) * (n - n1));
+		end += n;
+	}
+
+	T shift() {
+		return data[mask(start++)];
+	}
+
+	// i-th element from the start, i < S
+	T &at(size_t i) {
+		return data[mask(start + i)];
+	}
+
+	T &front() {
+		return data[mask(start)];
+	}
+
+	void startIncr(size_t n) {
+		start += n;
+	}
+
+	void clear() {
+		start = end;
+	}
+
+	bool empty() const {
+		return start == end;
+	}
+
+	bool full() const {
+		return end - start >= S;
+	}
+
+	size_t size() const {
+		return end - start;
+	}
+
+	size_t capacity() const {
+		return S - size();
+	}
+};
+
+// Ring of interleaved frames sized at run time, for captures whose length
+// depends on the sample rate. All the channels of a poly or stereo signal
+// share one buffer and one pair of indices. The constructor allocates, build
+// it off the audio thread. A push on a full ring drops the oldest frame.
+template <typename T>
+struct FrameRing {
+	std::vector<T> data;
+	size_t channels;
+	size_t frames;
+	size_t start = 0;
+	size_t count = 0;
+
+	FrameRing(size_t frames, size_t channels) : data(std::max(frames, (size_t)1) * channels), channels(channels), frames(std::max(frames, (size_t)1)) {}
+
+	// i-th frame from the start, i <= frames
+	T *at(size_t i) {
+		size_t j = start + i;
+		if (j >= frames) j -= frames;
+		return &data[j * channels];
+	}
+
+	T *front() {
+		return at(0);
+	}
+
+	// returns the frame to write
+	T *push() {
+		T *frame = at(count);
+		if (count < frames) count++;
+		else if (++start == frames) start = 0;
+		return frame;
+	}
+
+	void startIncr(size_t n) {
+		n = std::min(n, count);
+		start += n;
+		if (start >= frames) start -= frames;
+		count -= n;
+	}
+
+	void clear() {
+		start = 0;
+		count = 0;
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	bool full() const {
+		return count == frames;
+	}
+
+	size_t size() const {
+		return count;
+	}
+};
+
+}
@@ -3,153 +3,495 @@
 #define DR_WAV_IMPLEMENTATION
 #include "dr_wav/dr_wav.h"
 #include <dsp/resampler.hpp>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <mutex>
 
 namespace waves {
 
-  std::vector<rack::dsp::Frame<1>> getMonoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
-    waveFileName = rack::system::getFilename(path);
-    waveExtension = rack::system::getExtension(waveFileName);
-    std::vector<rack::dsp::Frame<1>> result;
-    if (rack::string::uppercase(waveExtension) == ".WAV") {
-      unsigned int c;
-      unsigned int sr;
-      drwav_uint64 sc;
-      float* pSampleData;
-      pSampleData = drwav_open_file_and_read_pcm_frames_f32(path.c_str(), &c, &sr, &sc, NULL);
-      if (pSampleData != NULL)  {
-        sampleChannels = c;
-        sampleRate = sr;
-        for (long long unsigned int i=0; i < sc; i = i + c) {
-          rack::dsp::Frame<1> frame;
-          if (sampleChannels == 2) {
-            frame.samples[0] = (pSampleData[i] + pSampleData[i+1])/2.0f;
-          }
-          else {
-            frame.samples[0] = pSampleData[i];
-          }
-          result.push_back(frame);
-        }
-        sampleCount = sc/c;
-        drwav_free(pSampleData, NULL);
-      }
+  template <size_t CHANNELS>
+  struct SampleCache {
+    std::mutex mutex;
+    std::map<std::string, std::weak_ptr<const Sample<CHANNELS>>> entries;
+
+    std::shared_ptr<const Sample<CHANNELS>> find(const std::string &key) {
+      std::lock_guard<std::mutex> guard(mutex);
+      auto it = entries.find(key);
+      return (it != entries.end()) ? it->second.lock() : nullptr;
     }
-    else if (rack::string::uppercase(waveExtension) == ".AIFF") {
-      AudioFile<float> audioFile;
-      if (audioFile.load (path.c_str()))  {
-        sampleChannels = audioFile.getNumChannels();
-        sampleRate = audioFile.getSampleRate();
-        sampleCount = audioFile.getNumSamplesPerChannel();
-        for (int i=0; i < sampleCount; i++) {
-          rack::dsp::Frame<1> frame;
-          if (sampleChannels == 2) {
-            frame.samples[0] = (audioFile.samples[0][i] + audioFile.samples[1][i])/2.0f;
-          }
-          else {
-            frame.samples[0] = audioFile.samples[0][i];
-          }
-          result.push_back(frame);
-        }
+
+    // keeps the first decode when two loaders raced on the same key
+    std::shared_ptr<const Sample<CHANNELS>> insert(const std::string &key, std::shared_ptr<const Sample<CHANNELS>> sample) {
+      std::lock_guard<std::mutex> guard(mutex);
+      for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.expired()) it = entries.erase(it);
+        else it++;
       }
+      std::shared_ptr<const Sample<CHANNELS>> cached = entries[key].lock();
+      if (cached) return cached;
+      entries[key] = sample;
+      return sample;
     }
+  };
+
+  static SampleCache<1> monoCache;
+  static SampleCache<2> stereoCache;
+
+  static std::string fileKey(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return "";
+    return rack::string::f("%s|%lld|%lld", path.c_str(), (long long)st.st_mtime, (long long)st.st_size);
+  }
+
+  static std::string rateKey(const std::string &fileKey, const float currentSampleRate) {
+    return fileKey.empty() ? "" : rack::string::f("%s|%d", fileKey.c_str(), (int)currentSampleRate);
+  }
 
-    if ((sampleRate != currentSampleRate) && (sampleCount>0)) {
-      rack::dsp::SampleRateConverter<1> conv;
-      conv.setRates(sampleRate, currentSampleRate);
-      conv.setQuality(SPEEX_RESAMPLER_QUALITY_DESKTOP);
-      int outCount = sampleCount;
-      std::vector<rack::dsp::Frame<1>> subResult;
-      for (int i=0;i<sampleCount;i++) {
-        rack::dsp::Frame<1> frame;
-        frame.samples[0]=0.0f;
-        subResult.push_back(frame);
+  static std::string memoryKey(const std::string &fileKey, const float currentSampleRate, bool compact) {
+    return fileKey.empty() ? "" : rateKey(fileKey, currentSampleRate) + (compact ? "|16" : "|32");
+  }
+
+  // Resampled decodes are also kept on disk as raw frames behind a small
+  // header, so a warm patch load reads them back instead of decoding and
+  // resampling again. The least recently used entries are removed once the
+  // cache grows past DISK_CACHE_BYTES. Use order and sizes are kept in an
+  // index file instead of file times and directory listings, so the cache
+  // needs nothing but stdio and stat, on Rack as on MetaModule.
+  static const uint64_t DISK_CACHE_BYTES = 1024ull << 20;
+  static const uint32_t DISK_CACHE_MAGIC = 0x43444942;
+  static const uint32_t DISK_CACHE_VERSION = 1;
+
+  struct DiskCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t frameChannels;
+    uint32_t keySize;
+    int32_t channels;
+    int32_t sampleRate;
+    int32_t sampleCount;
+    uint32_t reserved;
+    uint64_t frameCount;
+  };
+
+  struct DiskCacheEntry {
+    uint64_t size = 0;
+    uint64_t used = 0;
+  };
+
+  // guards the index, loaded on first use
+  static std::mutex diskCacheMutex;
+  static std::map<std::string, DiskCacheEntry> diskCacheIndex;
+  static uint64_t diskCacheClock = 0;
+  static bool diskCacheLoaded = false;
+
+  static std::string diskCacheDir() {
+    return rack::asset::user("Bidoo/cache");
+  }
+
+  static std::string diskCacheName(const std::string &key, size_t channels) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : key) hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+    return rack::string::f("%016llx-%d.raw", (unsigned long long)hash, (int)channels);
+  }
+
+  static void loadDiskCacheIndex() {
+    if (diskCacheLoaded) return;
+    diskCacheLoaded = true;
+    FILE *f = std::fopen(rack::system::join(diskCacheDir(), "index.txt").c_str(), "r");
+    if (!f) return;
+    char name[64];
+    unsigned long long size, used;
+    while (std::fscanf(f, "%63s %llu %llu", name, &size, &used) == 3) {
+      DiskCacheEntry &entry = diskCacheIndex[name];
+      entry.size = size;
+      entry.used = used;
+      diskCacheClock = std::max(diskCacheClock, (uint64_t)used);
+    }
+    std::fclose(f);
+  }
+
+  static void saveDiskCacheIndex() {
+    std::string path = rack::system::join(diskCacheDir(), "index.txt");
+    std::string tmp = path + ".tmp";
+    FILE *f = std::fopen(tmp.c_str(), "w");
+    if (!f) return;
+    for (const auto &it : diskCacheIndex) {
+      std::fprintf(f, "%s %llu %llu\n", it.first.c_str(), (unsigned long long)it.second.size, (unsigned long long)it.second.used);
+    }
+    bool ok = std::fclose(f) == 0;
+    std::remove(path.c_str());
+    if (!ok || (std::rename(tmp.c_str(), path.c_str()) != 0)) std::remove(tmp.c_str());
+  }
+
+  // marks the entry as just used, entries the index lost are picked up again
+  static void touchDiskCache(const std::string &name, uint64_t size) {
+    std::lock_guard<std::mutex> guard(diskCacheMutex);
+    loadDiskCacheIndex();
+    DiskCacheEntry &entry = diskCacheIndex[name];
+    entry.size = size;
+    entry.used = ++diskCacheClock;
+    uint64_t total = 0;
+    for (const auto &it : diskCacheIndex) total += it.second.size;
+    while (total > DISK_CACHE_BYTES) {
+      auto oldest = diskCacheIndex.begin();
+      for (auto it = diskCacheIndex.begin(); it != diskCacheIndex.end(); it++) {
+        if (it->second.used < oldest->second.used) oldest = it;
       }
-      conv.process(&result[0], &sampleCount, &subResult[0], &outCount);
-      sampleCount = outCount;
-      return subResult;
+      std::remove(rack::system::join(diskCacheDir(), oldest->first).c_str());
+      total -= oldest->second.size;
+      diskCacheIndex.erase(oldest);
     }
+    saveDiskCacheIndex();
+  }
 
-    return result;
+  template <size_t CHANNELS>
+  static bool readDiskCache(const std::string &key, Sample<CHANNELS> &sample) {
+    std::string name = diskCacheName(key, CHANNELS);
+    FILE *f = std::fopen(rack::system::join(diskCacheDir(), name).c_str(), "rb");
+    if (!f) return false;
+    DiskCacheHeader header;
+    // the key is stored too, a hash collision reads as a miss
+    bool ok = (std::fread(&header, sizeof(header), 1, f) == 1) && (header.magic == DISK_CACHE_MAGIC) && (header.version == DISK_CACHE_VERSION)
+      && (header.frameChannels == CHANNELS) && (header.keySize == key.size());
+    if (ok) {
+      std::string stored(key.size(), '\0');
+      ok = (std::fread(&stored[0], 1, stored.size(), f) == stored.size()) && (stored == key);
+    }
+    if (ok) {
+      sample.frames.resize(header.frameCount);
+      ok = std::fread(sample.frames.data(), sizeof(rack::dsp::Frame<CHANNELS>), header.frameCount, f) == header.frameCount;
+    }
+    std::fclose(f);
+    if (!ok) {
+      std::vector<rack::dsp::Frame<CHANNELS>>().swap(sample.frames);
+      return false;
+    }
+    sample.channels = header.channels;
+    sample.sampleRate = header.sampleRate;
+    sample.sampleCount = header.sampleCount;
+    touchDiskCache(name, sizeof(header) + key.size() + header.frameCount * sizeof(rack::dsp::Frame<CHANNELS>));
+    return true;
   }
 
-  std::vector<rack::dsp::Frame<2>> getStereoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
+  template <size_t CHANNELS>
+  static void writeDiskCache(const std::string &key, const Sample<CHANNELS> &sample) {
+    uint64_t bytes = sizeof(DiskCacheHeader) + key.size() + sample.frames.size() * sizeof(rack::dsp::Frame<CHANNELS>);
+    if (sample.frames.empty() || (bytes > DISK_CACHE_BYTES)) return;
+    rack::system::createDirectories(diskCacheDir());
+    std::string name = diskCacheName(key, CHANNELS);
+    std::string path = rack::system::join(diskCacheDir(), name);
+    // written aside and renamed so a reader never sees a partial entry
+    std::string tmp = path + ".tmp";
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return;
+    DiskCacheHeader header = {DISK_CACHE_MAGIC, DISK_CACHE_VERSION, (uint32_t)CHANNELS, (uint32_t)key.size(),
+      sample.channels, sample.sampleRate, sample.sampleCount, 0, (uint64_t)sample.frames.size()};
+    bool ok = (std::fwrite(&header, sizeof(header), 1, f) == 1) && (std::fwrite(key.data(), 1, key.size(), f) == key.size())
+      && (std::fwrite(sample.frames.data(), sizeof(rack::dsp::Frame<CHANNELS>), sample.frames.size(), f) == sample.frames.size());
+    ok = (std::fclose(f) == 0) && ok;
+    // rename does not replace an existing file on Windows or FAT
+    std::remove(path.c_str());
+    if (!ok || (std::rename(tmp.c_str(), path.c_str()) != 0)) {
+      std::remove(tmp.c_str());
+      return;
+    }
+    touchDiskCache(name, bytes);
+  }
+
+  template <size_t CHANNELS, typename Decoder>
+  static std::shared_ptr<const Sample<CHANNELS>> getSample(SampleCache<CHANNELS> &cache, Decoder decoder, const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount, bool compact) {
+    std::string file = fileKey(path);
+    std::string diskKey = rateKey(file, currentSampleRate);
+    std::string key = memoryKey(file, currentSampleRate, compact);
+    std::shared_ptr<const Sample<CHANNELS>> sample = key.empty() ? nullptr : cache.find(key);
+    if (!sample) {
+      std::shared_ptr<Sample<CHANNELS>> decoded = std::make_shared<Sample<CHANNELS>>();
+      if (diskKey.empty() || !readDiskCache(diskKey, *decoded)) {
+        decoded->frames = decoder(path, currentSampleRate, waveFileName, waveExtension, decoded->channels, decoded->sampleRate, decoded->sampleCount);
+        // files already at the engine rate decode about as fast as they would read back
+        if (!diskKey.empty() && ((float)decoded->sampleRate != currentSampleRate)) writeDiskCache(diskKey, *decoded);
+      }
+      decoded->frameRate = currentSampleRate;
+      decoded->fileKey = file;
+      if (compact) decoded->compact();
+      sample = key.empty() ? std::shared_ptr<const Sample<CHANNELS>>(decoded) : cache.insert(key, decoded);
+    }
     waveFileName = rack::system::getFilename(path);
     waveExtension = rack::system::getExtension(waveFileName);
-    std::vector<rack::dsp::Frame<2>> result;
+    sampleChannels = sample->channels;
+    sampleRate = sample->sampleRate;
+    sampleCount = sample->sampleCount;
+    return sample;
+  }
+
+  static const int CHUNK_FRAMES = 4096;
+
+  static void mixFrame(rack::dsp::Frame<1> &frame, float left, float right, int fileChannels) {
+    frame.samples[0] = (fileChannels == 2) ? (left + right)/2.0f : left;
+  }
+
+  static void mixFrame(rack::dsp::Frame<2> &frame, float left, float right, int fileChannels) {
+    frame.samples[0] = left;
+    frame.samples[1] = (fileChannels == 2) ? right : left;
+  }
+
+  // Writes decoded chunks straight into the destination, which is sized once
+  // from the file length, resampling them on the fly when the rates differ.
+  template <size_t CHANNELS>
+  struct FrameWriter {
+    std::vector<rack::dsp::Frame<CHANNELS>> &dest;
+    rack::dsp::SampleRateConverter<CHANNELS> conv;
+    bool resample;
+    size_t written = 0;
+
+    FrameWriter(std::vector<rack::dsp::Frame<CHANNELS>> &dest, int fileRate, float currentSampleRate, size_t fileFrames) : dest(dest) {
+      resample = (fileRate != currentSampleRate) && (fileFrames > 0);
+      size_t expected = fileFrames;
+      if (resample) {
+        conv.setRates(fileRate, currentSampleRate);
+        conv.setQuality(SPEEX_RESAMPLER_QUALITY_DESKTOP);
+        expected = (size_t)std::ceil((double)fileFrames * currentSampleRate / fileRate) + CHUNK_FRAMES;
+      }
+      dest.resize(expected);
+    }
+
+    void write(const rack::dsp::Frame<CHANNELS> *frames, int count) {
+      if (!resample) {
+        if (written + count > dest.size()) dest.resize(written + count);
+        std::copy(frames, frames + count, dest.begin() + written);
+        written += count;
+        return;
+      }
+      while (count > 0) {
+        if (dest.size() - written < (size_t)CHUNK_FRAMES) dest.resize(dest.size() + CHUNK_FRAMES);
+        int inCount = count;
+        int outCount = dest.size() - written;
+        conv.process(frames, &inCount, &dest[written], &outCount);
+        frames += inCount;
+        count -= inCount;
+        written += outCount;
+      }
+    }
+
+    int finish() {
+      dest.resize(written);
+      return written;
+    }
+  };
 
-    // Convert extension to uppercase for comparison
+  template <size_t CHANNELS>
+  static std::vector<rack::dsp::Frame<CHANNELS>> decode(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
+    waveFileName = rack::system::getFilename(path);
+    waveExtension = rack::system::getExtension(waveFileName);
+    std::vector<rack::dsp::Frame<CHANNELS>> result;
     std::string upperExt = rack::string::uppercase(waveExtension);
-    
-    // Check if extension is supported
+
     if (upperExt != ".WAV" && upperExt != ".AIFF") {
-        // Return empty buffer for unsupported format
-        sampleChannels = 0;
-        sampleRate = 0;
-        sampleCount = 0;
-        return result;
+      sampleChannels = 0;
+      sampleRate = 0;
+      sampleCount = 0;
+      return result;
     }
 
+    std::vector<rack::dsp::Frame<CHANNELS>> chunk(CHUNK_FRAMES);
     if (upperExt == ".WAV") {
-      unsigned int c;
-      unsigned int sr;
-      drwav_uint64 sc;
-      float* pSampleData;
-      pSampleData = drwav_open_file_and_read_pcm_frames_f32(path.c_str(), &c, &sr, &sc, NULL);
-      if (pSampleData != NULL)  {
+      drwav wav;
+      if (drwav_init_file(&wav, path.c_str(), NULL)) {
+        int c = wav.channels;
         sampleChannels = c;
-        sampleRate = sr;
-        sc = 2 * sc;
-        for (long long unsigned int i=0; i < sc; i = i + c) {
-          rack::dsp::Frame<2> frame;
-          frame.samples[0] = pSampleData[i];
-  				if (sampleChannels == 2)
-  					frame.samples[1] = (float)pSampleData[i+1];
-  				else
-  					frame.samples[1] = (float)pSampleData[i];
-          result.push_back(frame);
+        sampleRate = wav.sampleRate;
+        FrameWriter<CHANNELS> writer(result, sampleRate, currentSampleRate, wav.totalPCMFrameCount);
+        std::vector<float> pcm(CHUNK_FRAMES * c);
+        drwav_uint64 read;
+        while ((read = drwav_read_pcm_frames_f32(&wav, CHUNK_FRAMES, pcm.data())) > 0) {
+          for (drwav_uint64 i = 0; i < read; i++) {
+            const float *in = &pcm[i * c];
+            mixFrame(chunk[i], in[0], in[c > 1 ? 1 : 0], c);
+          }
+          writer.write(chunk.data(), read);
         }
-        sampleCount = sc/c;
-        drwav_free(pSampleData, NULL);
+        sampleCount = writer.finish();
+        drwav_uninit(&wav);
       }
     }
-    else if (upperExt == ".AIFF") {
+    else {
       AudioFile<float> audioFile;
       if (audioFile.load (path.c_str()))  {
         sampleChannels = audioFile.getNumChannels();
         sampleRate = audioFile.getSampleRate();
-        sampleCount = audioFile.getNumSamplesPerChannel();
-        for (int i=0; i < sampleCount; i++) {
-          rack::dsp::Frame<2> frame;
-          frame.samples[0] = audioFile.samples[0][i];
-  				if (sampleChannels == 2)
-  					frame.samples[1] = audioFile.samples[1][i];
-  				else
-  					frame.samples[1] = audioFile.samples[0][i];
-          result.push_back(frame);
+        int frames = audioFile.getNumSamplesPerChannel();
+        const std::vector<float> &left = audioFile.samples[0];
+        const std::vector<float> &right = audioFile.samples[sampleChannels > 1 ? 1 : 0];
+        FrameWriter<CHANNELS> writer(result, sampleRate, currentSampleRate, frames);
+        for (int i = 0; i < frames; i += CHUNK_FRAMES) {
+          int count = std::min(CHUNK_FRAMES, frames - i);
+          for (int k = 0; k < count; k++) {
+            mixFrame(chunk[k], left[i + k], right[i + k], sampleChannels);
+          }
+          writer.write(chunk.data(), count);
         }
+        sampleCount = writer.finish();
       }
     }
 
-    if ((sampleRate != currentSampleRate) && (sampleCount>0)) {
-      rack::dsp::SampleRateConverter<2> conv;
-      conv.setRates(sampleRate, currentSampleRate);
-      conv.setQuality(SPEEX_RESAMPLER_QUALITY_DESKTOP);
-      int outCount = 16*sampleCount;
-      std::vector<rack::dsp::Frame<2>> subResult;
-      for (int i=0;i<outCount;i++) {
-        rack::dsp::Frame<2> frame;
-        frame.samples[0]=0.0f;
-        frame.samples[1]=0.0f;
-        subResult.push_back(frame);
+    return result;
+  }
+
+  std::vector<rack::dsp::Frame<1>> getMonoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
+    return decode<1>(path, currentSampleRate, waveFileName, waveExtension, sampleChannels, sampleRate, sampleCount);
+  }
+
+  std::vector<rack::dsp::Frame<2>> getStereoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount) {
+    return decode<2>(path, currentSampleRate, waveFileName, waveExtension, sampleChannels, sampleRate, sampleCount);
+  }
+
+  MonoSample getMonoSample(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount, bool compact) {
+    return getSample<1>(monoCache, getMonoWav, path, currentSampleRate, waveFileName, waveExtension, sampleChannels, sampleRate, sampleCount, compact);
+  }
+
+  StereoSample getStereoSample(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount, bool compact) {
+    return getSample<2>(stereoCache, getStereoWav, path, currentSampleRate, waveFileName, waveExtension, sampleChannels, sampleRate, sampleCount, compact);
+  }
+
+  // One more resampling pass over the frames in memory, from their rate to
+  // the new one. The file is not read: a rate change costs a resample of the
+  // buffer and no disk access, a patch load still decodes from the source.
+  template <size_t CHANNELS>
+  static std::shared_ptr<const Sample<CHANNELS>> resample(SampleCache<CHANNELS> &cache, const std::shared_ptr<const Sample<CHANNELS>> &from, const float currentSampleRate, bool compact) {
+    if (!from || (from->frameRate <= 0)) return nullptr;
+    if (((float)from->frameRate == currentSampleRate) && (compact == !from->pcm.empty())) return from;
+    std::string key = memoryKey(from->fileKey, currentSampleRate, compact);
+    std::shared_ptr<const Sample<CHANNELS>> sample = key.empty() ? nullptr : cache.find(key);
+    if (sample) return sample;
+
+    std::shared_ptr<Sample<CHANNELS>> resampled = std::make_shared<Sample<CHANNELS>>();
+    resampled->channels = from->channels;
+    resampled->sampleRate = from->sampleRate;
+    resampled->frameRate = currentSampleRate;
+    resampled->fileKey = from->fileKey;
+    size_t count = from->size();
+    FrameWriter<CHANNELS> writer(resampled->frames, from->frameRate, currentSampleRate, count);
+    std::vector<rack::dsp::Frame<CHANNELS>> chunk(CHUNK_FRAMES);
+    for (size_t i = 0; i < count; i += CHUNK_FRAMES) {
+      int n = std::min((size_t)CHUNK_FRAMES, count - i);
+      for (int k = 0; k < n; k++) chunk[k] = from->frame(i + k);
+      writer.write(chunk.data(), n);
+    }
+    resampled->sampleCount = writer.finish();
+    if (compact) resampled->compact();
+    return key.empty() ? std::shared_ptr<const Sample<CHANNELS>>(resampled) : cache.insert(key, resampled);
+  }
+
+  MonoSample resampleSample(const MonoSample &sample, const float currentSampleRate, bool compact) {
+    return resample<1>(monoCache, sample, currentSampleRate, compact);
+  }
+
+  StereoSample resampleSample(const StereoSample &sample, const float currentSampleRate, bool compact) {
+    return resample<2>(stereoCache, sample, currentSampleRate, compact);
+  }
+
+  struct StreamDecoder {
+    drwav wav;
+  };
+
+  Stream::~Stream() {
+    if (decoder) {
+      drwav_uninit(&decoder->wav);
+      delete decoder;
+    }
+  }
+
+  bool Stream::open(const std::string &path) {
+    if (rack::string::uppercase(rack::system::getExtension(path)) != ".WAV") return false;
+    decoder = new StreamDecoder;
+    if (!drwav_init_file(&decoder->wav, path.c_str(), NULL)) {
+      delete decoder;
+      decoder = NULL;
+      return false;
+    }
+    channels = decoder->wav.channels;
+    sampleRate = decoder->wav.sampleRate;
+    sampleCount = decoder->wav.totalPCMFrameCount;
+    pcm.resize(BLOCK_FRAMES * channels);
+    // the first blocks are read here so playback can start from the top at once
+    for (int i = 0; (i < READ_AHEAD) && (i * BLOCK_FRAMES < sampleCount); i++) load(i);
+    return true;
+  }
+
+  bool Stream::read(int frame, rack::dsp::Frame<2> &out) {
+    int index = frame / BLOCK_FRAMES;
+    Block &block = blocks[index % NUM_BLOCKS];
+    if (block.index.load(std::memory_order_acquire) == index) {
+      out = block.frames[frame % BLOCK_FRAMES];
+      // the worker may have recycled the block while it was read
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (block.index.load(std::memory_order_relaxed) == index) return true;
+    }
+    underruns++;
+    out.samples[0] = 0.0f;
+    out.samples[1] = 0.0f;
+    return false;
+  }
+
+  void Stream::setPlayHead(int frame, bool reverse) {
+    playHead.store(frame, std::memory_order_relaxed);
+    this->reverse.store(reverse, std::memory_order_relaxed);
+  }
+
+  void Stream::setHint(int frame) {
+    hint.store(frame, std::memory_order_relaxed);
+  }
+
+  bool Stream::inWindow(int block, int head, int dir) {
+    int distance = (block - head) * dir;
+    return (distance >= -1) && (distance <= READ_AHEAD);
+  }
+
+  void Stream::fill() {
+    if (!decoder) return;
+    int last = (sampleCount - 1) / BLOCK_FRAMES;
+    int head = playHead.load(std::memory_order_relaxed) / BLOCK_FRAMES;
+    int dir = reverse.load(std::memory_order_relaxed) ? -1 : 1;
+    // read-ahead in the play direction first, then the jump target when its
+    // slot does not hold a block the play head is about to need
+    for (int i = -1; i <= READ_AHEAD; i++) {
+      int index = head + i * dir;
+      if ((index >= 0) && (index <= last)) load(index);
+    }
+    int target = hint.load(std::memory_order_relaxed);
+    if (target >= 0) {
+      for (int i = 0; i < 2; i++) {
+        int index = target / BLOCK_FRAMES + i * dir;
+        if ((index < 0) || (index > last)) continue;
+        int held = blocks[index % NUM_BLOCKS].index.load(std::memory_order_relaxed);
+        if ((held < 0) || !inWindow(held, head, dir)) load(index);
       }
-      conv.process(&result[0], &sampleCount, &subResult[0], &outCount);
-      sampleCount = outCount;
-      return subResult;
     }
+  }
 
-    return result;
+  void Stream::load(int index) {
+    Block &block = blocks[index % NUM_BLOCKS];
+    if (block.index.load(std::memory_order_relaxed) == index) return;
+    block.index.store(-1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    drwav_uint64 read = 0;
+    if (drwav_seek_to_pcm_frame(&decoder->wav, (drwav_uint64)index * BLOCK_FRAMES)) {
+      read = drwav_read_pcm_frames_f32(&decoder->wav, BLOCK_FRAMES, pcm.data());
+    }
+    for (drwav_uint64 i = 0; i < read; i++) {
+      const float *in = &pcm[i * channels];
+      mixFrame(block.frames[i], in[0], in[channels > 1 ? 1 : 0], channels);
+    }
+    for (int i = read; i < BLOCK_FRAMES; i++) {
+      block.frames[i].samples[0] = 0.0f;
+      block.frames[i].samples[1] = 0.0f;
+    }
+    block.index.store(index, std::memory_order_release);
   }
 
-  void saveWave(std::vector<rack::dsp::Frame<2>> &sample, int sampleRate, std::string path) {
+  void saveWave(const Sample<2> &sample, int sampleRate, std::string path) {
     drwav_data_format format;
     format.container = drwav_container_riff;
     format.format = DR_WAVE_FORMAT_PCM;
@@ -160,8 +502,9 @@ namespace waves {
     int *pSamples = (int*)calloc(2*sample.size(),sizeof(int));
     memset(pSamples, 0, 2*sample.size()*sizeof(int));
     for (unsigned int i = 0; i < sample.size(); i++) {
-    	*(pSamples+2*i)= floor(sample[i].samples[0]*1990000000);
-    	*(pSamples+2*i+1)= floor(sample[i].samples[1]*1990000000);
+    	rack::dsp::Frame<2> frame = sample.frame(i);
+    	*(pSamples+2*i)= floor(frame.samples[0]*1990000000);
+    	*(pSamples+2*i+1)= floor(frame.samples[1]*1990000000);
     }
 
     drwav wav;
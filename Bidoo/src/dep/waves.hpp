@@ -1,12 +1,183 @@
 #pragma once
 #include <rack.hpp>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#if !defined(METAMODULE)
+#include <chrono>
+#include <thread>
+#endif
 
 namespace waves {
 
+// Decoded audio, either as float frames or, with compact storage, as
+// interleaved int16 times a scale which halves the RAM. Readers go through
+// size() and frame() so they do not depend on the storage.
+template <size_t CHANNELS>
+struct Sample {
+  std::vector<rack::dsp::Frame<CHANNELS>> frames;
+  std::vector<int16_t> pcm;
+  float scale = 0.0f;
+  int channels = 0;
+  int sampleRate = 0;
+  int sampleCount = 0;
+  // rate the frames are at, 0 when unknown, and the file they were decoded
+  // from (path, mtime, size), empty for buffers that are not a plain decode
+  int frameRate = 0;
+  std::string fileKey;
+
+  size_t size() const {
+    return pcm.empty() ? frames.size() : pcm.size() / CHANNELS;
+  }
+
+  rack::dsp::Frame<CHANNELS> frame(size_t i) const {
+    if (pcm.empty()) return frames[i];
+    rack::dsp::Frame<CHANNELS> frame;
+    for (size_t c = 0; c < CHANNELS; c++) frame.samples[c] = pcm[i * CHANNELS + c] * scale;
+    return frame;
+  }
+
+  // 16 bit material in full scale converts back exactly, louder material
+  // (resampler overshoot, float files) is scaled to its peak instead of clipped
+  void compact() {
+    float peak = 0.0f;
+    for (const rack::dsp::Frame<CHANNELS> &frame : frames) {
+      for (size_t c = 0; c < CHANNELS; c++) peak = std::max(peak, std::fabs(frame.samples[c]));
+    }
+    scale = (peak > 1.0f) ? peak / 32767.0f : 1.0f / 32768.0f;
+    float gain = 1.0f / scale;
+    pcm.resize(frames.size() * CHANNELS);
+    for (size_t i = 0; i < frames.size(); i++) {
+      for (size_t c = 0; c < CHANNELS; c++) {
+        pcm[i * CHANNELS + c] = (int16_t)std::max(-32768L, std::min(32767L, std::lrint(frames[i].samples[c] * gain)));
+      }
+    }
+    std::vector<rack::dsp::Frame<CHANNELS>>().swap(frames);
+  }
+
+  std::vector<rack::dsp::Frame<CHANNELS>> expand() const {
+    if (pcm.empty()) return frames;
+    std::vector<rack::dsp::Frame<CHANNELS>> result(size());
+    for (size_t i = 0; i < result.size(); i++) result[i] = frame(i);
+    return result;
+  }
+};
+
+typedef std::shared_ptr<const Sample<1>> MonoSample;
+typedef std::shared_ptr<const Sample<2>> StereoSample;
+
 std::vector<rack::dsp::Frame<1>> getMonoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount);
 
 std::vector<rack::dsp::Frame<2>> getStereoWav(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount);
 
-void saveWave(std::vector<rack::dsp::Frame<2>> &sample, int sampleRate, std::string path);
+// Decoded samples shared by every module of the process, keyed by path, file
+// modification time and target sample rate. The cache only keeps weak
+// references, a decode lives as long as one module holds it. compact selects
+// the int16 storage.
+MonoSample getMonoSample(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount, bool compact = false);
+
+StereoSample getStereoSample(const std::string path, const float currentSampleRate, std::string &waveFileName, std::string &waveExtension, int &sampleChannels, int &sampleRate, int &sampleCount, bool compact = false);
+
+// Brings a sample already in memory to a new engine sample rate without
+// reading the file again, for onSampleRateChange(). Returns the sample itself
+// when it is already at that rate and null when its rate is unknown, the
+// caller reloads the file then. Resampled decodes go through the cache too.
+MonoSample resampleSample(const MonoSample &sample, const float currentSampleRate, bool compact = false);
+
+StereoSample resampleSample(const StereoSample &sample, const float currentSampleRate, bool compact = false);
+
+struct StreamDecoder;
+
+// Disk streaming of a WAV file too long to be held in RAM. The audio thread
+// reads frames out of a fixed set of blocks that a worker keeps filled around
+// the play head and around a hinted jump target (loop or slice start), so the
+// memory used does not depend on the file length. Frames stay at the file
+// sample rate and a missing block is counted as an underrun and reads silent.
+struct Stream {
+  static const int BLOCK_FRAMES = 4096;
+  static const int NUM_BLOCKS = 32;
+  static const int READ_AHEAD = 12;
+
+  int channels = 0;
+  int sampleRate = 0;
+  int sampleCount = 0;
+  std::atomic<uint32_t> underruns{0};
+
+  ~Stream();
+
+  bool open(const std::string &path);
+
+  // audio thread
+  bool read(int frame, rack::dsp::Frame<2> &out);
+  void setPlayHead(int frame, bool reverse);
+  void setHint(int frame);
+
+  // worker thread
+  void fill();
+
+private:
+  struct Block {
+    std::atomic<int> index{-1};
+    rack::dsp::Frame<2> frames[BLOCK_FRAMES];
+  };
+
+  Block blocks[NUM_BLOCKS];
+  std::atomic<int> playHead{0};
+  std::atomic<bool> reverse{false};
+  std::atomic<int> hint{-1};
+  StreamDecoder *decoder = NULL;
+  std::vector<float> pcm;
+
+  bool inWindow(int block, int head, int dir);
+  void load(int block);
+};
+
+#if !defined(METAMODULE)
+// Rack side worker filling a module's stream while it has one, MetaModule
+// modules call Stream::fill() from their AsyncThread instead. The module
+// calls start() when it publishes a stream, fill() returns false once no
+// stream is published anymore and the thread then ends by itself, after one
+// more pass so the dropped stream is collected once the audio thread let go.
+struct StreamWorker {
+  std::thread thread;
+  std::atomic<bool> running{false};
+  std::atomic<bool> quit{false};
+
+  // a no-op while the thread runs, only called from the loader thread
+  template <typename F>
+  void start(F fill) {
+    if (running.exchange(true)) return;
+    // the previous thread may still be winding down
+    if (thread.joinable()) thread.join();
+    thread = std::thread([this, fill]() {
+      bool dropped = false;
+      while (!quit) {
+        if (fill()) {
+          dropped = false;
+        }
+        else if (dropped) {
+          // a stream published meanwhile is filled on, unless its start()
+          // already waits for this thread to end
+          running = false;
+          if (!fill() || running.exchange(true)) return;
+          dropped = false;
+        }
+        else {
+          dropped = true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      }
+    });
+  }
+
+  ~StreamWorker() {
+    quit = true;
+    if (thread.joinable()) thread.join();
+  }
+};
+#endif
+
+void saveWave(const Sample<2> &sample, int sampleRate, std::string path);
 
 }
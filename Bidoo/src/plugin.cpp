@@ -81,6 +81,8 @@ void InstantiateExpanderItem::onAction(const event::Action &e) {
 json_t *BidooModule::dataToJson() {
 	json_t *rootJ = json_object();
 	json_object_set_new(rootJ, "themeId", json_integer(themeId));
+	if (controlRateSupported)
+		json_object_set_new(rootJ, "controlRateDivision", json_integer(controlRateDivision));
 	return rootJ;
 }
 
@@ -88,6 +90,9 @@ void BidooModule::dataFromJson(json_t *rootJ) {
 	json_t *themeIdJ = json_object_get(rootJ, "themeId");
 	if (themeIdJ)
 		themeId = json_integer_value(themeIdJ);
+	json_t *controlRateDivisionJ = json_object_get(rootJ, "controlRateDivision");
+	if (controlRateDivisionJ)
+		controlRateDivision = clamp((int)json_integer_value(controlRateDivisionJ), 1, 64);
 }
 
 void BidooWidget::appendContextMenu(Menu *menu) {
@@ -100,6 +105,16 @@ void BidooWidget::appendContextMenu(Menu *menu) {
 		menu->addChild(construct<BlueItem>(&MenuItem::text, dynamic_cast<BidooModule*>(module)->themeId == 3 ? "Blue ✓" : "Blue", &BlueItem::module, dynamic_cast<BidooModule*>(module), &BlueItem::pWidget, dynamic_cast<BidooWidget*>(this)));
 		menu->addChild(construct<GreenItem>(&MenuItem::text, dynamic_cast<BidooModule*>(module)->themeId == 4 ? "Green ✓" : "Green", &GreenItem::module, dynamic_cast<BidooModule*>(module), &GreenItem::pWidget, dynamic_cast<BidooWidget*>(this)));
 	}));
+	BidooModule *bidooModule = dynamic_cast<BidooModule*>(module);
+	if (bidooModule && bidooModule->controlRateSupported) {
+		menu->addChild(createSubmenuItem("Control rate", "", [=](ui::Menu* menu) {
+			static const int divisions[6] = {1, 4, 8, 16, 32, 64};
+			for (int division : divisions) {
+				std::string text = division == 1 ? "Audio rate" : std::to_string(division) + " samples";
+				menu->addChild(construct<ControlRateItem>(&MenuItem::text, bidooModule->controlRateDivision == division ? text + " ✓" : text, &ControlRateItem::module, bidooModule, &ControlRateItem::division, division));
+			}
+		}));
+	}
 }
 
 unsigned int packedColor(int r, int g, int b, int a) {
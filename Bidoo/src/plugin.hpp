@@ -1,4 +1,5 @@
 #include "rack.hpp"
+#include <cstring>
 
 using namespace rack;
 
@@ -71,12 +72,90 @@ struct InstantiateExpanderItem : MenuItem {
 	void onAction(const event::Action &e) override;
 };
 
+// Linear ramp towards a value evaluated at control rate, four polyphony
+// channels at once for the float_4 paths. The target is reached after the
+// given number of samples.
+struct ControlRamp4 {
+	simd::float_4 value = 0.0f;
+	simd::float_4 target = 0.0f;
+	simd::float_4 delta = 0.0f;
+	int remaining = 0;
+	bool started = false;
+
+	void setTarget(const simd::float_4 t, const int samples) {
+		target = t;
+		if (!started || (samples <= 1)) {
+			value = t;
+			remaining = 0;
+			started = true;
+		}
+		else {
+			delta = (t - value) / samples;
+			remaining = samples;
+		}
+	}
+
+	simd::float_4 process() {
+		if (remaining > 0) {
+			remaining--;
+			value = remaining == 0 ? target : value + delta;
+		}
+		return value;
+	}
+};
+
+// [7/6] Pade approximant of tanh, within 1e-4 of it once clamped
+template <typename T>
+inline T fastTanh(T x) {
+	x = simd::clamp(x, -5.0f, 5.0f);
+	T x2 = x * x;
+	T y = x * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2))) / (135135.0f + x2 * (62370.0f + x2 * (3150.0f + x2 * 28.0f)));
+	return simd::clamp(y, -1.0f, 1.0f);
+}
+
+// phase^exponent of the ZOUMAI and ENCORE slides, phase in [0, 1] and the
+// exponent in the 0.01 steps of their former lookup table. log2 and exp2 are
+// taken from the float bits with short minimax polynomials, within 2e-5 of
+// powf without a libm call.
+inline float slideCurve(const float slide, const float phase) {
+	float exponent = (int)(slide*99.0f)*0.01f;
+	if (exponent == 0.0f) return 1.0f;
+	if (phase < 1.17549435e-38f) return 0.0f;
+
+	int32_t i;
+	std::memcpy(&i, &phase, sizeof(i));
+	float e = (float)((i >> 23) - 127);
+	i = (i & 0x007FFFFF) | 0x3F800000;
+	float u;
+	std::memcpy(&u, &i, sizeof(u));
+	u -= 1.0f;
+	float l = exponent * (e + u * (1.44196547f + u * (-0.70966143f + u * (0.41759159f + u * (-0.19626464f + u * 0.04638330f)))));
+
+	float lf = std::floor(l);
+	float f = l - lf;
+	i = ((int32_t)lf + 127) << 23;
+	float y;
+	std::memcpy(&y, &i, sizeof(y));
+	return y * (1.0f + f * (0.69304484f + f * (0.24128022f + f * (0.05224245f + f * 0.01342670f))));
+}
+
 struct BidooModule : Module {
 	int themeId = -1;
 	bool themeChanged = true;
 	bool loadDefault = true;
+	bool controlRateSupported = false;
+	int controlRateDivision = 1;
+	int controlRateCounter = 0;
 	json_t *dataToJson() override;
 	void dataFromJson(json_t *rootJ) override;
+
+	// true on the samples where control rate mappings are evaluated, every
+	// controlRateDivision samples starting with the first one
+	bool controlRateTick() {
+		bool tick = controlRateCounter == 0;
+		if (++controlRateCounter >= controlRateDivision) controlRateCounter = 0;
+		return tick;
+	}
 };
 
 struct BidooWidget : ModuleWidget {
@@ -135,6 +214,15 @@ struct BidooWidget : ModuleWidget {
 		}
 	};
 
+	struct ControlRateItem : MenuItem {
+		BidooModule *module;
+		int division;
+		void onAction(const event::Action &e) override {
+			module->controlRateDivision = division;
+			module->controlRateCounter = 0;
+		}
+	};
+
 	struct GreenItem : MenuItem {
 		BidooModule *module;
 		BidooWidget *pWidget;